@@ -0,0 +1,20 @@
+/*
+Copyright (C) 2025  Neo Reinmann (neoreinmann@gmail.com)
+*/
+
+#ifndef SIXTE_ANNULUS_H
+#define SIXTE_ANNULUS_H
+
+#include <cmath>
+
+/**
+ * @brief Ring around the optical axis in a plane z = const, radii in mm.
+ */
+struct Annulus {
+    double r_lo, r_hi;
+
+    [[nodiscard]] double area() const { return M_PI * (r_hi * r_hi - r_lo * r_lo); }
+};
+
+
+#endif //SIXTE_ANNULUS_H
@@ -0,0 +1,57 @@
+/*
+Copyright (C) 2025  Neo Reinmann (neoreinmann@gmail.com)
+*/
+
+#ifndef SIXTE_GRAZINGANGLES_H
+#define SIXTE_GRAZINGANGLES_H
+
+#include "Vec3fa.h"
+#include "RayHistory.h"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Grazing angles of the reflections of a ray, in order, stored inline like the ids of RayHistory.
+ * Recorded at every reflection whatever the history level, the throughput of a path at any energy
+ * follows from these angles (EffectiveAreaAccumulator).
+ */
+class GrazingAngles {
+public:
+    static constexpr std::size_t capacity = RayHistory::capacity;
+
+    /**
+     * @brief Angle between a ray and the surface it hits [rad], from the direction and the surface normal.
+     */
+    static float between(const Vec3fa &direction, const Vec3fa &normal) {
+        const float cosine = std::abs(dot(direction, normal)) / std::sqrt(dot(direction, direction) * dot(normal, normal));
+        return std::asin(std::min(1.f, cosine));
+    }
+
+    void clear() {
+        size_ = 0;
+        truncated_ = false;
+    }
+
+    void record(float angle) {
+        if (size_ == capacity) {
+            truncated_ = true;
+            return;
+        }
+        angles_[size_++] = angle;
+    }
+
+    [[nodiscard]] std::size_t size() const { return size_; }
+    [[nodiscard]] bool empty() const { return size_ == 0; }
+    [[nodiscard]] bool truncated() const { return truncated_; }
+    [[nodiscard]] float operator[](std::size_t i) const { return angles_[i]; }
+
+private:
+    float angles_[capacity]{};
+    std::uint8_t size_ = 0;
+    bool truncated_ = false;
+};
+
+
+#endif //SIXTE_GRAZINGANGLES_H
@@ -6,14 +6,10 @@ Copyright (C) 2025  Neo Reinmann (neoreinmann@gmail.com)
 #define SIXTE_RAY_H
 
 #include "Vec3fa.h"
+#include "RayHistory.h"
+#include "GrazingAngles.h"
+#include "SpectralWeights.h"
 #include <embree4/rtcore.h>
-#include <vector>
-
-struct shape_id {
-    shape_id(short id, const Vec3fa &origin, const Vec3fa &direction) : id(id), origin(origin), direction(direction) {}
-    short id{};
-    Vec3fa origin, direction;
-};
 
 class Ray {
 public:
@@ -27,7 +23,11 @@ public:
     void set_normal(const Vec3fa& v);
 
     double energy;
-    std::vector<shape_id> raytracing_history{};
+    // Statistical weight, 1 unless simulation_details weighting="weighted" (surface/Weighting.h)
+    double weight = 1.0;
+    RayHistory raytracing_history{};
+    GrazingAngles grazing_angles{};
+    SpectralWeights spectral_weights{};
     RTCRayHit rayhit{};
 };
 #endif //SIXTE_RAY_H
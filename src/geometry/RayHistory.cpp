@@ -0,0 +1,17 @@
+/*
+Copyright (C) 2025  Neo Reinmann (neoreinmann@gmail.com)
+*/
+
+#include "RayHistory.h"
+
+#include <stdexcept>
+
+HistoryLevel history_level_from_string(const std::string &level) {
+    if (level == "off")
+        return HistoryLevel::off;
+    if (level == "ids")
+        return HistoryLevel::ids;
+    if (level == "full")
+        return HistoryLevel::full;
+    throw std::runtime_error("simulation_details: history must be off, ids or full, not " + level);
+}
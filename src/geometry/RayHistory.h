@@ -0,0 +1,103 @@
+/*
+Copyright (C) 2025  Neo Reinmann (neoreinmann@gmail.com)
+*/
+
+#ifndef SIXTE_RAYHISTORY_H
+#define SIXTE_RAYHISTORY_H
+
+#include "Vec3fa.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include <string>
+
+// How much of its path a ray records, set with simulation_details history="off|ids|full"
+enum class HistoryLevel : std::uint8_t {
+    off,    // nothing
+    ids,    // id of every surface hit
+    full    // id, position and direction at every surface hit
+};
+
+/**
+ * @brief Parses "off", "ids" or "full", throws std::runtime_error for anything else.
+ */
+HistoryLevel history_level_from_string(const std::string &level);
+
+/**
+ * @brief Surfaces a ray hit, in order. The ids are kept in a small array inside the ray, the positions and
+ * directions of HistoryLevel::full in a RayHistory::Path outside of it (see RayStorage), which rays are bound to
+ * before they are traced at that level. Recording never allocates at any level.
+ */
+class RayHistory {
+public:
+    // Longest path of any module: 5 lobster eye bounces plus 10 pore walls, Wolter needs 4
+    static constexpr std::size_t capacity = 16;
+
+    // Position and direction of the ray at every recorded hit
+    struct Path {
+        std::array<Vec3fa, capacity> origin, direction;
+    };
+
+    /**
+     * @brief Sets where the positions and directions go at HistoryLevel::full, the history does not own it.
+     */
+    void bind(Path *path) { path_ = path; }
+
+    /**
+     * @brief Empties the history and sets what record keeps from now on.
+     * Throws std::runtime_error for HistoryLevel::full if no path is bound.
+     */
+    void reset(HistoryLevel level) {
+        if (level == HistoryLevel::full && path_ == nullptr)
+            throw std::runtime_error("RayHistory: history=\"full\" needs rays bound to a RayStorage");
+        level_ = level;
+        size_ = 0;
+        total_ = 0;
+    }
+
+    void record(short id, const Vec3fa &origin, const Vec3fa &direction) {
+        if (level_ == HistoryLevel::off)
+            return;
+        total_++;
+        if (size_ == capacity)
+            return;
+        ids_[size_] = id;
+        if (level_ == HistoryLevel::full) {
+            path_->origin[size_] = origin;
+            path_->direction[size_] = direction;
+        }
+        size_++;
+    }
+
+    [[nodiscard]] HistoryLevel level() const { return level_; }
+    // Recorded hits, at most capacity
+    [[nodiscard]] std::size_t size() const { return size_; }
+    [[nodiscard]] bool empty() const { return size_ == 0; }
+    // All hits, including those past capacity that were not recorded
+    [[nodiscard]] std::size_t total() const { return total_; }
+    [[nodiscard]] bool truncated() const { return total_ > size_; }
+    [[nodiscard]] short id(std::size_t i) const { return ids_[i]; }
+    [[nodiscard]] std::span<const short> ids() const { return {ids_.data(), size_}; }
+
+    /**
+     * @brief Positions and directions of the recorded hits, empty unless the level is full.
+     */
+    [[nodiscard]] std::span<const Vec3fa> origins() const {
+        return level_ == HistoryLevel::full ? std::span<const Vec3fa>(path_->origin.data(), size_) : std::span<const Vec3fa>();
+    }
+    [[nodiscard]] std::span<const Vec3fa> directions() const {
+        return level_ == HistoryLevel::full ? std::span<const Vec3fa>(path_->direction.data(), size_) : std::span<const Vec3fa>();
+    }
+
+private:
+    std::array<short, capacity> ids_{};
+    std::uint8_t size_ = 0;
+    std::uint16_t total_ = 0;
+    HistoryLevel level_ = HistoryLevel::off;
+    Path *path_ = nullptr;
+};
+
+
+#endif //SIXTE_RAYHISTORY_H
@@ -0,0 +1,16 @@
+/*
+Copyright (C) 2025  Neo Reinmann (neoreinmann@gmail.com)
+*/
+
+#include "RayStorage.h"
+
+RayStorage::RayStorage(HistoryLevel history, std::size_t spectral_bins, std::size_t rays)
+        : spectral_bins_(spectral_bins), spectral_weights_(rays * spectral_bins) {
+    if (history == HistoryLevel::full)
+        paths_.resize(rays);
+}
+
+void RayStorage::bind(Ray &ray, std::size_t slot) {
+    ray.raytracing_history.bind(paths_.empty() ? nullptr : &paths_[slot]);
+    ray.spectral_weights.bind(spectral_bins_ > 0 ? spectral_weights_.data() + slot * spectral_bins_ : nullptr);
+}
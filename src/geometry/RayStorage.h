@@ -0,0 +1,41 @@
+/*
+Copyright (C) 2025  Neo Reinmann (neoreinmann@gmail.com)
+*/
+
+#ifndef SIXTE_RAYSTORAGE_H
+#define SIXTE_RAYSTORAGE_H
+
+#include "Ray.h"
+#include <cstddef>
+#include <vector>
+
+/**
+ * @brief Side storage of the rays of one chunk for what only some runs need, so Ray itself stays what the
+ * trace needs: the positions and directions of HistoryLevel::full and the weights of the spectral mode.
+ * Each part is only allocated in the runs that use it.
+ *
+ * Rays point into their slot, so the storage has to outlive their trace and everything that reads them.
+ * PhotonEngine keeps one per chunk and copies the hits out (HitBatch) before the chunk ends.
+ */
+class RayStorage {
+public:
+    /**
+     * @param history Level the rays are traced at
+     * @param spectral_bins Weights per ray, 0 outside the spectral mode
+     * @param rays Number of slots
+     */
+    RayStorage(HistoryLevel history, std::size_t spectral_bins, std::size_t rays);
+
+    /**
+     * @brief Points ray to slot, it keeps that slot until it is bound again.
+     */
+    void bind(Ray &ray, std::size_t slot);
+
+private:
+    std::size_t spectral_bins_;
+    std::vector<RayHistory::Path> paths_;
+    std::vector<float> spectral_weights_;
+};
+
+
+#endif //SIXTE_RAYSTORAGE_H
@@ -0,0 +1,46 @@
+/*
+Copyright (C) 2025  Neo Reinmann (neoreinmann@gmail.com)
+*/
+
+#ifndef SIXTE_SPECTRALWEIGHTS_H
+#define SIXTE_SPECTRALWEIGHTS_H
+
+#include <algorithm>
+#include <cstddef>
+#include <stdexcept>
+
+/**
+ * @brief Weight of a ray in every energy bin of the spectral mode, 1 at the start and multiplied by the
+ * reflectivity of every reflection. The number of bins is fixed for a run. The weights are not part of the
+ * ray, they live in a RayStorage the ray is bound to before it is traced, which is only allocated in the
+ * spectral mode. Outside of it the weights are empty.
+ */
+class SpectralWeights {
+public:
+    /**
+     * @brief Sets where the weights go, at least as many floats as bins of the run. Not owned.
+     */
+    void bind(float *weights) { weights_ = weights; }
+
+    /**
+     * @brief Sets every weight to 1. Throws std::runtime_error for bins > 0 if no storage is bound.
+     */
+    void reset(std::size_t bins) {
+        if (bins > 0 && weights_ == nullptr)
+            throw std::runtime_error("SpectralWeights: the spectral mode needs rays bound to a RayStorage");
+        size_ = bins;
+        std::fill_n(weights_, bins, 1.f);
+    }
+
+    [[nodiscard]] std::size_t size() const { return size_; }
+    [[nodiscard]] bool empty() const { return size_ == 0; }
+    [[nodiscard]] float operator[](std::size_t bin) const { return weights_[bin]; }
+    float &operator[](std::size_t bin) { return weights_[bin]; }
+
+private:
+    float *weights_ = nullptr;
+    std::size_t size_ = 0;
+};
+
+
+#endif //SIXTE_SPECTRALWEIGHTS_H
@@ -0,0 +1,85 @@
+/*
+Copyright (C) 2025  Neo Reinmann (neoreinmann@gmail.com)
+*/
+
+#include "WorkStealingPool.h"
+
+#include <algorithm>
+#include <exception>
+#include <thread>
+
+WorkStealingPool::WorkStealingPool(unsigned n_threads) : n_threads_(n_threads) {
+    if (n_threads_ == 0)
+        n_threads_ = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned i = 0; i < n_threads_; i++)
+        queues_.emplace_back(std::make_unique<WorkQueue>());
+}
+
+unsigned WorkStealingPool::size() const {
+    return n_threads_;
+}
+
+void WorkStealingPool::run(std::size_t n_chunks, const std::function<void(unsigned, std::size_t)> &task) {
+    // Contiguous blocks keep neighbouring photons on the same core as long as nobody has to steal
+    for (unsigned w = 0; w < n_threads_; w++) {
+        std::size_t begin = n_chunks * w / n_threads_;
+        std::size_t end = n_chunks * (w + 1) / n_threads_;
+        std::lock_guard<std::mutex> lock(queues_[w]->mutex);
+        queues_[w]->chunks.clear();
+        for (std::size_t c = begin; c < end; c++)
+            queues_[w]->chunks.push_back(c);
+    }
+
+    std::exception_ptr error = nullptr;
+    std::mutex error_mutex;
+
+    auto worker_loop = [&](unsigned worker) {
+        std::size_t chunk;
+        while (pop_own(worker, chunk) || steal(worker, chunk)) {
+            try {
+                task(worker, chunk);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(error_mutex);
+                if (!error)
+                    error = std::current_exception();
+            }
+        }
+    };
+
+    if (n_threads_ == 1) {
+        worker_loop(0);
+    } else {
+        std::vector<std::thread> threads;
+        threads.reserve(n_threads_);
+        for (unsigned w = 0; w < n_threads_; w++)
+            threads.emplace_back(worker_loop, w);
+        for (auto &thread : threads)
+            thread.join();
+    }
+
+    if (error)
+        std::rethrow_exception(error);
+}
+
+bool WorkStealingPool::pop_own(unsigned worker, std::size_t &chunk) {
+    std::lock_guard<std::mutex> lock(queues_[worker]->mutex);
+    if (queues_[worker]->chunks.empty())
+        return false;
+    chunk = queues_[worker]->chunks.front();
+    queues_[worker]->chunks.pop_front();
+    return true;
+}
+
+bool WorkStealingPool::steal(unsigned thief, std::size_t &chunk) {
+    // No new chunks appear during a run, so one sweep over all victims finding nothing means we are done
+    for (unsigned i = 1; i < n_threads_; i++) {
+        unsigned victim = (thief + i) % n_threads_;
+        std::lock_guard<std::mutex> lock(queues_[victim]->mutex);
+        if (queues_[victim]->chunks.empty())
+            continue;
+        chunk = queues_[victim]->chunks.back();
+        queues_[victim]->chunks.pop_back();
+        return true;
+    }
+    return false;
+}
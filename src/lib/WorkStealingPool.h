@@ -0,0 +1,53 @@
+/*
+Copyright (C) 2025  Neo Reinmann (neoreinmann@gmail.com)
+*/
+
+#ifndef SIXTE_WORKSTEALINGPOOL_H
+#define SIXTE_WORKSTEALINGPOOL_H
+
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/**
+ * @brief Runs a fixed number of independent chunks on N worker threads.
+ *
+ * Every worker starts with a contiguous block of chunk indices in its own deque and takes work
+ * from the front. Once its deque is empty it steals from the back of the other workers' deques,
+ * so uneven chunks (e.g. photons that miss vs. photons that bounce 4 times) do not leave cores idle.
+ */
+class WorkStealingPool {
+public:
+    /**
+     * @param n_threads Number of workers, 0 selects std::thread::hardware_concurrency()
+     */
+    explicit WorkStealingPool(unsigned n_threads = 0);
+
+    [[nodiscard]] unsigned size() const;
+
+    /**
+     * @brief Calls task(worker, chunk) once for every chunk in [0, n_chunks) and blocks until all are done.
+     * @param n_chunks Number of chunks to process
+     * @param task Callable, worker is in [0, size()) and identifies the calling thread
+     * @throws The first exception thrown by any task, after all workers have stopped
+     */
+    void run(std::size_t n_chunks, const std::function<void(unsigned worker, std::size_t chunk)>& task);
+
+private:
+    struct WorkQueue {
+        std::mutex mutex;
+        std::deque<std::size_t> chunks;
+    };
+
+    bool pop_own(unsigned worker, std::size_t &chunk);
+    bool steal(unsigned thief, std::size_t &chunk);
+
+    unsigned n_threads_;
+    std::vector<std::unique_ptr<WorkQueue>> queues_;
+};
+
+
+#endif //SIXTE_WORKSTEALINGPOOL_H
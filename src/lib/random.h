@@ -7,12 +7,191 @@ Copyright (C) 2025  Neo Reinmann (neoreinmann@gmail.com)
 #endif //RAYTRACINGTOOLS_RANDOM_H
 #pragma once
 
+#include <array>
+#include <cstddef>
+#include <cstdint>
 #include <random>
 
-static std::random_device rd;
-static std::mt19937 mt(rd());
-static std::uniform_real_distribution<double> dist(0.0, 1.0);
+// SplitMix64 finalizer, used to derive well separated keys from (run seed, run).
+inline std::uint64_t mix_seed(std::uint64_t x) {
+    x += 0x9E3779B97F4A7C15ull;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+
+/**
+ * Philox4x32-10 counter-based generator from "Parallel Random Numbers: As Easy as 1, 2, 3"
+ * by Salmon et al. (2011). The output is a pure function of (counter, key), so there is no state
+ * to share or to advance sequentially.
+ */
+struct Philox4x32 {
+    using Counter = std::array<std::uint32_t, 4>;
+    using Key = std::array<std::uint32_t, 2>;
+
+    static Counter generate(Counter ctr, Key key) {
+        for (int round = 0; round < 10; round++) {
+            if (round > 0) {
+                key[0] += 0x9E3779B9u;
+                key[1] += 0xBB67AE85u;
+            }
+            const std::uint64_t p0 = (std::uint64_t) 0xD2511F53u * ctr[0];
+            const std::uint64_t p1 = (std::uint64_t) 0xCD9E8D57u * ctr[2];
+            ctr = {(std::uint32_t) (p1 >> 32) ^ ctr[1] ^ key[0], (std::uint32_t) p1,
+                   (std::uint32_t) (p0 >> 32) ^ ctr[3] ^ key[1], (std::uint32_t) p0};
+        }
+        return ctr;
+    }
+};
+
+/**
+ * Owen scrambled 2D Sobol points, with the hash based scrambling of Burley, "Practical Hash-based Owen
+ * Scrambling" (JCGT 2020). Points are 32 bit fixed point numbers in [0, 2^32).
+ */
+namespace sobol {
+    inline std::uint32_t reverse_bits(std::uint32_t x) {
+        x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+        x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+        x = ((x >> 4) & 0x0F0F0F0Fu) | ((x & 0x0F0F0F0Fu) << 4);
+        x = ((x >> 8) & 0x00FF00FFu) | ((x & 0x00FF00FFu) << 8);
+        return (x >> 16) | (x << 16);
+    }
+
+    // Dimension 1 of the Sobol sequence, direction numbers v_k = v_{k-1} ^ (v_{k-1} >> 1)
+    inline std::uint32_t second_dimension(std::uint32_t i) {
+        std::uint32_t x = 0;
+        for (std::uint32_t v = 1u << 31; i != 0; i >>= 1, v ^= v >> 1)
+            if (i & 1u)
+                x ^= v;
+        return x;
+    }
+
+    // Nested uniform (Owen) scrambling in base 2: the Laine-Karras hash on the reversed bits
+    inline std::uint32_t scramble(std::uint32_t x, std::uint32_t seed) {
+        x = reverse_bits(x);
+        x += seed;
+        x ^= x * 0x6C50B47Cu;
+        x ^= x * 0xB82F1E52u;
+        x ^= x * 0xC7AFE638u;
+        x ^= x * 0x8D22F6E6u;
+        return reverse_bits(x);
+    }
+
+    /**
+     * Point i of a shuffled and scrambled 2D Sobol set. Scrambling the index permutes the points within
+     * every aligned block of 2^m indices, so the first 2^m points of a set still form a (0, m, 2)-net,
+     * and different seeds give uncorrelated sets that can be padded into more dimensions.
+     */
+    inline std::array<std::uint32_t, 2> point(std::uint32_t i, std::uint32_t seed) {
+        i = scramble(i, seed);
+        return {scramble(reverse_bits(i), (std::uint32_t) mix_seed(seed)),
+                scramble(second_dimension(i), (std::uint32_t) mix_seed(seed + 1ull))};
+    }
+}
+
+// Source of RandomStream::uniform2
+enum class Sampling { random, sobol };
+
+/**
+ * Random numbers of one photon, keyed by (run seed, photon id, bounce, draw index).
+ *
+ * The counter is (draw block, bounce, photon id low, photon id high) and the key is the run seed,
+ * so every photon and every bounce has its own independent stream: a photon can be regenerated on
+ * its own, and parallel runs are bit-reproducible no matter which thread traces which photon.
+ * Draws are produced in bulk, kBlocks Philox blocks at a time, into a small buffer.
+ */
+class RandomStream {
+public:
+    static constexpr std::size_t kBlocks = 8;
+    static constexpr std::size_t kBufferSize = 2 * kBlocks; // two 53 bit doubles per block
+
+    RandomStream() {
+        std::random_device rd;
+        begin_photon(((std::uint64_t) rd() << 32) | rd(), 0);
+    }
+
+    // Starts the stream of photon `photon_id` at bounce 0, draw 0.
+    void begin_photon(std::uint64_t seed, std::uint64_t photon_id) {
+        key_ = {(std::uint32_t) seed, (std::uint32_t) (seed >> 32)};
+        photon_id_ = photon_id;
+        set_bounce(0);
+    }
+
+    // Switches to the stream of the given bounce, draw index restarts at 0.
+    void set_bounce(std::uint32_t bounce) {
+        bounce_ = bounce;
+        block_ = 0;
+        next_ = kBufferSize;
+        pair_ = 0;
+    }
+
+    // Kept across begin_photon, the photon engine sets it on every worker
+    void set_sampling(Sampling sampling) {
+        sampling_ = sampling;
+    }
+
+    [[nodiscard]] Sampling sampling() const {
+        return sampling_;
+    }
+
+    [[nodiscard]] std::uint32_t bounce() const {
+        return bounce_;
+    }
+
+    double uniform() {
+        if (next_ == kBufferSize)
+            refill();
+        return buffer_[next_++];
+    }
+
+    /**
+     * Two numbers in [0, 1) for one 2D sample, like an aperture position or a microfacet normal.
+     * Sampling::random draws them with uniform(). With Sampling::sobol the k-th pair of a bounce is point
+     * (photon id mod 2^32) of its own scrambled Sobol set, seeded by (run seed, bounce, k): the photons of
+     * a run fill every pair of dimensions evenly, uniform() stays random.
+     */
+    std::array<double, 2> uniform2() {
+        if (sampling_ == Sampling::random)
+            return {uniform(), uniform()};
+        const std::uint64_t seed = ((std::uint64_t) key_[1] << 32) | key_[0];
+        const auto p = sobol::point((std::uint32_t) photon_id_,
+                                    (std::uint32_t) mix_seed(seed ^ mix_seed(((std::uint64_t) bounce_ << 32) | pair_++)));
+        return {p[0] * 0x1.0p-32, p[1] * 0x1.0p-32};
+    }
+
+private:
+    void refill() {
+        for (std::size_t b = 0; b < kBlocks; b++) {
+            const Philox4x32::Counter out = Philox4x32::generate(
+                    {block_ + (std::uint32_t) b, bounce_, (std::uint32_t) photon_id_, (std::uint32_t) (photon_id_ >> 32)}, key_);
+            buffer_[2 * b] = to_unit(out[0], out[1]);
+            buffer_[2 * b + 1] = to_unit(out[2], out[3]);
+        }
+        block_ += kBlocks;
+        next_ = 0;
+    }
+
+    // 53 random bits -> [0, 1)
+    static double to_unit(std::uint32_t hi, std::uint32_t lo) {
+        return (double) (((std::uint64_t) (hi >> 5) << 26) | (lo >> 6)) * 0x1.0p-53;
+    }
+
+    Philox4x32::Key key_{};
+    std::uint64_t photon_id_ = 0;
+    std::uint32_t bounce_ = 0;
+    std::uint32_t block_ = 0;
+    std::uint32_t pair_ = 0;
+    Sampling sampling_ = Sampling::random;
+    std::size_t next_ = kBufferSize;
+    std::array<double, kBufferSize> buffer_{};
+};
+
+// One stream per thread; the photon engine positions it with begin_photon before every photon.
+inline RandomStream& random_stream() {
+    thread_local RandomStream stream;
+    return stream;
+}
 
 inline double easy_uniform_random () {
-    return dist(mt);
-}
\ No newline at end of file
+    return random_stream().uniform();
+}
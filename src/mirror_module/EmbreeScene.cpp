@@ -3,72 +3,409 @@ Copyright (C) 2025  Neo Reinmann (neoreinmann@gmail.com)
 */
 
 #include "EmbreeScene.h"
+#include "lib/random.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+
+BvhOptions BvhOptions::from_xml(const XMLData &xml_data) {
+    const auto details = xml_data.child("telescope").child("raytracer").child("simulation_details");
+    BvhOptions options;
+    options.quality = quality_from_string(details.attributeAsStringOr("bvh_quality", "high"));
+    options.compact = details.attributeAsStringOr("bvh_compact", "false") == "true";
+    // Embree only honours the quality of a geometry in a two level build
+    const auto raytracing = xml_data.child("telescope").child("raytracer");
+    for (const char *mesh : {"spider", "optical", "sensor"})
+        if (const auto node = raytracing.optionalChild(mesh))
+            options.two_level = options.two_level || options.mesh_quality(*node) != options.quality;
+    return options;
+}
+
+RTCBuildQuality BvhOptions::quality_from_string(const std::string &quality) {
+    if (quality == "low")
+        return RTC_BUILD_QUALITY_LOW;
+    if (quality == "medium")
+        return RTC_BUILD_QUALITY_MEDIUM;
+    if (quality == "high")
+        return RTC_BUILD_QUALITY_HIGH;
+    throw std::runtime_error("bvh_quality must be low, medium or high, not " + quality);
+}
+
+RTCBuildQuality BvhOptions::mesh_quality(const XMLNode &mesh) const {
+    return mesh.hasAttribute("bvh_quality") ? quality_from_string(mesh.attributeAsString("bvh_quality")) : quality;
+}
+
+RTCScene BvhOptions::new_scene(RTCDevice device) const {
+    RTCScene scene = rtcNewScene(device);
+    rtcSetSceneFlags(scene, compact ? RTC_SCENE_FLAG_ROBUST | RTC_SCENE_FLAG_COMPACT : RTC_SCENE_FLAG_ROBUST);
+    rtcSetSceneBuildQuality(scene, two_level ? RTC_BUILD_QUALITY_LOW : quality);
+    return scene;
+}
 
-std::optional<Ray> EmbreeScene::ray_trace(Ray &ray) {
-    if(embree_ray_trace(ray, 4)) {
+std::optional<Ray> EmbreeScene::ray_trace(Ray &ray, const CoatingContext &coating) const {
+    ray.raytracing_history.reset(history_level);
+    ray.grazing_angles.clear();
+    ray.spectral_weights.reset(coating.spectrum != nullptr ? coating.spectrum->size() : 0);
+    ray.weight = 1.0;
+    if(embree_ray_trace(ray, max_depth, coating)) {
         return ray;
     }
     return std::nullopt;
 }
 
-bool EmbreeScene::embree_ray_trace(Ray &ray, int depth) {
+bool EmbreeScene::embree_ray_trace(Ray &ray, int depth, const CoatingContext &coating) const {
+    if (coating.blocker_prepass && blocked_before_shells(ray.rayhit.ray))
+        return false;
+    std::uint32_t bounce = 0;
      while (depth > 0) {
+        // Random numbers drawn on this bounce come from their own stream
+        random_stream().set_bounce(++bounce);
         // Intersect
+        intersect(ray);
+
+        BounceResult result = process_hit(ray, depth, coating);
+        if (result != BounceResult::reflected)
+            return result == BounceResult::sensor;
+        // Decrease depth
+        depth--;
+    }
+    return false;
+}
+
+void EmbreeScene::ray_trace_batch(std::vector<Ray> &rays, std::uint64_t stream_key, std::uint64_t first_photon,
+                                  std::vector<char> &on_sensor, const CoatingContext &coating) const {
+    on_sensor.assign(rays.size(), 0);
+    for (Ray &ray : rays) {
+        ray.raytracing_history.reset(history_level);
+        ray.grazing_angles.clear();
+        ray.spectral_weights.reset(coating.spectrum != nullptr ? coating.spectrum->size() : 0);
+        ray.weight = 1.0;
+    }
+    std::vector<std::uint32_t> active(rays.size());
+    std::iota(active.begin(), active.end(), 0);
+    if (coating.blocker_prepass)
+        std::erase_if(active, [&](std::uint32_t idx) { return blocked_before_shells(rays[idx].rayhit.ray); });
+    std::vector<std::uint32_t> fallback;
+    fallback.reserve(rays.size());
+    RandomStream &stream = random_stream();
+
+    std::uint32_t bounce = 0;
+    for (int depth = max_depth; depth > 0 && !active.empty(); depth--) {
+        bounce++;
+        // Rays the radial shell index can not decide go through the BVH as packets
+        fallback.clear();
+        for (std::uint32_t idx : active)
+            if (!predicted_intersect(rays[idx].rayhit))
+                fallback.push_back(idx);
+        intersect_wavefront(scene, packet_width, rays, fallback);
+
+        std::size_t survivors = 0;
+        for (std::uint32_t idx : active) {
+            // Same stream the scalar path uses for this photon and bounce
+            stream.begin_photon(stream_key, first_photon + idx);
+            stream.set_bounce(bounce);
+            switch (process_hit(rays[idx], depth, coating)) {
+                case BounceResult::sensor:
+                    on_sensor[idx] = 1;
+                    break;
+                case BounceResult::lost:
+                    break;
+                case BounceResult::reflected:
+                    active[survivors++] = idx;
+                    break;
+            }
+        }
+        active.resize(survivors);
+    }
+}
+
+void EmbreeScene::intersect(Ray &ray) const {
+    if (!predicted_intersect(ray.rayhit))
         rtcIntersect1(scene, &ray.rayhit);
+}
 
-        if (ray.rayhit.hit.geomID == RTC_INVALID_GEOMETRY_ID)
-            return false;
+bool EmbreeScene::predicted_intersect(RTCRayHit &rayhit) const {
+    if (!predicted_path || shell_index.empty())
+        return false;
 
-        ray.raytracing_history.emplace_back((short) ray.rayhit.hit.geomID,
-                                             ray.position(),
-                                             ray.direction());
-        // Check if sensor was hit
-        if (sensor.isOnSensor(ray.rayhit)) {
-            if (depth == 4) {
-                return false;
+    // Slack for float rounding of hit points and boxes, in mm
+    constexpr double margin = 0.1;
+    constexpr double inf = std::numeric_limits<double>::infinity();
+
+    const RTCRay &ray = rayhit.ray;
+    const Vec3fa pos{ray.org_x, ray.org_y, ray.org_z};
+    const Vec3fa dir{ray.dir_x, ray.dir_y, ray.dir_z};
+    const double ox = ray.org_x, oy = ray.org_y, oz = ray.org_z;
+    const double dx = ray.dir_x, dy = ray.dir_y, dz = ray.dir_z;
+
+    float t_best = ray.tfar;
+    unsigned int geomID = RTC_INVALID_GEOMETRY_ID;
+    Vec3fa Ng{};
+
+    // Part of the ray within the axial range of the shells
+    double t0 = ray.tnear, t1 = ray.tfar;
+    if (dz != 0.0) {
+        const double ta = (shell_index.z_lo() - margin - oz) / dz;
+        const double tb = (shell_index.z_hi() + margin - oz) / dz;
+        t0 = std::max(t0, std::min(ta, tb));
+        t1 = std::min(t1, std::max(ta, tb));
+    } else if (oz < shell_index.z_lo() - margin || oz > shell_index.z_hi() + margin) {
+        t1 = -inf;
+    }
+
+    if (t0 <= t1) {
+        // The distance to the axis is convex along the ray: smallest where the ray passes the axis
+        // closest, largest at one of the ends
+        auto radius = [&](double t) { return std::hypot(ox + t * dx, oy + t * dy); };
+        const double dd = dx * dx + dy * dy;
+        const double t_axis = dd > 0.0 ? std::clamp(-(ox * dx + oy * dy) / dd, t0, t1) : t0;
+        const double r_lo = radius(t_axis) - margin;
+        const double r_hi = std::isinf(t1) ? (dd > 0.0 ? inf : radius(t0)) + margin
+                                           : std::max(radius(t0), radius(t1)) + margin;
+        const double z_a = oz + t0 * dz;
+        const double z_b = dz != 0.0 ? oz + t1 * dz : oz;
+
+        shell_index.for_each_candidate(r_lo, r_hi, std::min(z_a, z_b) - margin, std::max(z_a, z_b) + margin,
+                                       [&](const RadialShellIndex::Shell &shell) {
+            float t;
+            Vec3fa normal;
+            if (shell.paraboloid) {
+                const auto &para = prepared_paraboloids[shell.index];
+                if (Paraboloid::intersect(para, pos, dir, ray.tnear, t_best, t, normal)) {
+                    t_best = t;
+                    geomID = para.geomID;
+                    Ng = normal;
+                }
+            } else {
+                const auto &hyper = prepared_hyperboloids[shell.index];
+                if (Hyperboloid::intersect(hyper, pos, dir, ray.tnear, t_best, t, normal)) {
+                    t_best = t;
+                    geomID = hyper.geomID;
+                    Ng = normal;
+                }
             }
-            ray.set_position(ray.position() + ray.rayhit.ray.tfar * ray.direction());
-            return true;
+        });
+    }
+
+    // Sensor plane, same arithmetic as Plane::planeIntersectFunc. It only reports a hit if Embree
+    // visits its box, which is certain when the hit point lies well inside the sensor area.
+    const Plane_parameters &plane = sensor.planeParameters;
+    const double A = plane.a * ray.org_x + plane.b * ray.org_y + plane.c * ray.org_z + plane.d;
+    const double B = plane.a * ray.dir_x + plane.b * ray.dir_y + plane.c * ray.dir_z;
+    const double t_plane = -A / B;
+    if (!(t_plane < ray.tnear || t_plane > t_best)) {
+        const RTCBounds box = Plane::bounds(plane);
+        const double x = ox + t_plane * dx, y = oy + t_plane * dy;
+        const bool inside = x > box.lower_x + margin && x < box.upper_x - margin
+                            && y > box.lower_y + margin && y < box.upper_y - margin;
+        if (inside) {
+            t_best = (float) t_plane;
+            geomID = plane.geomID;
+            Ng = Vec3fa{plane.Ng_x, plane.Ng_y, plane.Ng_z};
+        } else {
+            // Slab test against the padded box over the whole ray, if it may be entered the BVH decides
+            const double org[3] = {ox, oy, oz}, d[3] = {dx, dy, dz};
+            const double lower[3] = {box.lower_x - margin, box.lower_y - margin, box.lower_z - margin};
+            const double upper[3] = {box.upper_x + margin, box.upper_y + margin, box.upper_z + margin};
+            double s0 = ray.tnear, s1 = ray.tfar;
+            for (int i = 0; i < 3 && s0 <= s1; i++) {
+                if (d[i] == 0.0) {
+                    if (org[i] < lower[i] || org[i] > upper[i])
+                        s1 = -inf;
+                    continue;
+                }
+                const double ta = (lower[i] - org[i]) / d[i], tb = (upper[i] - org[i]) / d[i];
+                s0 = std::max(s0, std::min(ta, tb));
+                s1 = std::min(s1, std::max(ta, tb));
+            }
+            if (s0 <= s1)
+                return false;
         }
+    }
 
-        // Check if spider was hit
-        if (ray.rayhit.hit.geomID == spider.geomID) {
+    // The spider is a mesh, leave rays it might block in front of the hit to the BVH
+    if (blocker_scene != nullptr) {
+        RTCRay shadow = ray;
+        shadow.tfar = t_best;
+        rtcOccluded1(blocker_scene, &shadow);
+        if (shadow.tfar < 0.f)
             return false;
+    }
+
+    if (geomID != RTC_INVALID_GEOMETRY_ID) {
+        rayhit.ray.tfar = t_best;
+        rayhit.hit.Ng_x = Ng.x;
+        rayhit.hit.Ng_y = Ng.y;
+        rayhit.hit.Ng_z = Ng.z;
+        rayhit.hit.primID = geomID;
+        rayhit.hit.geomID = geomID;
+        rayhit.hit.instID[0] = RTC_INVALID_GEOMETRY_ID;
+    }
+    return true;
+}
+
+bool EmbreeScene::blocked_before_shells(const RTCRay &ray) const {
+    if (blocker_scene == nullptr || ray.dir_z >= 0.f)
+        return false;
+    // Above the shells nothing but a blocker is in the way of a ray coming down
+    constexpr double margin = 0.1;
+    const double t_shells = (shell_index.z_hi() + margin - ray.org_z) / ray.dir_z;
+    if (t_shells <= ray.tnear)
+        return false;
+    RTCRay shadow = ray;
+    shadow.tfar = (float) std::min<double>(ray.tfar, t_shells);
+    rtcOccluded1(blocker_scene, &shadow);
+    return shadow.tfar < 0.f;
+}
+
+BounceResult EmbreeScene::process_hit(Ray &ray, int depth, const CoatingContext &coating) const {
+    if (ray.rayhit.hit.geomID == RTC_INVALID_GEOMETRY_ID)
+        return BounceResult::lost;
+
+    ray.raytracing_history.record((short) ray.rayhit.hit.geomID,
+                                  ray.position(),
+                                  ray.direction());
+    const GeometryEntry &entry = registry[ray.rayhit.hit.geomID];
+    // Check if sensor was hit
+    if (entry.role == GeometryRole::sensor) {
+        if (depth == max_depth) {
+            return BounceResult::lost;
         }
+        ray.set_position(ray.position() + ray.rayhit.ray.tfar * ray.direction());
+        return BounceResult::sensor;
+    }
 
-        // Add roughness if there is any
-        surfaceModel = find_surface_model(ray.rayhit.hit.geomID);
-        if (surfaceModel != nullptr)
-            if(!surfaceModel->simulate_surface(ray))
-                return false;
+    // Check if spider was hit
+    if (entry.role == GeometryRole::blocker) {
+        return BounceResult::lost;
+    }
 
-        // Reflect ray
-        if(!reflect_ray(ray))
-            return false;
-        // Decrease depth
-        depth--;
+    // Add roughness if there is any
+    if (coating.surface != nullptr)
+        if(!coating.surface->simulate_surface(ray, weighting))
+            return BounceResult::lost;
+
+    // Reflect ray
+    if(!reflect_ray(ray, coating))
+        return BounceResult::lost;
+    return BounceResult::reflected;
+}
+
+namespace {
+    void intersect_packet(const int *valid, RTCScene scene, RTCRayHit4 *rayhit) { rtcIntersect4(valid, scene, rayhit); }
+    void intersect_packet(const int *valid, RTCScene scene, RTCRayHit8 *rayhit) { rtcIntersect8(valid, scene, rayhit); }
+    void intersect_packet(const int *valid, RTCScene scene, RTCRayHit16 *rayhit) { rtcIntersect16(valid, scene, rayhit); }
+
+    template<typename Packet, int W>
+    void intersect_packets(RTCScene scene, std::vector<Ray> &rays, const std::vector<std::uint32_t> &active) {
+        Packet packet{};
+        alignas(64) int valid[W];
+        for (std::size_t first = 0; first < active.size(); first += W) {
+            const std::size_t lanes = std::min<std::size_t>(W, active.size() - first);
+            // Gather the compacted rays into SoA lanes, the tail of the last packet stays invalid
+            for (std::size_t l = 0; l < W; l++) {
+                valid[l] = l < lanes ? -1 : 0;
+                if (l >= lanes) continue;
+                const RTCRay &ray = rays[active[first + l]].rayhit.ray;
+                packet.ray.org_x[l] = ray.org_x;
+                packet.ray.org_y[l] = ray.org_y;
+                packet.ray.org_z[l] = ray.org_z;
+                packet.ray.tnear[l] = ray.tnear;
+                packet.ray.dir_x[l] = ray.dir_x;
+                packet.ray.dir_y[l] = ray.dir_y;
+                packet.ray.dir_z[l] = ray.dir_z;
+                packet.ray.time[l] = ray.time;
+                packet.ray.tfar[l] = ray.tfar;
+                packet.ray.mask[l] = ray.mask;
+                packet.ray.id[l] = ray.id;
+                packet.ray.flags[l] = ray.flags;
+                packet.hit.geomID[l] = RTC_INVALID_GEOMETRY_ID;
+                packet.hit.instID[0][l] = RTC_INVALID_GEOMETRY_ID;
+            }
+
+            intersect_packet(valid, scene, &packet);
+
+            // Scatter the hits back
+            for (std::size_t l = 0; l < lanes; l++) {
+                RTCRayHit &rayhit = rays[active[first + l]].rayhit;
+                rayhit.ray.tfar = packet.ray.tfar[l];
+                rayhit.hit.Ng_x = packet.hit.Ng_x[l];
+                rayhit.hit.Ng_y = packet.hit.Ng_y[l];
+                rayhit.hit.Ng_z = packet.hit.Ng_z[l];
+                rayhit.hit.u = packet.hit.u[l];
+                rayhit.hit.v = packet.hit.v[l];
+                rayhit.hit.primID = packet.hit.primID[l];
+                rayhit.hit.geomID = packet.hit.geomID[l];
+                rayhit.hit.instID[0] = packet.hit.instID[0][l];
+            }
+        }
+    }
+}
+
+int EmbreeScene::native_packet_width(RTCDevice device) {
+    if (rtcGetDeviceProperty(device, RTC_DEVICE_PROPERTY_NATIVE_RAY16_SUPPORTED))
+        return 16;
+    if (rtcGetDeviceProperty(device, RTC_DEVICE_PROPERTY_NATIVE_RAY8_SUPPORTED))
+        return 8;
+    return 4;
+}
+
+void EmbreeScene::intersect_wavefront(RTCScene scene, int packet_width, std::vector<Ray> &rays,
+                                      const std::vector<std::uint32_t> &active) {
+    switch (packet_width) {
+        case 16:
+            intersect_packets<RTCRayHit16, 16>(scene, rays, active);
+            break;
+        case 8:
+            intersect_packets<RTCRayHit8, 8>(scene, rays, active);
+            break;
+        default:
+            intersect_packets<RTCRayHit4, 4>(scene, rays, active);
+            break;
     }
-    return false;
 }
 
 EmbreeScene::EmbreeScene() {
     device = initializeDevice();
 }
 
+EmbreeScene::~EmbreeScene() {
+    if (blocker_scene != nullptr)
+        rtcReleaseScene(blocker_scene);
+    if (scene != nullptr)
+        rtcReleaseScene(scene);
+    if (device != nullptr)
+        rtcReleaseDevice(device);
+}
+
 RTCScene EmbreeScene::initializeScene(RTCDevice device)
 {
 
-    RTCScene scene = rtcNewScene(device);
-    rtcSetSceneFlags(scene, RTC_SCENE_FLAG_ROBUST);
-    rtcSetSceneBuildQuality(scene, RTC_BUILD_QUALITY_HIGH);
-    for  ( auto & paraboloid : paraboloids) {
+    RTCScene scene = bvh.new_scene(device);
+
+    registry.clear();
+
+    // Bake every shell once, the intersect callbacks only read these records. Both vectors are
+    // filled before any geometry takes a pointer into them.
+    prepared_paraboloids.clear();
+    for (const auto & paraboloid : paraboloids)
+        prepared_paraboloids.push_back(Paraboloid::prepare(paraboloid.paraboloid_parameters, shell_segmentation));
+    prepared_hyperboloids.clear();
+    for (const auto & hyperboloid : hyperboloids)
+        prepared_hyperboloids.push_back(Hyperboloid::prepare(hyperboloid.hyperboloid_parameters, shell_segmentation));
+
+    for  (std::size_t i = 0; i < paraboloids.size(); i++) {
+        auto & paraboloid = paraboloids[i];
         RTCGeometry geometry = rtcNewGeometry(device, RTC_GEOMETRY_TYPE_USER);
         auto* para = &paraboloid.paraboloid_parameters;
 
-        rtcSetGeometryUserPrimitiveCount(geometry,1);
-        rtcSetGeometryUserData(geometry,para);
+        rtcSetGeometryUserPrimitiveCount(geometry, shell_segmentation.primitives());
+        rtcSetGeometryUserData(geometry,&prepared_paraboloids[i]);
         para->geometry = geometry;
 
+        rtcSetGeometryBuildQuality(geometry, bvh.quality);
         rtcSetGeometryBoundsFunction(geometry, Paraboloid::paraboloidBoundsFunc, nullptr);
         rtcSetGeometryIntersectFunction(geometry, Paraboloid::paraboloidIntersectFunc);
         rtcSetGeometryOccludedFunction(geometry, Paraboloid::paraboloidOccludedFunc);
@@ -77,17 +414,21 @@ RTCScene EmbreeScene::initializeScene(RTCDevice device)
         rtcCommitGeometry(geometry);
         para->geomID = rtcAttachGeometry(scene,geometry);
         paraboloid.geomID = para->geomID;
+        prepared_paraboloids[i].geomID = para->geomID;
+        registry.add(para->geomID, GeometryRole::mirror, (std::int32_t) i);
         rtcReleaseGeometry(geometry);
     }
 
-    for  ( auto & hyperboloid : hyperboloids) {
+    for  (std::size_t i = 0; i < hyperboloids.size(); i++) {
+        auto & hyperboloid = hyperboloids[i];
         RTCGeometry geometry = rtcNewGeometry(device, RTC_GEOMETRY_TYPE_USER);
         auto* para = &hyperboloid.hyperboloid_parameters;
 
-        rtcSetGeometryUserPrimitiveCount(geometry,1);
-        rtcSetGeometryUserData(geometry,para);
+        rtcSetGeometryUserPrimitiveCount(geometry, shell_segmentation.primitives());
+        rtcSetGeometryUserData(geometry,&prepared_hyperboloids[i]);
         para->geometry = geometry;
 
+        rtcSetGeometryBuildQuality(geometry, bvh.quality);
         rtcSetGeometryBoundsFunction(geometry, Hyperboloid::hyperboloidBoundsFunc, nullptr);
         rtcSetGeometryIntersectFunction(geometry, Hyperboloid::hyperboloidIntersectFunc);
         rtcSetGeometryOccludedFunction(geometry, Hyperboloid::hyperboloidOccludedFunc);
@@ -96,6 +437,8 @@ RTCScene EmbreeScene::initializeScene(RTCDevice device)
         rtcCommitGeometry(geometry);
         para->geomID = rtcAttachGeometry(scene,geometry);
         hyperboloid.geomID = para->geomID;
+        prepared_hyperboloids[i].geomID = para->geomID;
+        registry.add(para->geomID, GeometryRole::mirror, (std::int32_t) i);
         rtcReleaseGeometry(geometry);
     }
     {
@@ -106,6 +449,7 @@ RTCScene EmbreeScene::initializeScene(RTCDevice device)
         rtcSetGeometryUserData(geometry, para);
         para->geometry = geometry;
 
+        rtcSetGeometryBuildQuality(geometry, bvh.quality);
         rtcSetGeometryBoundsFunction(geometry, Plane::planeBoundsFunc, nullptr);
         rtcSetGeometryIntersectFunction(geometry, Plane::planeIntersectFunc);
         rtcSetGeometryOccludedFunction(geometry, Plane::planeOccludedFunc);
@@ -113,11 +457,24 @@ RTCScene EmbreeScene::initializeScene(RTCDevice device)
         // Commit the geometry and attach it to the scene.
         rtcCommitGeometry(geometry);
         para->geomID = rtcAttachGeometry(scene, geometry);
+        registry.add(para->geomID, GeometryRole::sensor);
         rtcReleaseGeometry(geometry);
     }
-    if (!spider.filename.empty())
-        spider.geomID = addSTLMesh(spider.filename, spider.position, scene, device);
+    meshes.clear();
+    if (!spider.filename.empty()) {
+        meshes.push_back(TriangleMesh::load(spider.filename, spider.position, mesh_cache));
+        spider.geomID = addSTLMesh(*meshes.back(), scene, device, spider.build_quality);
+        registry.add(spider.geomID, GeometryRole::blocker);
+    }
     rtcCommitScene(scene);
+    packet_width = native_packet_width(device);
+
+    shell_index.build(prepared_paraboloids, prepared_hyperboloids);
+    if (!spider.filename.empty() && !shell_index.empty()) {
+        blocker_scene = bvh.new_scene(device);
+        addSTLMesh(*meshes.back(), blocker_scene, device, spider.build_quality);
+        rtcCommitScene(blocker_scene);
+    }
     return scene;
 }
 
@@ -140,12 +497,14 @@ void EmbreeScene::errorFunction([[maybe_unused]] void *userPtr, [[maybe_unused]]
 
 
 
-bool EmbreeScene::reflect_ray(Ray &ray) {
+bool EmbreeScene::reflect_ray(Ray &ray, const CoatingContext &coating) const {
     double angle = get_angle(ray.normal(), ray.direction());
     // Return position but no direction because ray is now trapped
     if (angle - M_PI / 2 < 0) {
         return false;
     }
+    if (!coating.apply(ray, weighting))
+        return false;
 
     ray.set_position(ray.position() + ray.rayhit.ray.tfar * ray.direction());
     ray.set_direction(reflect(ray.direction(), ray.normal()));
@@ -159,71 +518,10 @@ bool EmbreeScene::reflect_ray(Ray &ray) {
     return true;
 }
 
-unsigned int EmbreeScene::addSTLMesh(const std::string& path, const Vec3fa& position, RTCScene& scene, RTCDevice& device) {
-    stl_reader::StlMesh <float, unsigned int> mesh (path);
-    RTCGeometry rtcMesh = rtcNewGeometry (device, RTC_GEOMETRY_TYPE_TRIANGLE);
-    unsigned int geomID;
-    unsigned* indices = (unsigned*) rtcSetNewGeometryBuffer(rtcMesh,
-                                                            RTC_BUFFER_TYPE_INDEX,
-                                                            0,
-                                                            RTC_FORMAT_UINT3,
-                                                            3*sizeof(unsigned),
-                                                            mesh.num_tris());
-    float* vertices = (float*) rtcSetNewGeometryBuffer(rtcMesh,
-                                                       RTC_BUFFER_TYPE_VERTEX,
-                                                       0,
-                                                       RTC_FORMAT_FLOAT3,
-                                                       3*sizeof(float),
-                                                mesh.num_tris()*3);
-    int counter_indices = 0;
-    int counter_corner = 0;
-
-    for(size_t itri = 0; itri < mesh.num_tris(); ++itri) {
-        for(size_t icorner = 0; icorner < 3; ++icorner) {
-            const float* c = mesh.tri_corner_coords (itri, icorner);
-            if (vertices && indices)
-            {
-                vertices[counter_corner] = c[0] + position.x;
-                counter_corner++;
-                vertices[counter_corner] = c[1] + position.y;
-                counter_corner++;
-                vertices[counter_corner] = c[2] + position.z;
-                counter_corner++;
-            }
-        }
-        if (indices) {
-            indices[counter_indices] = counter_indices;
-            counter_indices++;
-            indices[counter_indices] = counter_indices;
-            counter_indices++;
-            indices[counter_indices] = counter_indices;
-            counter_indices++;
-        }
-    }
-    rtcCommitGeometry(rtcMesh);
-    geomID = rtcAttachGeometry(scene,rtcMesh);
-    rtcReleaseGeometry(rtcMesh);
+unsigned int EmbreeScene::addSTLMesh(const TriangleMesh &mesh, RTCScene scene, RTCDevice device,
+                                     RTCBuildQuality quality) {
+    RTCGeometry geometry = mesh.create_geometry(device, quality);
+    const unsigned int geomID = rtcAttachGeometry(scene, geometry);
+    rtcReleaseGeometry(geometry);
     return geomID;
 }
-
-std::shared_ptr<SurfaceModel> EmbreeScene::find_surface_model(unsigned int geomID) {
-    for (auto const &hyperboloid : hyperboloids) {
-        if (hyperboloid.geomID == geomID)
-            return hyperboloid.surface;
-    }
-    for (auto const &paraboloid : paraboloids) {
-        if (paraboloid.geomID == geomID)
-            return paraboloid.surface;
-    }
-    return nullptr;
-}
-
-
-
-
-
-
-
-
-
-
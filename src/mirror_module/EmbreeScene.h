@@ -11,41 +11,144 @@ Copyright (C) 2025  Neo Reinmann (neoreinmann@gmail.com)
 #include "shape/Plane.h"
 #include "sensor/Sensor.h"
 #include "shape/Spider.h"
-#include "lib/stl_reader.h"
+#include "shape/TriangleMesh.h"
+#include "RadialShellIndex.h"
+#include "GeometryRegistry.h"
+#include "surface/Reflectivity.h"
+#include "surface/Weighting.h"
 #include <embree4/rtcore.h>
+#include <cstdint>
 #include <optional>
+#include <vector>
 
+/**
+ * @brief How Embree builds the BVHs of a module, simulation_details bvh_quality and bvh_compact.
+ */
+struct BvhOptions {
+    RTCBuildQuality quality = RTC_BUILD_QUALITY_HIGH;
+    // RTC_SCENE_FLAG_COMPACT: less memory per node and triangle, somewhat slower traversal
+    bool compact = false;
+    // A mesh has its own quality: the scenes are built at RTC_BUILD_QUALITY_LOW, which Embree builds in two
+    // levels, one BVH per geometry at that geometry's quality under a quickly built top level. At medium and
+    // high Embree builds one BVH over all primitives and ignores the quality of the geometries.
+    bool two_level = false;
+
+    /**
+     * @brief bvh_quality ("low", "medium" or "high", default "high") and bvh_compact ("true" or "false"),
+     * two_level if <spider>, <optical> or <sensor> sets a bvh_quality other than the scene's.
+     */
+    static BvhOptions from_xml(const XMLData &xml_data);
+    static RTCBuildQuality quality_from_string(const std::string &quality);
+    /**
+     * @brief Build quality of a mesh element (<spider>, <optical>, <sensor>): its bvh_quality, else the scene's.
+     */
+    [[nodiscard]] RTCBuildQuality mesh_quality(const XMLNode &mesh) const;
+    /**
+     * @brief New empty scene on device with these options.
+     */
+    [[nodiscard]] RTCScene new_scene(RTCDevice device) const;
+};
+
+// What happened to a ray at one intersection of the trace loop
+enum class BounceResult {
+    sensor,     // ray ended on the sensor
+    lost,       // ray missed, got blocked or absorbed
+    reflected   // ray continues with the next bounce
+};
+
+/**
+ * @brief Committed Embree scene of a mirror module with the shapes its geometries point to.
+ *
+ * Built once by the module's create and then shared read only by all of its clones
+ * (std::shared_ptr<const EmbreeScene>), N workers trace one BVH. The trace entry points are const and
+ * re-entrant, what may differ between clones (coating and surface) comes in as a CoatingContext. The scene owns
+ * its device and scenes and releases them with the last clone; it can neither be copied nor moved,
+ * since the geometries keep pointers into it.
+ */
 class EmbreeScene {
 public:
     EmbreeScene();
-    EmbreeScene(const EmbreeScene&) = default;
-    EmbreeScene& operator=(const EmbreeScene&) = default;
+    EmbreeScene(const EmbreeScene&) = delete;
+    EmbreeScene& operator=(const EmbreeScene&) = delete;
 
-    EmbreeScene(EmbreeScene&&) noexcept = default;
-    EmbreeScene& operator=(EmbreeScene&&) noexcept = default;
+    ~EmbreeScene();
 
-    ~EmbreeScene() = default;
+    static constexpr int max_depth = 4;
+    static_assert(max_depth <= (int) RayHistory::capacity, "the ray history must hold every bounce");
 
-    [[nodiscard]] std::optional<Ray> ray_trace(Ray &ray);
+    [[nodiscard]] std::optional<Ray> ray_trace(Ray &ray, const CoatingContext &coating) const;
+    /**
+     * @brief Wavefront version of ray_trace: every bounce intersects all live rays with packet queries,
+     * compacts the survivors and applies the surfaces before the next bounce starts.
+     */
+    void ray_trace_batch(std::vector<Ray> &rays, std::uint64_t stream_key, std::uint64_t first_photon,
+                         std::vector<char> &on_sensor, const CoatingContext &coating) const;
     RTCScene initializeScene(RTCDevice device);
     static RTCDevice initializeDevice();
-    static unsigned int addSTLMesh(const std::string& path, const Vec3fa& position, RTCScene& scene, RTCDevice& device);
+    /**
+     * @brief Attaches a triangle geometry sharing the buffers of mesh to scene, returns its geomID.
+     * The mesh has to outlive the scene.
+     */
+    static unsigned int addSTLMesh(const TriangleMesh &mesh, RTCScene scene, RTCDevice device,
+                                   RTCBuildQuality quality = RTC_BUILD_QUALITY_HIGH);
+    /**
+     * @brief Widest packet (16, 8 or 4) the device traverses natively, falls back to 4.
+     */
+    static int native_packet_width(RTCDevice device);
+    /**
+     * @brief Intersects rays[active[i]] with the scene using rtcIntersect4/8/16 and writes the hits back into the rays.
+     */
+    static void intersect_wavefront(RTCScene scene, int packet_width, std::vector<Ray> &rays,
+                                    const std::vector<std::uint32_t> &active);
 
     std::vector<Hyperboloid> hyperboloids{};
     std::vector<Paraboloid> paraboloids{};
+    // Every shell geometry has one primitive per sector and band
+    ShellSegmentation shell_segmentation{32, 1};
+    // Baked by initializeScene, these are the user data of the shell geometries
+    std::vector<PreparedHyperboloid> prepared_hyperboloids{};
+    std::vector<PreparedParaboloid> prepared_paraboloids{};
     Spider spider{};
     Plane sensor;
-    RTCScene scene;
-    RTCDevice device;
+    RTCScene scene = nullptr;
+    RTCDevice device = nullptr;
+    int packet_width = 4;
+    // What the traced rays record, simulation_details history
+    HistoryLevel history_level = HistoryLevel::full;
+    // Role and shell of every geomID, filled by initializeScene
+    GeometryRegistry registry{};
+    // Resolve shell hits through the radial shell index instead of the BVH where possible
+    bool predicted_path = true;
+    RadialShellIndex shell_index{};
+    // Spider only, lets the fast path and the blocker pre-pass check that nothing blocks a ray
+    RTCScene blocker_scene = nullptr;
+    BvhOptions bvh{};
+    // Directory of the mesh cache, empty parses the STL files every time (TriangleMesh::cache_dir_from_xml)
+    std::string mesh_cache{};
+    // Meshes whose buffers the geometries share
+    std::vector<std::shared_ptr<const TriangleMesh>> meshes{};
+    // Analog or weighted surface losses, simulation_details weighting
+    Weighting weighting{};
 
 private:
     static void errorFunction(void* userPtr, enum RTCError error, const char* str);
-    bool embree_ray_trace(Ray &ray, int depth);
-    std::shared_ptr<SurfaceModel> find_surface_model(unsigned int geomID);
-    bool reflect_ray(Ray &ray);
-
-    std::shared_ptr<SurfaceModel> surfaceModel = nullptr;
-
+    bool embree_ray_trace(Ray &ray, int depth, const CoatingContext &coating) const;
+    /**
+     * @brief Closest hit like rtcIntersect1, answered by the radial shell index when it can decide the ray.
+     */
+    void intersect(Ray &ray) const;
+    /**
+     * @brief Fast path of intersect: tests only the shells whose radial range the ray passes through, then the
+     * sensor plane and the spider. Returns false, with the ray untouched, if the BVH has to decide.
+     */
+    bool predicted_intersect(RTCRayHit &rayhit) const;
+    /**
+     * @brief Blocker pre-pass (CoatingContext::blocker_prepass): one any-hit query against blocker_scene over the
+     * part of the ray above the shells. True if a blocker stops the ray there.
+     */
+    [[nodiscard]] bool blocked_before_shells(const RTCRay &ray) const;
+    BounceResult process_hit(Ray &ray, int depth, const CoatingContext &coating) const;
+    bool reflect_ray(Ray &ray, const CoatingContext &coating) const;
 };
 
 
@@ -0,0 +1,64 @@
+/*
+Copyright (C) 2025  Neo Reinmann (neoreinmann@gmail.com)
+*/
+
+#ifndef SIXTE_GEOMETRYREGISTRY_H
+#define SIXTE_GEOMETRYREGISTRY_H
+
+#include <cstdint>
+#include <vector>
+
+// What a geometry of the scene does to a ray that hits it
+enum class GeometryRole : std::uint8_t {
+    none,       // not registered, e.g. RTC_INVALID_GEOMETRY_ID
+    mirror,     // reflecting shell, rough if the trace context has a surface model
+    sensor,     // ends the ray
+    blocker,    // absorbs the ray (spider)
+    optic       // hands the ray to a sub-tracer (lobster eye pores)
+};
+
+struct GeometryEntry {
+    GeometryRole role = GeometryRole::none;
+    std::int32_t shell = -1;                // index into the module's shell vector, -1 if not a shell
+    std::uint32_t tally = no_tally;         // dense slot for per-surface counters
+
+    static constexpr std::uint32_t no_tally = UINT32_MAX;
+};
+
+/**
+ * @brief Per geomID description of a scene, filled while the geometries are attached.
+ * The trace loops look a hit up with one array access instead of comparing against every shape.
+ */
+class GeometryRegistry {
+public:
+    /**
+     * @brief Registers geomID, the tally slot is assigned here in registration order.
+     */
+    void add(unsigned int geomID, GeometryRole role, std::int32_t shell = -1) {
+        if (geomID >= entries_.size())
+            entries_.resize(geomID + 1);
+        entries_[geomID] = {role, shell, tally_slots_++};
+    }
+
+    void clear() {
+        entries_.clear();
+        tally_slots_ = 0;
+    }
+
+    /**
+     * @brief Entry of geomID, an unregistered id (RTC_INVALID_GEOMETRY_ID included) has role none.
+     */
+    [[nodiscard]] const GeometryEntry &operator[](unsigned int geomID) const {
+        return geomID < entries_.size() ? entries_[geomID] : unregistered_;
+    }
+
+    [[nodiscard]] std::uint32_t tally_slots() const { return tally_slots_; }
+
+private:
+    std::vector<GeometryEntry> entries_;
+    std::uint32_t tally_slots_ = 0;
+    static inline const GeometryEntry unregistered_{};
+};
+
+
+#endif //SIXTE_GEOMETRYREGISTRY_H
@@ -2,55 +2,107 @@
 Copyright (C) 2025  Neo Reinmann (neoreinmann@gmail.com)
 */
 #include "LobsterEyeOptic.h"
+#include "lib/random.h"
+#include <numeric>
 
 LobsterEyeOptic::LobsterEyeOptic(const XMLData &xml_data) {
-    device = EmbreeScene::initializeDevice();
     LobsterEyeOptic::create(xml_data);
 }
 
-std::optional<Ray> LobsterEyeOptic::ray_trace(Ray &ray) {
-    if(embree_ray_trace(ray, 5)) {
+std::optional<Ray> LobsterEyeOptic::ray_trace(Ray &ray) const {
+    ray.raytracing_history.reset(shared->history_level);
+    ray.grazing_angles.clear();
+    ray.spectral_weights.reset(spectrum_ ? spectrum_->size() : 0);
+    ray.weight = 1.0;
+    if(embree_ray_trace(ray, max_depth)) {
         return ray;
     }
     return std::nullopt;
 }
 
-bool LobsterEyeOptic::embree_ray_trace(Ray &ray, int depth) {
+bool LobsterEyeOptic::embree_ray_trace(Ray &ray, int depth) const {
+    std::uint32_t bounce = 0;
     while (depth > 0) {
+        // Random numbers drawn on this bounce (pore entry point) come from their own stream
+        random_stream().set_bounce(++bounce);
         // Intersect
-        rtcIntersect1(scene, &ray.rayhit);
-        Vec3fa normal = Vec3fa(ray.rayhit.hit.Ng_x, ray.rayhit.hit.Ng_y, ray.rayhit.hit.Ng_z);
-        ray.set_normal(normalize(normal));
+        rtcIntersect1(shared->scene, &ray.rayhit);
 
+        BounceResult result = process_hit(ray, depth);
+        if (result != BounceResult::reflected)
+            return result == BounceResult::sensor;
+        // Decrease depth
+        depth--;
+    }
+    return false;
+}
 
-        if (ray.rayhit.hit.geomID == RTC_INVALID_GEOMETRY_ID)
-            return false;
-
-        ray.raytracing_history.emplace_back((short) ray.rayhit.hit.geomID,
-                                            ray.position(),
-                                            ray.direction());
-        // Check if sensor was hit
-        if (ray.rayhit.hit.geomID == sensor.planeParameters.geomID) {
-            if (depth == 5) {
-                return false;
+void LobsterEyeOptic::ray_trace_batch(std::vector<Ray> &rays, std::uint64_t stream_key, std::uint64_t first_photon,
+                                      std::vector<char> &on_sensor) const {
+    on_sensor.assign(rays.size(), 0);
+    for (Ray &ray : rays) {
+        ray.raytracing_history.reset(shared->history_level);
+        ray.grazing_angles.clear();
+        ray.spectral_weights.reset(spectrum_ ? spectrum_->size() : 0);
+        ray.weight = 1.0;
+    }
+    std::vector<std::uint32_t> active(rays.size());
+    std::iota(active.begin(), active.end(), 0);
+    RandomStream &stream = random_stream();
+
+    std::uint32_t bounce = 0;
+    for (int depth = max_depth; depth > 0 && !active.empty(); depth--) {
+        bounce++;
+        EmbreeScene::intersect_wavefront(shared->scene, shared->packet_width, rays, active);
+
+        std::size_t survivors = 0;
+        for (std::uint32_t idx : active) {
+            stream.begin_photon(stream_key, first_photon + idx);
+            stream.set_bounce(bounce);
+            switch (process_hit(rays[idx], depth)) {
+                case BounceResult::sensor:
+                    on_sensor[idx] = 1;
+                    break;
+                case BounceResult::lost:
+                    break;
+                case BounceResult::reflected:
+                    active[survivors++] = idx;
+                    break;
             }
-            ray.set_position(ray.position() + ray.rayhit.ray.tfar * ray.direction());
-            return true;
         }
+        active.resize(survivors);
+    }
+}
 
-        if (ray.rayhit.hit.geomID == spider.geomID) {
-            return false;
-        } else if(ray.rayhit.hit.geomID == opticalMesh.geomID) {
+BounceResult LobsterEyeOptic::process_hit(Ray &ray, int depth) const {
+    Vec3fa normal = Vec3fa(ray.rayhit.hit.Ng_x, ray.rayhit.hit.Ng_y, ray.rayhit.hit.Ng_z);
+    ray.set_normal(normalize(normal));
+
+    if (ray.rayhit.hit.geomID == RTC_INVALID_GEOMETRY_ID)
+        return BounceResult::lost;
+
+    ray.raytracing_history.record((short) ray.rayhit.hit.geomID,
+                                  ray.position(),
+                                  ray.direction());
+    switch (shared->registry[ray.rayhit.hit.geomID].role) {
+        case GeometryRole::sensor:
+            if (depth == max_depth) {
+                return BounceResult::lost;
+            }
             ray.set_position(ray.position() + ray.rayhit.ray.tfar * ray.direction());
-            if(!pore.ray_trace(ray, depth)){
-                return false;
+            return BounceResult::sensor;
+        case GeometryRole::blocker:
+            return BounceResult::lost;
+        case GeometryRole::optic:
+            ray.set_position(ray.position() + ray.rayhit.ray.tfar * ray.direction());
+            if(!shared->pore.ray_trace(ray, depth, coating_context())){
+                return BounceResult::lost;
             }
-        }
-
-        // Decrease depth
-        depth--;
+            break;
+        default:
+            break;
     }
-    return false;
+    return BounceResult::reflected;
 }
 
 void LobsterEyeOptic::set_surface_parameter([[maybe_unused]] std::string model, [[maybe_unused]] std::string shadowing, [[maybe_unused]] double factor,
@@ -59,6 +111,8 @@ void LobsterEyeOptic::set_surface_parameter([[maybe_unused]] std::string model,
 }
 
 void LobsterEyeOptic::create(XMLData xml_data) {
+    auto scene = std::make_shared<Scene>();
+    scene->device = EmbreeScene::initializeDevice();
     const auto raytracing = xml_data.child("telescope").child("raytracer");
 
     std::string spider_flag = raytracing.child("spider").attributeAsString("spider");
@@ -68,25 +122,28 @@ void LobsterEyeOptic::create(XMLData xml_data) {
     spider_position.z = (float) raytracing.child("spider").attributeAsDouble("position_z");
     std::string spider_path = raytracing.child("spider").attributeAsString("path");
 
-    if (spider_flag == "true")
-        spider = Spider(spider_path, spider_position);
+    scene->bvh = BvhOptions::from_xml(xml_data);
+    if (spider_flag == "true") {
+        scene->spider = Spider(spider_path, spider_position);
+        scene->spider.build_quality = scene->bvh.mesh_quality(raytracing.child("spider"));
+    }
 
     std::string surface_model = raytracing.child("surface").attributeAsString("model");
-    std::string material_path = raytracing.child("surface").attributeAsString("material_path");
-    std::string material = raytracing.child("surface").attributeAsString("material");
 
     Vec3fa optical_position = {};
     optical_position.x = (float) raytracing.child("optical").attributeAsDouble("position_x");
     optical_position.y = (float) raytracing.child("optical").attributeAsDouble("position_y");
     optical_position.z = (float) raytracing.child("optical").attributeAsDouble("position_z");
     std::string optical_path = raytracing.child("optical").attributeAsString("path");
-    opticalMesh = OpticalMesh(optical_path, optical_position);
+    scene->opticalMesh = OpticalMesh(optical_path, optical_position);
+    scene->opticalMesh.build_quality = scene->bvh.mesh_quality(raytracing.child("optical"));
 
     double pore_width;
     double pore_length;
     pore_width = raytracing.child("type").attributeAsDouble("pore_width");
     pore_length = raytracing.child("type").attributeAsDouble("pore_length");
-    pore = Pore(pore_width, pore_length, Vec3fa(0,0,0), Vec3fa(0,0,0), material_path, material);
+    scene->pore = Pore(pore_width, pore_length, Vec3fa(0,0,0), Vec3fa(0,0,0));
+    set_reflectivity(ReflectivityTable::from_xml(xml_data));
 
     focal_length = raytracing.child("type").attributeAsDouble("focal_length");
 
@@ -99,22 +156,34 @@ void LobsterEyeOptic::create(XMLData xml_data) {
     if (sensor_mesh == "true") {
         std::string sensor_path = raytracing.child("sensor").attributeAsString("path");
 
-        mesh_sensor = Sensor(sensor_path, sensor_position);
+        scene->mesh_sensor = Sensor(sensor_path, sensor_position);
+        scene->mesh_sensor.build_quality = scene->bvh.mesh_quality(raytracing.child("sensor"));
     }
     double sensor_offset = raytracing.child("sensor").attributeAsDouble("offset");
 
-    sensor = Plane(0,0,1, sensor_offset, sensor_x, sensor_y);
-    scene = initializeScene(device);
+    scene->sensor = Plane(0,0,1, sensor_offset, sensor_x, sensor_y);
+    scene->history_level = history_level_from_string(raytracing.child("simulation_details").attributeAsStringOr("history", "full"));
+    scene->pore.set_weighting(Weighting::from_xml(xml_data));
+    scene->mesh_cache = TriangleMesh::cache_dir_from_xml(xml_data);
+    scene->initializeScene();
+    shared = std::move(scene);
+
+}
 
+LobsterEyeOptic::Scene::~Scene() {
+    if (scene != nullptr)
+        rtcReleaseScene(scene);
+    if (device != nullptr)
+        rtcReleaseDevice(device);
 }
 
-RTCScene LobsterEyeOptic::initializeScene(RTCDevice device) {
-    RTCScene scene = rtcNewScene(device);
-    rtcSetSceneFlags(scene, RTC_SCENE_FLAG_ROBUST);
-    rtcSetSceneBuildQuality(scene, RTC_BUILD_QUALITY_HIGH);
+void LobsterEyeOptic::Scene::initializeScene() {
+    scene = bvh.new_scene(device);
+    registry.clear();
 
     if (!mesh_sensor.filename.empty()) {
-        mesh_sensor.geomID = EmbreeScene::addSTLMesh(mesh_sensor.filename, mesh_sensor.position, scene, device);
+        meshes.push_back(TriangleMesh::load(mesh_sensor.filename, mesh_sensor.position, mesh_cache));
+        mesh_sensor.geomID = EmbreeScene::addSTLMesh(*meshes.back(), scene, device, mesh_sensor.build_quality);
         sensor.planeParameters.geomID = mesh_sensor.geomID;
     } else {
         RTCGeometry geometry = rtcNewGeometry(device, RTC_GEOMETRY_TYPE_USER);
@@ -124,6 +193,7 @@ RTCScene LobsterEyeOptic::initializeScene(RTCDevice device) {
         rtcSetGeometryUserData(geometry, para);
         para->geometry = geometry;
 
+        rtcSetGeometryBuildQuality(geometry, bvh.quality);
         rtcSetGeometryBoundsFunction(geometry, Plane::planeBoundsFunc, nullptr);
         rtcSetGeometryIntersectFunction(geometry, Plane::planeIntersectFunc);
         rtcSetGeometryOccludedFunction(geometry, Plane::planeOccludedFunc);
@@ -133,14 +203,24 @@ RTCScene LobsterEyeOptic::initializeScene(RTCDevice device) {
         para->geomID = rtcAttachGeometry(scene, geometry);
         rtcReleaseGeometry(geometry);
     }
+    registry.add(sensor.planeParameters.geomID, GeometryRole::sensor);
 
-    if (!spider.filename.empty())
-        spider.geomID = EmbreeScene::addSTLMesh(spider.filename, spider.position, scene, device);
-    opticalMesh.geomID = EmbreeScene::addSTLMesh(opticalMesh.filename, opticalMesh.position, scene, device);
+    if (!spider.filename.empty()) {
+        meshes.push_back(TriangleMesh::load(spider.filename, spider.position, mesh_cache));
+        spider.geomID = EmbreeScene::addSTLMesh(*meshes.back(), scene, device, spider.build_quality);
+        registry.add(spider.geomID, GeometryRole::blocker);
+    }
+    meshes.push_back(TriangleMesh::load(opticalMesh.filename, opticalMesh.position, mesh_cache));
+    opticalMesh.geomID = EmbreeScene::addSTLMesh(*meshes.back(), scene, device, opticalMesh.build_quality);
+    registry.add(opticalMesh.geomID, GeometryRole::optic);
     rtcCommitScene(scene);
-    return scene;
+    packet_width = EmbreeScene::native_packet_width(device);
 }
 
 double LobsterEyeOptic::get_focal_length() {
     return focal_length;
 }
+
+HistoryLevel LobsterEyeOptic::history_level() const {
+    return shared->history_level;
+}
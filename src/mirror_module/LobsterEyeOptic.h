@@ -11,6 +11,7 @@ Copyright (C) 2025  Neo Reinmann (neoreinmann@gmail.com)
 #include "shape/OpticalMesh.h"
 #include "shape/Plane.h"
 #include "shape/Pore.h"
+#include "surface/ReflectivityTable.h"
 
 #include "EmbreeScene.h"
 
@@ -20,6 +21,7 @@ public:
 
     ~LobsterEyeOptic() override = default;
 
+    // Shares the scene, only the coating is per copy
     LobsterEyeOptic(const LobsterEyeOptic &o) = default;
 
     LobsterEyeOptic(LobsterEyeOptic&& o) noexcept = default;
@@ -28,24 +30,52 @@ public:
         return std::make_unique<LobsterEyeOptic>(*this);
     }
 
-    std::optional<Ray> ray_trace(Ray& ray) override;
+    static constexpr int max_depth = 5;
+    static_assert(max_depth + Pore::max_depth <= (int) RayHistory::capacity,
+                  "the ray history must hold the bounces and one pore passage");
+
+    std::optional<Ray> ray_trace(Ray& ray) const override;
+    void ray_trace_batch(std::vector<Ray> &rays, std::uint64_t stream_key, std::uint64_t first_photon,
+                         std::vector<char> &on_sensor) const override;
 
     void set_surface_parameter(std::string model, std::string shadowing, double factor, double shadowing_factor) override;
     double get_focal_length() override;
+    [[nodiscard]] HistoryLevel history_level() const override;
 private:
-    Spider spider;
-    OpticalMesh opticalMesh;
-    Plane sensor;
-    Sensor mesh_sensor;
-    Pore pore;
-
+    /**
+     * @brief Committed scene and the shapes its geometries point to, built by create and shared read only by
+     * all clones. Owns the device and the scene, neither copyable nor movable.
+     */
+    struct Scene {
+        Spider spider;
+        OpticalMesh opticalMesh;
+        Plane sensor;
+        Sensor mesh_sensor;
+        Pore pore;
+
+        RTCScene scene = nullptr;
+        RTCDevice device = nullptr;
+        int packet_width = 4;
+        GeometryRegistry registry;
+        HistoryLevel history_level = HistoryLevel::full;
+        BvhOptions bvh{};
+        std::string mesh_cache;
+        // Meshes whose buffers the geometries share
+        std::vector<std::shared_ptr<const TriangleMesh>> meshes;
+
+        Scene() = default;
+        Scene(const Scene &) = delete;
+        Scene &operator=(const Scene &) = delete;
+        ~Scene();
+
+        void initializeScene();
+    };
+
+    std::shared_ptr<const Scene> shared;
     double focal_length;
 
-    RTCScene scene;
-    RTCDevice device;
-
-    RTCScene initializeScene(RTCDevice device);
-    bool embree_ray_trace(Ray &ray, int depth);
+    bool embree_ray_trace(Ray &ray, int depth) const;
+    BounceResult process_hit(Ray &ray, int depth) const;
     void create(XMLData xml_data) override;
 
 };
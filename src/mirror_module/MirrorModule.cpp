@@ -3,5 +3,13 @@ Copyright (C) 2025  Neo Reinmann (neoreinmann@gmail.com)
 */
 
 #include "MirrorModule.h"
+#include "lib/random.h"
 
-
+void MirrorModule::ray_trace_batch(std::vector<Ray> &rays, std::uint64_t stream_key, std::uint64_t first_photon,
+                                   std::vector<char> &on_sensor) const {
+    on_sensor.assign(rays.size(), 0);
+    for (std::size_t i = 0; i < rays.size(); i++) {
+        random_stream().begin_photon(stream_key, first_photon + i);
+        on_sensor[i] = ray_trace(rays[i]).has_value();
+    }
+}
@@ -7,16 +7,121 @@ Copyright (C) 2025  Neo Reinmann (neoreinmann@gmail.com)
 
 
 #include "geometry/Ray.h"
+#include "geometry/RayStorage.h"
+#include "geometry/Annulus.h"
 #include "lib/XMLData.h"
+#include "surface/Reflectivity.h"
+#include "surface/SurfaceModel.h"
+#include <cstdint>
 #include <memory>
+#include <string>
+#include <vector>
 
+/**
+ * @brief Optics traced by the photon engine. A module keeps its committed scene in a part shared read only by
+ * all of its clones, a clone is only the trace context of one worker and cheap to make. Tracing is const and
+ * re-entrant.
+ */
 class MirrorModule {
 public:
     virtual ~MirrorModule() = default;
     [[nodiscard]] virtual std::unique_ptr<MirrorModule> clone() const = 0;
-    virtual std::optional<Ray> ray_trace(Ray &ray) = 0;
+    virtual std::optional<Ray> ray_trace(Ray &ray) const = 0;
+    /**
+     * @brief Traces rays[i] as photon first_photon + i of the random streams with key stream_key.
+     * Rays are updated in place like in ray_trace, on_sensor[i] tells whether ray i ended on the sensor.
+     * The default traces one ray after the other, Embree based modules trace the batch as a wavefront.
+     */
+    virtual void ray_trace_batch(std::vector<Ray> &rays, std::uint64_t stream_key, std::uint64_t first_photon,
+                                 std::vector<char> &on_sensor) const;
+    /**
+     * @brief Replaces the surface model of the mirrors by a copy with these parameters. Like set_surface, clones
+     * made before keep the old surface.
+     */
     virtual void set_surface_parameter(std::string model, std::string shadowing, double factor, double shadowing_factor) = 0;
     virtual double get_focal_length() = 0;
+    /**
+     * @brief What the rays record of their path, simulation_details history="off|ids|full".
+     */
+    [[nodiscard]] virtual HistoryLevel history_level() const = 0;
+    /**
+     * @brief Shell a history id (RayHistory::id) belongs to, -1 for anything that is not a shell.
+     */
+    [[nodiscard]] virtual int shell_of([[maybe_unused]] short history_id) const { return -1; }
+    /**
+     * @brief Number of shells, shell_of returns ids in [0, shell_count()). 0 for modules without shells.
+     */
+    [[nodiscard]] virtual int shell_count() const { return 0; }
+    /**
+     * @brief Annuli of the plane z = z_start that rays with direction (tan_x, tan_y, -1) have to start from to
+     * reach a mirror. Empty if the module can not tell, then the whole aperture has to be sampled.
+     */
+    [[nodiscard]] virtual std::vector<Annulus> entrance_annuli([[maybe_unused]] double tan_x, [[maybe_unused]] double tan_y,
+                                                               [[maybe_unused]] double z_start) const { return {}; }
+    /**
+     * @brief Coating applied at every reflection, nullptr if reflections are lossless. Shared by all clones.
+     */
+    [[nodiscard]] const std::shared_ptr<const Reflectivity> &reflectivity() const { return reflectivity_; }
+    /**
+     * @brief Replaces the coating, nullptr makes reflections lossless. Clones made before keep the old one.
+     */
+    virtual void set_reflectivity(std::shared_ptr<const Reflectivity> reflectivity) {
+        reflectivity_ = std::move(reflectivity);
+    }
+    /**
+     * @brief Energies [keV] of the spectral mode, nullptr outside it. In the spectral mode reflections absorb
+     * nothing, every ray carries one weight per energy that each reflection multiplies by the reflectivity.
+     */
+    [[nodiscard]] const std::shared_ptr<const std::vector<double>> &spectrum() const { return spectrum_; }
+    /**
+     * @brief Switches the spectral mode on (energies) or off (nullptr). Clones made before keep the old one.
+     */
+    virtual void set_spectrum(std::shared_ptr<const std::vector<double>> energies) {
+        spectrum_ = std::move(energies);
+    }
+    /**
+     * @brief Side storage for rays traced by this module, with the history paths and spectral weights its
+     * history level and spectrum need. Rays have to be bound to it before they are traced.
+     */
+    [[nodiscard]] RayStorage ray_storage(std::size_t rays) const {
+        return {history_level(), spectrum_ != nullptr ? spectrum_->size() : 0, rays};
+    }
+    /**
+     * @brief Roughness applied at every mirror reflection, nullptr for ideal mirrors.
+     */
+    [[nodiscard]] const std::shared_ptr<const SurfaceModel> &surface() const { return surface_; }
+    /**
+     * @brief Replaces the surface model. Clones made before keep the old one, PhotonEngine hands the telescope's
+     * surface to its contexts at the start of every run.
+     */
+    void set_surface(std::shared_ptr<const SurfaceModel> surface) { surface_ = std::move(surface); }
+    /**
+     * @brief True if reflections record their grazing angle in Ray::grazing_angles, which only the effective
+     * area and the vignetting map read. Off by default. Clones made before keep the old setting.
+     */
+    [[nodiscard]] bool records_grazing_angles() const { return grazing_angles_; }
+    void set_record_grazing_angles(bool record) { grazing_angles_ = record; }
+    /**
+     * @brief True if every ray first gets one any-hit query against the blockers (spider) over its way to the
+     * mirrors and is dropped there if it is stopped, instead of finding the blocker as closest hit. The rays of
+     * the sensor are the same, the dropped ones just have no history entry for the blocker. Off by default,
+     * the vignetting map switches it on. Clones made before keep the old setting.
+     */
+    [[nodiscard]] bool blocker_prepass() const { return blocker_prepass_; }
+    void set_blocker_prepass(bool prepass) { blocker_prepass_ = prepass; }
+protected:
+    std::shared_ptr<const Reflectivity> reflectivity_;
+    std::shared_ptr<const std::vector<double>> spectrum_;
+    std::shared_ptr<const SurfaceModel> surface_;
+    bool grazing_angles_ = false;
+    bool blocker_prepass_ = false;
+
+    /**
+     * @brief What this context hands to the shared scene with every trace.
+     */
+    [[nodiscard]] CoatingContext coating_context() const {
+        return {reflectivity_.get(), spectrum_.get(), grazing_angles_, surface_.get(), blocker_prepass_};
+    }
 private:
     virtual void create(XMLData xml_data) = 0;
 };
@@ -0,0 +1,79 @@
+/*
+Copyright (C) 2025  Neo Reinmann (neoreinmann@gmail.com)
+*/
+
+#include "RadialShellIndex.h"
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+
+namespace {
+    // Only a shift along the axis keeps the radius of every surface point
+    bool on_axis(const ShellFrame &frame) {
+        return frame.untilted && frame.origin[0] == 0.f && frame.origin[1] == 0.f;
+    }
+}
+
+bool RadialShellIndex::build(const std::vector<PreparedParaboloid> &paraboloids,
+                             const std::vector<PreparedHyperboloid> &hyperboloids) {
+    shells_.clear();
+    std::vector<Shell> shells;
+
+    for (unsigned int i = 0; i < paraboloids.size(); i++) {
+        const auto &shell = paraboloids[i];
+        if (!on_axis(shell.frame))
+            return false;
+        // r grows with z
+        const double oz = shell.frame.origin[2];
+        shells.push_back({shell.radius(shell.z_min), shell.radius(shell.z_max),
+                          shell.z_min + oz, shell.z_max + oz, 0, true, i});
+    }
+    for (unsigned int i = 0; i < hyperboloids.size(); i++) {
+        const auto &shell = hyperboloids[i];
+        if (!on_axis(shell.frame))
+            return false;
+        const double oz = shell.frame.origin[2];
+        double r_lo, r_hi;
+        shell.radial_range(shell.z_min, shell.z_max, r_lo, r_hi);
+        shells.push_back({r_lo, r_hi, shell.z_min + oz, shell.z_max + oz, 0, false, i});
+    }
+    if (shells.empty())
+        return false;
+
+    std::sort(shells.begin(), shells.end(), [](const Shell &a, const Shell &b) { return a.r_lo < b.r_lo; });
+    z_lo_ = shells.front().z_lo;
+    z_hi_ = shells.front().z_hi;
+    double r_hi_prefix = 0;
+    for (auto &shell : shells) {
+        r_hi_prefix = std::max(r_hi_prefix, shell.r_hi);
+        shell.r_hi_prefix = r_hi_prefix;
+        z_lo_ = std::min(z_lo_, shell.z_lo);
+        z_hi_ = std::max(z_hi_, shell.z_hi);
+    }
+    shells_ = std::move(shells);
+    return true;
+}
+
+std::vector<Annulus> RadialShellIndex::entrance_annuli(double tan_x, double tan_y, double z_start) const {
+    // Slack for float rounding of the surfaces, in mm, as in the predicted path
+    constexpr double margin = 0.1;
+    const double tan_theta = std::hypot(tan_x, tan_y);
+
+    // Paraboloid i and hyperboloid i are one shell
+    std::map<unsigned int, Annulus> shells;
+    for (const Shell &shell : shells_) {
+        const double drift = tan_theta * std::max(0.0, z_start - shell.z_lo) + margin;
+        const Annulus annulus{shell.r_lo - drift, shell.r_hi + drift};
+        auto [it, inserted] = shells.emplace(shell.index, annulus);
+        if (!inserted) {
+            it->second.r_lo = std::min(it->second.r_lo, annulus.r_lo);
+            it->second.r_hi = std::max(it->second.r_hi, annulus.r_hi);
+        }
+    }
+    std::vector<Annulus> annuli;
+    annuli.reserve(shells.size());
+    for (const auto &[index, annulus] : shells)
+        annuli.push_back({std::max(0.0, annulus.r_lo), annulus.r_hi});
+    return annuli;
+}
@@ -0,0 +1,78 @@
+/*
+Copyright (C) 2025  Neo Reinmann (neoreinmann@gmail.com)
+*/
+
+#ifndef SIXTE_RADIALSHELLINDEX_H
+#define SIXTE_RADIALSHELLINDEX_H
+
+#include "shape/Paraboloid.h"
+#include "shape/Hyperboloid.h"
+#include "geometry/Annulus.h"
+#include <algorithm>
+#include <vector>
+
+/**
+ * @brief Shells of a Wolter module sorted by the radial range their surface covers.
+ *
+ * A ray segment that stays within [r_lo, r_hi] from the optical axis can only hit shells whose range
+ * overlaps that interval, usually the paraboloid and hyperboloid of one or two neighbouring shells.
+ */
+class RadialShellIndex {
+public:
+    struct Shell {
+        double r_lo, r_hi;      // radial range of the surface (world frame)
+        double z_lo, z_hi;      // axial range of the surface (world frame)
+        double r_hi_prefix;     // largest r_hi of this and all previous entries
+        bool paraboloid;
+        unsigned int index;     // into the prepared paraboloids or hyperboloids
+    };
+
+    /**
+     * @brief Indexes all shells. Shells that are tilted or moved off the axis have no radial range in the
+     * world frame, if there is one the index stays empty and build returns false.
+     */
+    bool build(const std::vector<PreparedParaboloid> &paraboloids,
+               const std::vector<PreparedHyperboloid> &hyperboloids);
+
+    [[nodiscard]] bool empty() const { return shells_.empty(); }
+
+    /**
+     * @brief Axial range covered by all shells.
+     */
+    [[nodiscard]] double z_lo() const { return z_lo_; }
+    [[nodiscard]] double z_hi() const { return z_hi_; }
+
+    /**
+     * @brief Calls visit(shell) for every shell overlapping the radial range [r_lo, r_hi] and the axial range [z_lo, z_hi].
+     */
+    template<typename Visit>
+    void for_each_candidate(double r_lo, double r_hi, double z_lo, double z_hi, Visit &&visit) const;
+
+    /**
+     * @brief Where in the plane z = z_start rays with direction (tan_x, tan_y, -1) start if they can hit a shell:
+     * one annulus per shell, covering its paraboloid and hyperboloid, widened by the lateral drift down to
+     * the lowest point of the shell. Empty if the index is.
+     */
+    [[nodiscard]] std::vector<Annulus> entrance_annuli(double tan_x, double tan_y, double z_start) const;
+
+private:
+    std::vector<Shell> shells_;  // sorted by r_lo
+    double z_lo_ = 0, z_hi_ = 0;
+};
+
+template<typename Visit>
+void RadialShellIndex::for_each_candidate(double r_lo, double r_hi, double z_lo, double z_hi, Visit &&visit) const {
+    // Last shell starting below r_hi, then walk inwards as long as anything may still reach up to r_lo
+    auto end = std::upper_bound(shells_.begin(), shells_.end(), r_hi,
+                                [](double r, const Shell &shell) { return r < shell.r_lo; });
+    for (auto it = end; it != shells_.begin();) {
+        --it;
+        if (it->r_hi_prefix < r_lo)
+            break;
+        if (it->r_hi >= r_lo && it->z_hi >= z_lo && it->z_lo <= z_hi)
+            visit(*it);
+    }
+}
+
+
+#endif //SIXTE_RADIALSHELLINDEX_H
@@ -3,15 +3,20 @@ Copyright (C) 2025  Neo Reinmann (neoreinmann@gmail.com)
 */
 
 #include "Wolter.h"
+#include <stdexcept>
 #include <string>
 
 Wolter::Wolter(const XMLData& xml_data) {
-    shapes = EmbreeScene();
     Wolter::create(xml_data);
 }
 
-std::optional<Ray> Wolter::ray_trace(Ray &ray) {
-    return shapes.ray_trace(ray);
+std::optional<Ray> Wolter::ray_trace(Ray &ray) const {
+    return shapes->ray_trace(ray, coating_context());
+}
+
+void Wolter::ray_trace_batch(std::vector<Ray> &rays, std::uint64_t stream_key, std::uint64_t first_photon,
+                             std::vector<char> &on_sensor) const {
+    shapes->ray_trace_batch(rays, stream_key, first_photon, on_sensor, coating_context());
 }
 
 
@@ -25,6 +30,25 @@ void Wolter::create_parameters(const double new_radius, Paraboloid_parameters &p
     h_pars.b = sqrt(pow(h_pars.c, 2) - pow(h_pars.a, 2));
 }
 
+void Wolter::shell_parameters(const double radius, const double focal_length, const double mirror_height,
+                              Paraboloid_parameters &p_pars, Hyperboloid_parameters &h_pars) {
+    p_pars.theta = asin(radius / focal_length) / 4;
+    h_pars.c = focal_length / 2;
+    p_pars.Xp_min = focal_length * cos(4 * p_pars.theta) + 2 * h_pars.c;
+    p_pars.Xp_max = mirror_height + p_pars.Xp_min;
+    p_pars.Yp_min = radius;
+    p_pars.p = p_pars.Yp_min * tan(p_pars.theta);
+    p_pars.Yp_max = sqrt(p_pars.p * (2 * p_pars.Xp_max + p_pars.p));
+
+    h_pars.theta = p_pars.theta;
+    h_pars.a = focal_length * (2 * cos(2*h_pars.theta) - 1) / 2;
+    h_pars.b = sqrt(pow(h_pars.c, 2) - pow(h_pars.a, 2));
+    h_pars.Xh_max = p_pars.Xp_min;
+    h_pars.Xh_min = p_pars.Xp_min - mirror_height;
+    h_pars.Yh_max = p_pars.Yp_min;
+    h_pars.Yh_min = h_pars.b * sqrt(pow(h_pars.Xh_min - h_pars.c, 2) / pow(h_pars.a, 2) - 1);
+}
+
 std::vector<std::string> split(std::string s, const std::string& delimiter) {
     std::vector<std::string> tokens;
     size_t pos = 0;
@@ -41,6 +65,7 @@ std::vector<std::string> split(std::string s, const std::string& delimiter) {
 
 
 void Wolter::create(XMLData xml_data) {
+    auto scene = std::make_shared<EmbreeScene>();
     Paraboloid_parameters p_pars{};
     Hyperboloid_parameters h_pars{};
 
@@ -63,13 +88,33 @@ void Wolter::create(XMLData xml_data) {
     std::string spider_path = raytracing.child("spider").attributeAsString("path");
 
 
-    if (spider_flag == "true")
-        shapes.spider = Spider(spider_path, spider_position);
+    scene->bvh = BvhOptions::from_xml(xml_data);
+    if (spider_flag == "true") {
+        scene->spider = Spider(spider_path, spider_position);
+        scene->spider.build_quality = scene->bvh.mesh_quality(raytracing.child("spider"));
+    }
 
+    // One surface model for all shells, kept per trace context so set_surface_parameter can swap it
     std::string surface_model = raytracing.child("surface").attributeAsString("model");
-    std::string material_path = raytracing.child("surface").attributeAsString("material_path");
-    std::string material = raytracing.child("surface").attributeAsString("material");
-
+    if (surface_model == "gauss") {
+        double factor = raytracing.child("surface").attributeAsDouble("roughness");
+        set_surface(std::make_shared<SurfaceModel>(std::make_unique<GaussSurface>(factor)));
+    } else if (surface_model == "microfacet") {
+        double factor = raytracing.child("surface").attributeAsDouble("roughness");
+        double factor_shadowing = raytracing.child("surface").attributeAsDouble("shadowing_alpha");
+        std::string mf_type = raytracing.child("surface").attributeAsString("type");
+        std::string mf_shadowing = raytracing.child("surface").attributeAsString("shadowing");
+        bool ggx = false;
+        bool ggx_shadowing = false;
+        if (mf_type == "ggx")
+            ggx = true;
+        if (mf_shadowing == "ggx")
+            ggx_shadowing = true;
+
+        set_surface(std::make_shared<SurfaceModel>(std::make_unique<Microfacet>(factor, factor_shadowing, ggx, ggx_shadowing)));
+    } else {
+        set_surface(std::make_shared<SurfaceModel>(std::make_unique<Dummy>()));
+    }
 
     const auto mirror = raytracing.child("mirror");
     std::string mirror_flag = mirror.attributeAsString("exact");
@@ -79,22 +124,7 @@ void Wolter::create(XMLData xml_data) {
     if (mirror_flag == "true") {
         auto shell_positions = split(mirror.attributeAsString("positions"), ",");
         for (const auto& shell : shell_positions) {
-            auto Ypmin = std::stod(shell);
-            p_pars.theta = asin(Ypmin / focal_length) / 4;
-            h_pars.c = focal_length / 2;
-            p_pars.Xp_min = focal_length * cos(4 * p_pars.theta) + 2 * h_pars.c;
-            p_pars.Xp_max = mirror_height + p_pars.Xp_min;
-            p_pars.Yp_min = Ypmin;
-            p_pars.p = p_pars.Yp_min * tan(p_pars.theta);
-            p_pars.Yp_max = sqrt(p_pars.p * (2 * p_pars.Xp_max + p_pars.p));
-
-            h_pars.theta = p_pars.theta;
-            h_pars.a = focal_length * (2 * cos(2*h_pars.theta) - 1) / 2;
-            h_pars.b = sqrt(pow(h_pars.c, 2) - pow(h_pars.a, 2));
-            h_pars.Xh_max = p_pars.Xp_min;
-            h_pars.Xh_min = p_pars.Xp_min - mirror_height;
-            h_pars.Yh_max = p_pars.Yp_min;
-            h_pars.Yh_min = h_pars.b * sqrt(pow(h_pars.Xh_min - h_pars.c, 2) / pow(h_pars.a, 2) - 1);
+            shell_parameters(std::stod(shell), focal_length, mirror_height, p_pars, h_pars);
 
             if (first_shell) {
                 /*p_pars.angle_x = 0.03 * M_PI / 180;
@@ -109,33 +139,8 @@ void Wolter::create(XMLData xml_data) {
                 h_pars.origin = Vec3fa(0, 0, z_offset);
             }
 
-            if (surface_model == "gauss") {
-                double factor = raytracing.child("surface").attributeAsDouble("roughness");
-                p_pars.surface = std::make_unique<SurfaceModel>(std::make_unique<GaussSurface>(factor));
-                h_pars.surface = std::make_unique<SurfaceModel>(std::make_unique<GaussSurface>(factor));
-
-
-            } else if (surface_model == "microfacet") {
-                double factor = raytracing.child("surface").attributeAsDouble("roughness");
-                double factor_shadowing = raytracing.child("surface").attributeAsDouble("shadowing_alpha");
-                std::string mf_type = raytracing.child("surface").attributeAsString("type");
-                std::string mf_shadowing = raytracing.child("surface").attributeAsString("shadowing");
-                bool ggx = false;
-                bool ggx_shadowing = false;
-                if (mf_type == "ggx")
-                    ggx = true;
-                if (mf_shadowing == "ggx")
-                    ggx_shadowing = true;
-
-                p_pars.surface = std::make_unique<SurfaceModel>(std::make_unique<Microfacet>(factor, factor_shadowing, ggx, ggx_shadowing));;
-                h_pars.surface = std::make_unique<SurfaceModel>(std::make_unique<Microfacet>(factor, factor_shadowing, ggx, ggx_shadowing));
-            } else {
-                p_pars.surface = std::make_unique<SurfaceModel>(std::make_unique<Dummy>());
-                h_pars.surface = std::make_unique<SurfaceModel>(std::make_unique<Dummy>());
-            }
-
-            shapes.hyperboloids.emplace_back(h_pars);
-            shapes.paraboloids.emplace_back(p_pars);
+            scene->hyperboloids.emplace_back(h_pars);
+            scene->paraboloids.emplace_back(p_pars);
 
         }
 
@@ -165,52 +170,54 @@ void Wolter::create(XMLData xml_data) {
             h_pars.Yh_max = p_pars.Yp_min;
             h_pars.Yh_min = h_pars.b * sqrt(pow(h_pars.Xh_min - h_pars.c, 2) / pow(h_pars.a, 2) - 1);
 
-            if (surface_model == "gauss") {
-                double factor = raytracing.child("surface").attributeAsDouble("roughness");
-                p_pars.surface = std::make_unique<SurfaceModel>(std::make_unique<GaussSurface>(factor));
-                h_pars.surface = std::make_unique<SurfaceModel>(std::make_unique<GaussSurface>(factor));
-
-
-            } else if (surface_model == "microfacet") {
-                double factor = raytracing.child("surface").attributeAsDouble("roughness");
-                double factor_shadowing = raytracing.child("surface").attributeAsDouble("shadowing_alpha");
-                std::string mf_type = raytracing.child("surface").attributeAsString("type");
-                std::string mf_shadowing = raytracing.child("surface").attributeAsString("shadowing");
-                bool ggx = false;
-                bool ggx_shadowing = false;
-                if (mf_type == "ggx")
-                    ggx = true;
-                if (mf_shadowing == "ggx")
-                    ggx_shadowing = true;
-
-                p_pars.surface = std::make_unique<SurfaceModel>(std::make_unique<Microfacet>(factor, factor_shadowing, ggx, ggx_shadowing));;
-                h_pars.surface = std::make_unique<SurfaceModel>(std::make_unique<Microfacet>(factor, factor_shadowing, ggx, ggx_shadowing));
-            } else {
-                p_pars.surface = std::make_unique<SurfaceModel>(std::make_unique<Dummy>());
-                h_pars.surface = std::make_unique<SurfaceModel>(std::make_unique<Dummy>());
-            }
-
-            shapes.hyperboloids.emplace_back(h_pars);
-            shapes.paraboloids.emplace_back(p_pars);
+            scene->hyperboloids.emplace_back(h_pars);
+            scene->paraboloids.emplace_back(p_pars);
 
         }
     }
-    shapes.sensor = Plane{0, 0, 1, -h_pars.c * 2 + sensor_offset, sensor_x, sensor_y};
-    shapes.scene = shapes.initializeScene(shapes.device);
+    scene->sensor = Plane{0, 0, 1, -h_pars.c * 2 + sensor_offset, sensor_x, sensor_y};
+    const auto details = raytracing.child("simulation_details");
+    scene->predicted_path = details.attributeAsStringOr("fast_path", "true") == "true";
+    scene->history_level = history_level_from_string(details.attributeAsStringOr("history", "full"));
+    scene->weighting = Weighting::from_xml(xml_data);
+    int shell_sectors = details.attributeAsIntOr("shell_sectors", 32);
+    int shell_bands = details.attributeAsIntOr("shell_bands", 1);
+    if (shell_sectors <= 0 || shell_bands <= 0)
+        throw std::runtime_error("simulation_details: shell_sectors and shell_bands must be positive");
+    scene->shell_segmentation = ShellSegmentation((unsigned) shell_sectors, (unsigned) shell_bands);
+    scene->mesh_cache = TriangleMesh::cache_dir_from_xml(xml_data);
+    scene->scene = scene->initializeScene(scene->device);
+    shapes = std::move(scene);
+    set_reflectivity(ReflectivityTable::from_xml(xml_data));
 
 }
 
 void Wolter::set_surface_parameter(std::string model, std::string shadowing, double factor, double shadowing_factor) {
-    for (auto &paraboloid : shapes.paraboloids) {
-        paraboloid.surface->set_surface_parameter(model, shadowing, factor, shadowing_factor);
-    }
-    for (auto &hyperboloid : shapes.hyperboloids) {
-        hyperboloid.surface->set_surface_parameter(model, shadowing, factor, shadowing_factor);
-    }
+    // A new model instead of changing the old one, which traces of other contexts may still read
+    auto surface = std::make_shared<SurfaceModel>(*surface_);
+    surface->set_surface_parameter(model, shadowing, factor, shadowing_factor);
+    set_surface(std::move(surface));
+}
 
+std::vector<Annulus> Wolter::entrance_annuli(double tan_x, double tan_y, double z_start) const {
+    return shapes->shell_index.entrance_annuli(tan_x, tan_y, z_start);
 }
 
 double Wolter::get_focal_length() {
     return focal_length;
 }
 
+HistoryLevel Wolter::history_level() const {
+    return shapes->history_level;
+}
+
+int Wolter::shell_of(short history_id) const {
+    if (history_id < 0)
+        return -1;
+    return shapes->registry[(unsigned int) history_id].shell;
+}
+
+int Wolter::shell_count() const {
+    // With exact positions the shells come from the list, not from mirror_shells
+    return (int) shapes->paraboloids.size();
+}
@@ -21,6 +21,7 @@ Copyright (C) 2025  Neo Reinmann (neoreinmann@gmail.com)
 #include "sensor/Sensor.h"
 #include "shape/Plane.h"
 #include "shape/Spider.h"
+#include "surface/ReflectivityTable.h"
 
 
 class Wolter final : public virtual MirrorModule {
@@ -34,6 +35,7 @@ public:
 
     explicit Wolter(const XMLData& xml_data);
 
+    // Shares the scene, only the coating and the surface are per copy
     Wolter(const Wolter& o) = default;
 
     Wolter(Wolter&& o) noexcept = default;
@@ -41,15 +43,28 @@ public:
     [[nodiscard]] std::unique_ptr<MirrorModule> clone() const override {
         return std::make_unique<Wolter>(*this);
     }
-    std::optional<Ray> ray_trace(Ray &ray) override;
+    std::optional<Ray> ray_trace(Ray &ray) const override;
+    void ray_trace_batch(std::vector<Ray> &rays, std::uint64_t stream_key, std::uint64_t first_photon,
+                         std::vector<char> &on_sensor) const override;
     void set_surface_parameter(std::string model, std::string shadowing, double factor, double shadowing_factor) override;
     double get_focal_length() override;
+    [[nodiscard]] HistoryLevel history_level() const override;
+    [[nodiscard]] int shell_of(short history_id) const override;
+    [[nodiscard]] int shell_count() const override;
+    [[nodiscard]] std::vector<Annulus> entrance_annuli(double tan_x, double tan_y, double z_start) const override;
+    /**
+     * @brief Paraboloid and hyperboloid of the shell with entrance radius radius (Yp_min) of an exact="true" module,
+     * everything but the origins.
+     */
+    static void shell_parameters(double radius, double focal_length, double mirror_height,
+                                 Paraboloid_parameters &p_pars, Hyperboloid_parameters &h_pars);
 private:
     double mirror_height;
     double distance_to_mirror;
     double sensor_offset;
 
-    EmbreeScene shapes;
+    // Built by create, shared by all clones
+    std::shared_ptr<const EmbreeScene> shapes;
 
     void create_parameters(double new_radius, Paraboloid_parameters &p_pars, Hyperboloid_parameters &h_pars) const;
     void create(XMLData xml_data) override;
@@ -0,0 +1,86 @@
+/*
+Copyright (C) 2025  Neo Reinmann (neoreinmann@gmail.com)
+*/
+
+#include "AsyncHitWriter.h"
+
+#include <chrono>
+#include <stdexcept>
+
+AsyncHitWriter::AsyncHitWriter(WriteBatch write, std::size_t max_bytes)
+        : write_(std::move(write)), max_bytes_(max_bytes) {
+    if (max_bytes_ == 0)
+        throw std::runtime_error("AsyncHitWriter: max_bytes must be positive");
+    thread_ = std::thread(&AsyncHitWriter::run, this);
+}
+
+AsyncHitWriter::~AsyncHitWriter() {
+    try {
+        finish();
+    } catch (...) {
+        // Nothing sensible left to do in a destructor, call finish() to see the error
+    }
+}
+
+void AsyncHitWriter::push(HitBatch &&batch) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (done_)
+        throw std::runtime_error("AsyncHitWriter: push after finish");
+    const auto t1 = std::chrono::steady_clock::now();
+    const std::size_t bytes = batch.bytes();
+    not_full_.wait(lock, [&] { return queue_.empty() || queued_bytes_ + bytes <= max_bytes_ || error_; });
+    stall_ms_ += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t1).count();
+    if (error_)
+        std::rethrow_exception(error_);
+    queue_.push_back(std::move(batch));
+    queued_bytes_ += bytes;
+    not_empty_.notify_one();
+}
+
+void AsyncHitWriter::finish() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        done_ = true;
+    }
+    not_empty_.notify_one();
+    if (thread_.joinable())
+        thread_.join();
+    if (error_) {
+        // Report a failed write once
+        std::exception_ptr error = error_;
+        error_ = nullptr;
+        std::rethrow_exception(error);
+    }
+}
+
+void AsyncHitWriter::run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        not_empty_.wait(lock, [&] { return !queue_.empty() || done_; });
+        if (queue_.empty())
+            return;
+        HitBatch batch = std::move(queue_.front());
+        queue_.pop_front();
+        queued_bytes_ -= batch.bytes();
+        not_full_.notify_one();
+
+        lock.unlock();
+        std::exception_ptr error = nullptr;
+        try {
+            write_(batch);
+        } catch (...) {
+            error = std::current_exception();
+        }
+        // Free the hits before taking the next batch, they count against the memory bound
+        batch = HitBatch();
+        lock.lock();
+
+        if (error) {
+            error_ = error;
+            queue_.clear();
+            queued_bytes_ = 0;
+            not_full_.notify_all();
+            return;
+        }
+    }
+}
@@ -0,0 +1,73 @@
+/*
+Copyright (C) 2025  Neo Reinmann (neoreinmann@gmail.com)
+*/
+
+#ifndef SIXTE_ASYNCHITWRITER_H
+#define SIXTE_ASYNCHITWRITER_H
+
+#include "simulation/HitBatch.h"
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+/**
+ * @brief Hands batches of hits to a dedicated writer thread, so writing overlaps with tracing.
+ *
+ * The queue holds the hit columns (HitBatch), not the rays, and at most max_bytes of them: push blocks
+ * until the writer has taken enough, a batch larger than max_bytes waits for an empty queue. Together with
+ * the batch being written the writer never holds much more than max_bytes plus one batch. With
+ * PhotonEngine::trace(n, source, sink) the memory of a run is bounded by that plus the batch being traced,
+ * independent of the number of photons.
+ */
+class AsyncHitWriter {
+public:
+    using WriteBatch = std::function<void(const HitBatch &)>;
+
+    /**
+     * @param write Called on the writer thread for every batch, in push order
+     * @param max_bytes Bound of the queued batches (HitBatch::bytes), PhotonEngine::batch_bytes() is double buffering
+     */
+    AsyncHitWriter(WriteBatch write, std::size_t max_bytes);
+    ~AsyncHitWriter();
+
+    AsyncHitWriter(const AsyncHitWriter&) = delete;
+    AsyncHitWriter& operator=(const AsyncHitWriter&) = delete;
+
+    /**
+     * @brief Queues a batch, blocks while the queue is full.
+     * @throws The exception of a failed write, later batches are not written
+     */
+    void push(HitBatch &&batch);
+
+    /**
+     * @brief Writes the remaining batches and stops the writer thread, the destructor does this too.
+     * @throws The exception of a failed write
+     */
+    void finish();
+
+    /**
+     * @brief Milliseconds push spent waiting for the writer, i.e. writing time not hidden behind tracing.
+     */
+    [[nodiscard]] double stall_ms() const { return stall_ms_; }
+
+private:
+    void run();
+
+    WriteBatch write_;
+    std::size_t max_bytes_;
+    std::size_t queued_bytes_ = 0;
+    std::deque<HitBatch> queue_;
+    std::mutex mutex_;
+    std::condition_variable not_empty_, not_full_;
+    bool done_ = false;
+    std::exception_ptr error_ = nullptr;
+    double stall_ms_ = 0;
+    std::thread thread_;
+};
+
+
+#endif //SIXTE_ASYNCHITWRITER_H
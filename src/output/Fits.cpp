@@ -0,0 +1,376 @@
+/*
+Copyright (C) 2025  Neo Reinmann (neoreinmann@gmail.com)
+*/
+
+#include "Fits.h"
+
+#include <algorithm>
+#include <bit>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+namespace {
+    constexpr std::size_t block_size = 2880;
+    constexpr std::size_t card_size = 80;
+
+    // Fixed format: keyword in columns 1-8, "= " in 9-10, numbers and logicals right aligned up to column 30
+    std::string format_card(const FitsCard &card) {
+        std::string text = card.keyword;
+        text.resize(8, ' ');
+        if (card.keyword != "END") {
+            std::string value = card.value;
+            if (value.empty() || value.front() != '\'')
+                value.insert(0, value.size() < 20 ? 20 - value.size() : 0, ' ');
+            text += "= " + value;
+            if (!card.comment.empty())
+                text += " / " + card.comment;
+        }
+        if (text.size() > card_size)
+            throw std::runtime_error("write_fits_images: card " + card.keyword + " is longer than 80 characters");
+        text.resize(card_size, ' ');
+        return text;
+    }
+
+    void write_padded(std::ofstream &out, const std::string &bytes, char fill) {
+        out.write(bytes.data(), (std::streamsize) bytes.size());
+        const std::size_t rest = (block_size - bytes.size() % block_size) % block_size;
+        const std::string padding(rest, fill);
+        out.write(padding.data(), (std::streamsize) padding.size());
+    }
+
+    void write_header(std::ofstream &out, std::vector<FitsCard> cards) {
+        cards.push_back({"END", "", ""});
+        std::string header;
+        for (const FitsCard &card : cards)
+            header += format_card(card);
+        write_padded(out, header, ' ');
+    }
+
+    // FITS data is big endian
+    void put_float(std::string &data, std::size_t offset, double value) {
+        std::uint32_t bits = std::bit_cast<std::uint32_t>((float) value);
+        if constexpr (std::endian::native == std::endian::little)
+            bits = (bits >> 24) | ((bits >> 8) & 0xff00u) | ((bits << 8) & 0xff0000u) | (bits << 24);
+        std::memcpy(data.data() + offset, &bits, sizeof(float));
+    }
+
+    std::ofstream open_output(const std::string &path) {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        if (!out)
+            throw std::runtime_error("write_fits: cannot open " + path);
+        return out;
+    }
+
+    void close_output(std::ofstream &out, const std::string &path) {
+        out.close();
+        if (!out)
+            throw std::runtime_error("write_fits: writing " + path + " failed");
+    }
+
+    std::string upper(std::string text) {
+        std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c) { return (char) std::toupper(c); });
+        return text;
+    }
+
+    std::string trim(const std::string &text) {
+        const auto first = text.find_first_not_of(' ');
+        if (first == std::string::npos)
+            return "";
+        return text.substr(first, text.find_last_not_of(' ') - first + 1);
+    }
+
+    // Value of a header card, strings without quotes and trailing blanks, comments dropped
+    std::string card_value(const std::string &card) {
+        const std::string field = card.substr(10);
+        const auto start = field.find_first_not_of(' ');
+        if (start == std::string::npos)
+            return "";
+        if (field[start] == '\'') {
+            std::string value;
+            for (std::size_t i = start + 1; i < field.size(); i++) {
+                if (field[i] == '\'') {
+                    if (i + 1 < field.size() && field[i + 1] == '\'') {
+                        value += '\'';
+                        i++;
+                        continue;
+                    }
+                    break;
+                }
+                value += field[i];
+            }
+            return trim(value);
+        }
+        return trim(field.substr(0, field.find('/')));
+    }
+
+    long long header_integer(const std::map<std::string, std::string> &keywords, const std::string &keyword,
+                             long long fallback) {
+        auto it = keywords.find(keyword);
+        return it == keywords.end() ? fallback : std::atoll(it->second.c_str());
+    }
+
+    // Big endian bytes -> host value
+    template<typename T>
+    T get_value(const unsigned char *bytes) {
+        unsigned char swapped[sizeof(T)];
+        for (std::size_t i = 0; i < sizeof(T); i++)
+            swapped[i] = bytes[std::endian::native == std::endian::little ? sizeof(T) - 1 - i : i];
+        T value;
+        std::memcpy(&value, swapped, sizeof(T));
+        return value;
+    }
+
+    double get_number(char type, const unsigned char *bytes) {
+        switch (type) {
+            case 'L': return bytes[0] == 'T' ? 1 : 0;
+            case 'B': return bytes[0];
+            case 'I': return get_value<std::int16_t>(bytes);
+            case 'J': return get_value<std::int32_t>(bytes);
+            case 'K': return (double) get_value<std::int64_t>(bytes);
+            case 'E': return get_value<float>(bytes);
+            default: return get_value<double>(bytes);
+        }
+    }
+
+    std::size_t type_size(char type) {
+        switch (type) {
+            case 'L': case 'B': case 'A': case 'X': return 1;
+            case 'I': return 2;
+            case 'J': case 'E': case 'P': return 4;
+            case 'K': case 'D': case 'C': return 8;
+            case 'M': case 'Q': return 16;
+            default: throw std::runtime_error(std::string("read_fits_table: unknown column type ") + type);
+        }
+    }
+}
+
+const std::vector<double> &FitsTableData::column(const std::string &name) const {
+    auto it = columns.find(upper(name));
+    if (it == columns.end())
+        throw std::runtime_error("FitsTableData: no numeric column " + name);
+    return it->second;
+}
+
+std::optional<double> FitsTableData::number(const std::string &keyword) const {
+    auto it = keywords.find(upper(keyword));
+    if (it == keywords.end())
+        return std::nullopt;
+    char *end = nullptr;
+    const double value = std::strtod(it->second.c_str(), &end);
+    if (end == it->second.c_str())
+        return std::nullopt;
+    return value;
+}
+
+FitsCard FitsCard::string(const std::string &keyword, const std::string &value, const std::string &comment) {
+    std::string quoted;
+    for (char c : value) {
+        quoted += c;
+        if (c == '\'')
+            quoted += c;
+    }
+    // Strings are padded to at least 8 characters inside the quotes
+    if (quoted.size() < 8)
+        quoted.resize(8, ' ');
+    return {keyword, "'" + quoted + "'", comment};
+}
+
+FitsCard FitsCard::integer(const std::string &keyword, long long value, const std::string &comment) {
+    return {keyword, std::to_string(value), comment};
+}
+
+FitsCard FitsCard::number(const std::string &keyword, double value, const std::string &comment) {
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), "%.15G", value);
+    std::string text = buffer;
+    // A real value needs a decimal point or an exponent, "1" would be read as an integer
+    if (text.find_first_of(".EN") == std::string::npos)
+        text += ".0";
+    return {keyword, text, comment};
+}
+
+FitsCard FitsCard::logical(const std::string &keyword, bool value, const std::string &comment) {
+    return {keyword, value ? "T" : "F", comment};
+}
+
+void write_fits_images(const std::string &path, const std::vector<FitsImage> &images) {
+    if (images.empty())
+        throw std::runtime_error("write_fits_images: no image for " + path);
+    std::ofstream out = open_output(path);
+
+    for (std::size_t i = 0; i < images.size(); i++) {
+        const FitsImage &image = images[i];
+        const std::size_t n_values = (std::size_t) image.width * (std::size_t) image.height * (std::size_t) image.depth;
+        if (image.data == nullptr || image.data->size() != n_values)
+            throw std::runtime_error("write_fits_images: data of " + path + " does not match the image size");
+
+        std::vector<FitsCard> cards;
+        if (i == 0)
+            cards.push_back(FitsCard::logical("SIMPLE", true, "conforms to FITS standard"));
+        else
+            cards.push_back(FitsCard::string("XTENSION", "IMAGE", "image extension"));
+        cards.push_back(FitsCard::integer("BITPIX", -32, "32 bit floats"));
+        cards.push_back(FitsCard::integer("NAXIS", image.depth > 1 ? 3 : 2));
+        cards.push_back(FitsCard::integer("NAXIS1", image.width));
+        cards.push_back(FitsCard::integer("NAXIS2", image.height));
+        if (image.depth > 1)
+            cards.push_back(FitsCard::integer("NAXIS3", image.depth));
+        if (i == 0) {
+            cards.push_back(FitsCard::logical("EXTEND", images.size() > 1));
+        } else {
+            cards.push_back(FitsCard::integer("PCOUNT", 0));
+            cards.push_back(FitsCard::integer("GCOUNT", 1));
+            cards.push_back(FitsCard::string("EXTNAME", image.extname));
+        }
+        cards.insert(cards.end(), image.cards.begin(), image.cards.end());
+        write_header(out, cards);
+
+        std::string data(n_values * sizeof(float), '\0');
+        for (std::size_t k = 0; k < n_values; k++)
+            put_float(data, k * sizeof(float), (*image.data)[k]);
+        write_padded(out, data, '\0');
+    }
+    close_output(out, path);
+}
+
+void write_fits_tables(const std::string &path, const std::vector<FitsCard> &primary_cards,
+                       const std::vector<FitsTable> &tables) {
+    std::ofstream out = open_output(path);
+
+    std::vector<FitsCard> primary = {
+            FitsCard::logical("SIMPLE", true, "conforms to FITS standard"),
+            FitsCard::integer("BITPIX", 8),
+            FitsCard::integer("NAXIS", 0),
+            FitsCard::logical("EXTEND", true),
+    };
+    primary.insert(primary.end(), primary_cards.begin(), primary_cards.end());
+    write_header(out, primary);
+
+    for (const FitsTable &table : tables) {
+        const std::size_t n_rows = table.columns.empty() || table.columns.front().repeat == 0 ? 0
+                : table.columns.front().data->size() / table.columns.front().repeat;
+        std::size_t row_bytes = 0;
+        for (const FitsColumn &column : table.columns) {
+            if (column.data == nullptr || column.repeat == 0 || column.data->size() != n_rows * column.repeat)
+                throw std::runtime_error("write_fits_tables: columns of " + table.extname + " differ in length");
+            row_bytes += column.repeat * sizeof(float);
+        }
+
+        std::vector<FitsCard> cards = {
+                FitsCard::string("XTENSION", "BINTABLE", "binary table extension"),
+                FitsCard::integer("BITPIX", 8),
+                FitsCard::integer("NAXIS", 2),
+                FitsCard::integer("NAXIS1", (long long) row_bytes, "bytes per row"),
+                FitsCard::integer("NAXIS2", (long long) n_rows, "rows"),
+                FitsCard::integer("PCOUNT", 0),
+                FitsCard::integer("GCOUNT", 1),
+                FitsCard::integer("TFIELDS", (long long) table.columns.size()),
+        };
+        for (std::size_t c = 0; c < table.columns.size(); c++) {
+            const std::string n = std::to_string(c + 1);
+            cards.push_back(FitsCard::string("TTYPE" + n, table.columns[c].name));
+            const std::size_t repeat = table.columns[c].repeat;
+            cards.push_back(FitsCard::string("TFORM" + n, repeat == 1 ? "E" : std::to_string(repeat) + "E"));
+            if (!table.columns[c].unit.empty())
+                cards.push_back(FitsCard::string("TUNIT" + n, table.columns[c].unit));
+            if (!table.columns[c].dim.empty())
+                cards.push_back(FitsCard::string("TDIM" + n, table.columns[c].dim));
+        }
+        cards.push_back(FitsCard::string("EXTNAME", table.extname));
+        cards.insert(cards.end(), table.cards.begin(), table.cards.end());
+        write_header(out, cards);
+
+        // Row-major: all columns of row 0, then row 1, ...
+        std::string data(n_rows * row_bytes, '\0');
+        for (std::size_t row = 0; row < n_rows; row++) {
+            std::size_t offset = row * row_bytes;
+            for (const FitsColumn &column : table.columns)
+                for (std::size_t k = 0; k < column.repeat; k++, offset += sizeof(float))
+                    put_float(data, offset, (*column.data)[row * column.repeat + k]);
+        }
+        write_padded(out, data, '\0');
+    }
+    close_output(out, path);
+}
+
+FitsTableData read_fits_table(const std::string &path, const std::string &extname) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+        throw std::runtime_error("read_fits_table: cannot open " + path);
+    const std::string file((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+    std::size_t offset = 0;
+    while (offset < file.size()) {
+        // Header: cards up to END, padded to whole blocks
+        std::map<std::string, std::string> keywords;
+        bool end = false;
+        while (!end) {
+            if (offset + card_size > file.size())
+                throw std::runtime_error("read_fits_table: truncated header in " + path);
+            const std::string card = file.substr(offset, card_size);
+            offset += card_size;
+            const std::string keyword = trim(card.substr(0, 8));
+            if (keyword == "END")
+                end = true;
+            else if (card.compare(8, 2, "= ") == 0)
+                keywords[keyword] = card_value(card);
+        }
+        offset = (offset + block_size - 1) / block_size * block_size;
+
+        const long long naxis = header_integer(keywords, "NAXIS", 0);
+        std::size_t data_size = naxis > 0 ? 1 : 0;
+        for (long long axis = 1; axis <= naxis; axis++)
+            data_size *= (std::size_t) header_integer(keywords, "NAXIS" + std::to_string(axis), 0);
+        data_size *= (std::size_t) std::llabs(header_integer(keywords, "BITPIX", 8)) / 8;
+        data_size = (data_size + (std::size_t) header_integer(keywords, "PCOUNT", 0))
+                    * (std::size_t) header_integer(keywords, "GCOUNT", 1);
+        const std::size_t data_offset = offset;
+        offset += (data_size + block_size - 1) / block_size * block_size;
+
+        if (keywords["XTENSION"] != "BINTABLE" || upper(keywords["EXTNAME"]) != upper(extname))
+            continue;
+        if (data_offset + data_size > file.size())
+            throw std::runtime_error("read_fits_table: truncated data in " + path);
+
+        FitsTableData table;
+        const auto row_bytes = (std::size_t) header_integer(keywords, "NAXIS1", 0);
+        const auto n_rows = (std::size_t) header_integer(keywords, "NAXIS2", 0);
+        const long long n_fields = header_integer(keywords, "TFIELDS", 0);
+        std::size_t column_offset = 0;
+        for (long long field = 1; field <= n_fields; field++) {
+            const std::string n = std::to_string(field);
+            const std::string form = upper(keywords["TFORM" + n]);
+            const auto type_at = form.find_first_not_of("0123456789");
+            if (type_at == std::string::npos)
+                throw std::runtime_error("read_fits_table: bad TFORM" + n + " in " + path);
+            const std::size_t repeat = type_at == 0 ? 1 : (std::size_t) std::atoll(form.substr(0, type_at).c_str());
+            const char type = form[type_at];
+            const std::size_t width = type == 'X' ? (repeat + 7) / 8 : repeat * type_size(type);
+
+            if (std::string("LBIJKED").find(type) != std::string::npos) {
+                const std::string name = upper(keywords["TTYPE" + n]);
+                const double scale = keywords.count("TSCAL" + n) ? std::strtod(keywords["TSCAL" + n].c_str(), nullptr) : 1.0;
+                const double zero = keywords.count("TZERO" + n) ? std::strtod(keywords["TZERO" + n].c_str(), nullptr) : 0.0;
+                std::vector<double> &values = table.columns[name];
+                values.reserve(n_rows * repeat);
+                for (std::size_t row = 0; row < n_rows; row++) {
+                    const auto *bytes = (const unsigned char *) file.data() + data_offset + row * row_bytes + column_offset;
+                    for (std::size_t k = 0; k < repeat; k++)
+                        values.push_back(zero + scale * get_number(type, bytes + k * type_size(type)));
+                }
+                if (keywords.count("TUNIT" + n))
+                    table.units[name] = keywords["TUNIT" + n];
+            }
+            column_offset += width;
+        }
+        table.keywords = std::move(keywords);
+        return table;
+    }
+    throw std::runtime_error("read_fits_table: " + path + " has no binary table " + extname);
+}
@@ -0,0 +1,105 @@
+/*
+Copyright (C) 2025  Neo Reinmann (neoreinmann@gmail.com)
+*/
+
+#ifndef SIXTE_FITS_H
+#define SIXTE_FITS_H
+
+#include <map>
+#include <optional>
+#include <string>
+#include <vector>
+
+/**
+ * @brief One 80 character header card, the value is formatted when the card is created.
+ */
+struct FitsCard {
+    std::string keyword;
+    std::string value;      // already in FITS notation, e.g. "'DETX    '", "T" or "1.3E-04"
+    std::string comment;
+
+    static FitsCard string(const std::string &keyword, const std::string &value, const std::string &comment = "");
+    static FitsCard integer(const std::string &keyword, long long value, const std::string &comment = "");
+    static FitsCard number(const std::string &keyword, double value, const std::string &comment = "");
+    static FitsCard logical(const std::string &keyword, bool value, const std::string &comment = "");
+};
+
+/**
+ * @brief 2D image or, with depth > 1, cube of one HDU. Data is row-major with width values per row
+ * (NAXIS1 = width) and one width x height plane after the other (NAXIS3 = depth).
+ */
+struct FitsImage {
+    std::string extname;            // ignored for the primary HDU
+    long width = 0;
+    long height = 0;
+    const std::vector<double> *data = nullptr;
+    std::vector<FitsCard> cards;    // extra keywords, e.g. the WCS
+    long depth = 1;
+};
+
+/**
+ * @brief Column of a binary table, written as 32 bit floats (TFORM 'E'). With repeat > 1 every cell
+ * is a vector of repeat values, data holds them row after row.
+ */
+struct FitsColumn {
+    std::string name;
+    std::string unit;
+    const std::vector<double> *data = nullptr;
+    std::size_t repeat = 1;
+    std::string dim{};              // TDIM of a vector cell, e.g. "(1000,13,1)", empty for none
+};
+
+/**
+ * @brief Binary table, all columns have the same number of rows.
+ */
+struct FitsTable {
+    std::string extname;
+    std::vector<FitsColumn> columns;
+    std::vector<FitsCard> cards;    // extra keywords
+};
+
+/**
+ * @brief Binary table read from a file, see read_fits_table.
+ */
+struct FitsTableData {
+    std::map<std::string, std::string> keywords;            // values as written, strings without quotes
+    std::map<std::string, std::vector<double>> columns;     // by upper case TTYPE
+    std::map<std::string, std::string> units;               // TUNIT by upper case TTYPE, if given
+
+    /**
+     * @brief Column name, throws std::runtime_error if the table has no such numeric column.
+     */
+    [[nodiscard]] const std::vector<double> &column(const std::string &name) const;
+
+    /**
+     * @brief Numeric value of keyword, std::nullopt if it is missing or not a number.
+     */
+    [[nodiscard]] std::optional<double> number(const std::string &keyword) const;
+};
+
+/*
+ * The writers and the reader need no FITS library, only the subset of the standard used here is implemented.
+ * The writers throw std::runtime_error if the file cannot be written or a card does not fit into 80 characters.
+ */
+
+/**
+ * @brief Writes images[0] as primary HDU and every further image as IMAGE extension, as 32 bit floats.
+ */
+void write_fits_images(const std::string &path, const std::vector<FitsImage> &images);
+
+/**
+ * @brief Writes an empty primary HDU with primary_cards, followed by one BINTABLE extension per table.
+ */
+void write_fits_tables(const std::string &path, const std::vector<FitsCard> &primary_cards,
+                       const std::vector<FitsTable> &tables);
+
+/**
+ * @brief Reads the BINTABLE extension named extname (case insensitive).
+ * Numeric columns (L, B, I, J, K, E, D) are read with TSCAL and TZERO applied, a column with a repeat
+ * count above 1 is flattened row by row. Other columns are skipped. Throws std::runtime_error if the file
+ * cannot be read or has no such extension.
+ */
+FitsTableData read_fits_table(const std::string &path, const std::string &extname);
+
+
+#endif //SIXTE_FITS_H
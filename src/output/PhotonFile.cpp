@@ -0,0 +1,239 @@
+/*
+Copyright (C) 2025  Neo Reinmann (neoreinmann@gmail.com)
+*/
+
+#include "PhotonFile.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <stdexcept>
+#ifdef SIXTE_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+static_assert(std::endian::native == std::endian::little, "photon files are written in native little endian byte order");
+
+namespace {
+    constexpr char file_magic[8] = {'S', 'X', 'P', 'H', 'O', 'T', 'O', 'N'};
+    constexpr char group_magic[8] = {'R', 'O', 'W', 'G', 'R', 'O', 'U', 'P'};
+    constexpr char end_magic[8] = {'E', 'N', 'D', 'F', 'I', 'L', 'E', '\0'};
+    constexpr std::uint32_t version = 1;
+    constexpr std::size_t alignment = 64;
+
+    template<typename T>
+    void put(std::vector<char> &buffer, const T &value) {
+        const char *bytes = reinterpret_cast<const char *>(&value);
+        buffer.insert(buffer.end(), bytes, bytes + sizeof(T));
+    }
+
+    // Fixed size record padded with zeros to a multiple of the alignment
+    void pad_to_alignment(std::vector<char> &buffer) {
+        buffer.resize((buffer.size() + alignment - 1) / alignment * alignment, 0);
+    }
+
+    // Raw bytes of a column, get(row, values) fills the width values of one row
+    template<typename T, typename Get>
+    std::vector<char> column(std::size_t rows, std::size_t width, Get get) {
+        std::vector<char> raw(rows * width * sizeof(T));
+        T *values = reinterpret_cast<T *>(raw.data());
+        for (std::size_t row = 0; row < rows; row++)
+            get(row, values + row * width);
+        return raw;
+    }
+
+    // Raw bytes of a column that is stored as it is written
+    template<typename T>
+    std::vector<char> column(const std::vector<T> &values) {
+        const char *bytes = reinterpret_cast<const char *>(values.data());
+        return {bytes, bytes + values.size() * sizeof(T)};
+    }
+
+    // Raw bytes of the x, y or z components of vectors, width per row
+    std::vector<char> components(const std::vector<Vec3fa> &vectors, std::size_t width) {
+        const std::size_t rows = vectors.size() / width;
+        return column<float>(rows, 3 * width, [&](std::size_t row, float *v) {
+            for (std::size_t i = 0; i < width; i++) {
+                const Vec3fa &value = vectors[row * width + i];
+                v[3 * i] = value.x;
+                v[3 * i + 1] = value.y;
+                v[3 * i + 2] = value.z;
+            }
+        });
+    }
+}
+
+PhotonCompression photon_compression_from_string(const std::string &compression) {
+    if (compression == "none")
+        return PhotonCompression::none;
+    if (compression == "zstd") {
+#ifdef SIXTE_WITH_ZSTD
+        return PhotonCompression::zstd;
+#else
+        throw std::runtime_error("output: compression=\"zstd\" needs a build with zstd");
+#endif
+    }
+    throw std::runtime_error("output: compression must be none or zstd, not " + compression);
+}
+
+PhotonFileWriter::PhotonFileWriter(const std::string &path, HistoryLevel history, PhotonFileOptions options)
+        : out_(path, std::ios::binary | std::ios::trunc), path_(path), history_(history), options_(options) {
+    if (!out_)
+        throw std::runtime_error("PhotonFileWriter: cannot open " + path);
+    if (options_.chunk_rows == 0)
+        throw std::runtime_error("PhotonFileWriter: chunk_rows must be positive");
+
+    const auto capacity = (std::uint32_t) RayHistory::capacity;
+    columns_ = {{"index", "<u8", 1}, {"x", "<f4", 1}, {"y", "<f4", 1}};
+    if (options_.weights)
+        columns_.push_back({"weight", "<f4", 1});
+    if (history_ != HistoryLevel::off) {
+        columns_.push_back({"history_len", "|u1", 1});
+        columns_.push_back({"history_id", "<i2", capacity});
+    }
+    if (history_ == HistoryLevel::full) {
+        columns_.push_back({"history_origin", "<f4", 3 * capacity});
+        columns_.push_back({"history_direction", "<f4", 3 * capacity});
+    }
+    if (options_.spectral_bins > 0)
+        columns_.push_back({"spectral_weights", "<f4", (std::uint32_t) options_.spectral_bins});
+    write_header();
+}
+
+PhotonFileWriter::~PhotonFileWriter() {
+    try {
+        close();
+    } catch (...) {
+        // Nothing sensible left to do in a destructor, call close() to see the error
+    }
+}
+
+void PhotonFileWriter::write_header() {
+    std::vector<char> header;
+    header.insert(header.end(), file_magic, file_magic + 8);
+    put(header, version);
+    put(header, (std::uint32_t) columns_.size());
+    put(header, (std::uint32_t) options_.compression);
+    put(header, (std::uint32_t) history_);
+    put(header, (std::uint32_t) RayHistory::capacity);
+    pad_to_alignment(header);
+
+    for (const Column &c : columns_) {
+        char name[24] = {};
+        char dtype[4] = {};
+        std::memcpy(name, c.name, std::min(std::strlen(c.name), sizeof(name) - 1));
+        std::memcpy(dtype, c.dtype, std::min(std::strlen(c.dtype), sizeof(dtype)));
+        header.insert(header.end(), name, name + sizeof(name));
+        header.insert(header.end(), dtype, dtype + sizeof(dtype));
+        put(header, c.width);
+    }
+    pad_to_alignment(header);
+    out_.write(header.data(), (std::streamsize) header.size());
+}
+
+void PhotonFileWriter::pad() {
+    static const char zeros[alignment] = {};
+    const auto position = (std::size_t) out_.tellp();
+    out_.write(zeros, (std::streamsize) ((alignment - position % alignment) % alignment));
+}
+
+void PhotonFileWriter::write_block(const std::vector<char> &raw, [[maybe_unused]] std::size_t rows) {
+    std::vector<char> stored;
+    std::uint64_t frames = 0;
+#ifdef SIXTE_WITH_ZSTD
+    if (options_.compression == PhotonCompression::zstd) {
+        // Independent frames of chunk_rows rows, a reader can inflate them one at a time
+        const std::size_t row_bytes = raw.size() / std::max<std::size_t>(1, rows);
+        const std::size_t frame_bytes = std::max<std::size_t>(1, options_.chunk_rows * row_bytes);
+        for (std::size_t first = 0; first < raw.size(); first += frame_bytes, frames++) {
+            const std::size_t size = std::min(frame_bytes, raw.size() - first);
+            std::vector<char> frame(ZSTD_compressBound(size));
+            const std::size_t compressed = ZSTD_compress(frame.data(), frame.size(), raw.data() + first, size,
+                                                         options_.zstd_level);
+            if (ZSTD_isError(compressed))
+                throw std::runtime_error(std::string("PhotonFileWriter: ") + ZSTD_getErrorName(compressed));
+            put(stored, (std::uint64_t) compressed);
+            put(stored, (std::uint64_t) size);
+            stored.insert(stored.end(), frame.data(), frame.data() + compressed);
+        }
+    }
+#endif
+    const std::vector<char> &data = frames > 0 ? stored : raw;
+
+    std::vector<char> header;
+    put(header, (std::uint64_t) data.size());
+    put(header, (std::uint64_t) raw.size());
+    put(header, frames);
+    pad_to_alignment(header);
+    out_.write(header.data(), (std::streamsize) header.size());
+    out_.write(data.data(), (std::streamsize) data.size());
+    pad();
+}
+
+void PhotonFileWriter::write(const HitBatch &hits) {
+    if (closed_)
+        throw std::runtime_error("PhotonFileWriter: " + path_ + " is already closed");
+    if (hits.spectral_bins != options_.spectral_bins)
+        throw std::runtime_error("PhotonFileWriter: hits with " + std::to_string(hits.spectral_bins) +
+                                 " spectral weights, the file has " + std::to_string(options_.spectral_bins));
+    if (!hits.empty() && hits.history < history_)
+        throw std::runtime_error("PhotonFileWriter: the hits have less history than the file");
+
+    std::vector<char> header;
+    header.insert(header.end(), group_magic, group_magic + 8);
+    put(header, (std::uint64_t) hits.size());
+    pad_to_alignment(header);
+    out_.write(header.data(), (std::streamsize) header.size());
+
+    const std::size_t rows = hits.size();
+    for (const Column &c : columns_) {
+        const std::string name = c.name;
+        if (name == "index")
+            write_block(column(hits.index), rows);
+        else if (name == "x" || name == "y") {
+            const bool x = name == "x";
+            write_block(column<float>(rows, 1, [&](std::size_t row, float *v) {
+                *v = x ? hits.position[row].x : hits.position[row].y;
+            }), rows);
+        }
+        else if (name == "weight")
+            write_block(column<float>(rows, 1, [&](std::size_t row, float *v) {
+                *v = (float) hits.weight[row];
+            }), rows);
+        else if (name == "history_len")
+            write_block(column(hits.history_len), rows);
+        else if (name == "spectral_weights")
+            write_block(column(hits.spectral_weights), rows);
+        else if (name == "history_id")
+            write_block(column(hits.history_id), rows);
+        else if (name == "history_origin")
+            write_block(components(hits.history_origin, RayHistory::capacity), rows);
+        else
+            write_block(components(hits.history_direction, RayHistory::capacity), rows);
+    }
+    rows_ += hits.size();
+    if (!out_)
+        throw std::runtime_error("PhotonFileWriter: writing " + path_ + " failed");
+}
+
+void PhotonFileWriter::close() {
+    if (closed_)
+        return;
+    closed_ = true;
+    // The end marker repeats the total row count, a file without it was not finished
+    std::vector<char> footer;
+    footer.insert(footer.end(), end_magic, end_magic + 8);
+    put(footer, rows_);
+    pad_to_alignment(footer);
+    out_.write(footer.data(), (std::streamsize) footer.size());
+    out_.close();
+    if (!out_)
+        throw std::runtime_error("PhotonFileWriter: writing " + path_ + " failed");
+}
+
+void write_photon_file(const HitBatch &hits, const std::string &path, PhotonFileOptions options) {
+    options.spectral_bins = hits.spectral_bins;
+    PhotonFileWriter writer(path, hits.history, options);
+    writer.write(hits);
+    writer.close();
+}
@@ -0,0 +1,88 @@
+/*
+Copyright (C) 2025  Neo Reinmann (neoreinmann@gmail.com)
+*/
+
+#ifndef SIXTE_PHOTONFILE_H
+#define SIXTE_PHOTONFILE_H
+
+#include "simulation/HitBatch.h"
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+enum class PhotonCompression : std::uint32_t {
+    none = 0,
+    zstd = 1    // only if built with SIXTE_WITH_ZSTD
+};
+
+/**
+ * @brief Parses "none" or "zstd", throws std::runtime_error for anything else or if zstd is not built in.
+ */
+PhotonCompression photon_compression_from_string(const std::string &compression);
+
+struct PhotonFileOptions {
+    PhotonCompression compression = PhotonCompression::none;
+    std::size_t chunk_rows = std::size_t(1) << 20;   // rows per zstd frame
+    int zstd_level = 3;
+    std::size_t spectral_bins = 0;                   // width of the spectral_weights column, 0 for none
+    bool weights = false;                            // weight column of weighted rays
+};
+
+/**
+ * @brief Writes hits as a columnar binary photon file, see docs/photon_file.md for the layout.
+ *
+ * Columns are index (int64), x, y (float32), for weighted rays weight (float32) and, depending on the
+ * history level of the rays, history_len (uint8), history_id (int16 x RayHistory::capacity) and
+ * history_origin, history_direction (float32 x 3 * RayHistory::capacity), and in the spectral mode
+ * spectral_weights (float32 x spectral_bins). Every write appends one row group in which each column
+ * is one contiguous, 64 byte aligned block, so an uncompressed file can be memory mapped column by
+ * column.
+ */
+class PhotonFileWriter {
+public:
+    PhotonFileWriter(const std::string &path, HistoryLevel history, PhotonFileOptions options = {});
+    ~PhotonFileWriter();
+
+    PhotonFileWriter(const PhotonFileWriter&) = delete;
+    PhotonFileWriter& operator=(const PhotonFileWriter&) = delete;
+
+    /**
+     * @brief Appends hits as one row group. Throws std::runtime_error if their columns do not match the file.
+     */
+    void write(const HitBatch &hits);
+
+    /**
+     * @brief Writes the end marker and closes the file, the destructor does this too.
+     */
+    void close();
+
+    [[nodiscard]] std::uint64_t rows() const { return rows_; }
+
+private:
+    struct Column {
+        const char *name;
+        const char *dtype;      // numpy type string
+        std::uint32_t width;    // values per row
+    };
+
+    void write_header();
+    void write_block(const std::vector<char> &raw, std::size_t rows);
+    void pad();
+
+    std::ofstream out_;
+    std::string path_;
+    HistoryLevel history_;
+    PhotonFileOptions options_;
+    std::vector<Column> columns_;
+    std::uint64_t rows_ = 0;
+    bool closed_ = false;
+};
+
+/**
+ * @brief Writes all hits to path in one row group, with their history level and spectral bins.
+ */
+void write_photon_file(const HitBatch &hits, const std::string &path, PhotonFileOptions options = {});
+
+
+#endif //SIXTE_PHOTONFILE_H
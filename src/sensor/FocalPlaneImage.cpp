@@ -0,0 +1,158 @@
+/*
+Copyright (C) 2025  Neo Reinmann (neoreinmann@gmail.com)
+*/
+
+#include "FocalPlaneImage.h"
+
+#include "output/Fits.h"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+DetectorWCS DetectorWCS::from_xml(const XMLData &xml_data) {
+    const auto detector = xml_data.child("detector");
+    const auto dimensions = detector.child("dimensions");
+    const auto wcs_node = detector.child("wcs");
+
+    DetectorWCS wcs;
+    wcs.xwidth = dimensions.attributeAsInt("xwidth");
+    wcs.ywidth = dimensions.attributeAsInt("ywidth");
+    wcs.xrpix = wcs_node.attributeAsDouble("xrpix");
+    wcs.yrpix = wcs_node.attributeAsDouble("yrpix");
+    wcs.xrval = wcs_node.attributeAsDouble("xrval");
+    wcs.yrval = wcs_node.attributeAsDouble("yrval");
+    wcs.xdelt = wcs_node.attributeAsDouble("xdelt");
+    wcs.ydelt = wcs_node.attributeAsDouble("ydelt");
+    if (wcs.xwidth <= 0 || wcs.ywidth <= 0)
+        throw std::runtime_error("detector: dimensions must be positive");
+    if (wcs.xdelt == 0 || wcs.ydelt == 0)
+        throw std::runtime_error("detector: wcs xdelt and ydelt must not be 0");
+    return wcs;
+}
+
+namespace {
+    // Pixel i (1-based) covers [i - 0.5, i + 0.5) in FITS pixel coordinates, NaN ends up at -1 too
+    long pixel_index(double position_m, double rpix, double rval, double delt, int width) {
+        const double pixel = std::floor(rpix + (position_m - rval) / delt - 0.5);
+        return pixel >= 0 && pixel < width ? (long) pixel : -1;
+    }
+}
+
+long DetectorWCS::column(double x_mm) const {
+    return pixel_index(x_mm * 1e-3, xrpix, xrval, xdelt, xwidth);
+}
+
+long DetectorWCS::row(double y_mm) const {
+    return pixel_index(y_mm * 1e-3, yrpix, yrval, ydelt, ywidth);
+}
+
+FocalPlaneImage::FocalPlaneImage(const DetectorWCS &wcs, std::vector<std::string> key_names, std::vector<double> energies)
+        : wcs_(wcs), key_names_(std::move(key_names)), energies_(std::move(energies)),
+          planes_(std::max<std::size_t>(1, energies_.size())),
+          pixels_((std::size_t) wcs.xwidth * (std::size_t) wcs.ywidth),
+          image_(pixels_ * planes_, 0.0), sub_images_(key_names_.size()) {}
+
+long FocalPlaneImage::pixel(double x_mm, double y_mm) const {
+    const long column = wcs_.column(x_mm);
+    const long row = wcs_.row(y_mm);
+    if (column < 0 || row < 0)
+        return -1;
+    return row * (long) wcs_.xwidth + column;
+}
+
+std::vector<double> &FocalPlaneImage::sub_image(int key) {
+    if ((std::size_t) key >= sub_images_.size())
+        throw std::runtime_error("FocalPlaneImage: key " + std::to_string(key) + " out of range");
+    std::vector<double> &sub_image = sub_images_[(std::size_t) key];
+    if (sub_image.empty())
+        sub_image.assign(image_.size(), 0.0);
+    return sub_image;
+}
+
+void FocalPlaneImage::add(double x_mm, double y_mm, double weight, int key) {
+    if (planes_ != 1)
+        throw std::runtime_error("FocalPlaneImage: a cube needs spectral weights");
+    const long p = pixel(x_mm, y_mm);
+    if (p < 0) {
+        outside_ += weight;
+        return;
+    }
+    image_[(std::size_t) p] += weight;
+    total_ += weight;
+    if (key >= 0)
+        sub_image(key)[(std::size_t) p] += weight;
+}
+
+void FocalPlaneImage::add(double x_mm, double y_mm, std::span<const float> weights, double weight, int key) {
+    if (weights.size() != planes_)
+        throw std::runtime_error("FocalPlaneImage: " + std::to_string(weights.size()) + " spectral weights for " +
+                                 std::to_string(planes_) + " planes");
+    double sum = 0;
+    for (std::size_t k = 0; k < weights.size(); k++)
+        sum += weight * weights[k];
+    const long p = pixel(x_mm, y_mm);
+    if (p < 0) {
+        outside_ += sum;
+        return;
+    }
+    total_ += sum;
+    std::vector<double> *sub = key >= 0 ? &sub_image(key) : nullptr;
+    for (std::size_t k = 0; k < planes_; k++) {
+        const std::size_t index = k * pixels_ + (std::size_t) p;
+        image_[index] += weight * weights[k];
+        if (sub != nullptr)
+            (*sub)[index] += weight * weights[k];
+    }
+}
+
+void FocalPlaneImage::merge(const FocalPlaneImage &other) {
+    if (other.image_.size() != image_.size() || other.sub_images_.size() != sub_images_.size())
+        throw std::runtime_error("FocalPlaneImage: merging images of different detectors or keys");
+    for (std::size_t i = 0; i < image_.size(); i++)
+        image_[i] += other.image_[i];
+    for (std::size_t key = 0; key < sub_images_.size(); key++) {
+        const std::vector<double> &theirs = other.sub_images_[key];
+        if (theirs.empty())
+            continue;
+        std::vector<double> &ours = sub_images_[key];
+        if (ours.empty())
+            ours.assign(image_.size(), 0.0);
+        for (std::size_t i = 0; i < ours.size(); i++)
+            ours[i] += theirs[i];
+    }
+    total_ += other.total_;
+    outside_ += other.outside_;
+}
+
+void FocalPlaneImage::write_fits(const std::string &path) const {
+    std::vector<FitsCard> wcs_cards = {
+            FitsCard::string("CTYPE1", "DETX"),
+            FitsCard::string("CUNIT1", "m"),
+            FitsCard::number("CRPIX1", wcs_.xrpix),
+            FitsCard::number("CRVAL1", wcs_.xrval),
+            FitsCard::number("CDELT1", wcs_.xdelt),
+            FitsCard::string("CTYPE2", "DETY"),
+            FitsCard::string("CUNIT2", "m"),
+            FitsCard::number("CRPIX2", wcs_.yrpix),
+            FitsCard::number("CRVAL2", wcs_.yrval),
+            FitsCard::number("CDELT2", wcs_.ydelt),
+    };
+    if (planes_ > 1) {
+        wcs_cards.push_back(FitsCard::string("CTYPE3", "ENERGY"));
+        wcs_cards.push_back(FitsCard::string("CUNIT3", "keV"));
+        wcs_cards.push_back(FitsCard::number("CRPIX3", 1));
+        wcs_cards.push_back(FitsCard::number("CRVAL3", energies_[0]));
+        wcs_cards.push_back(FitsCard::number("CDELT3", energies_[1] - energies_[0]));
+    }
+
+    std::vector<FitsImage> images;
+    FitsImage primary{"", wcs_.xwidth, wcs_.ywidth, &image_, wcs_cards, (long) planes_};
+    primary.cards.push_back(FitsCard::number("TOTAL", total_, "sum of weights on the detector"));
+    primary.cards.push_back(FitsCard::number("OUTSIDE", outside_, "sum of weights off the detector"));
+    images.push_back(primary);
+    for (std::size_t key = 0; key < sub_images_.size(); key++) {
+        if (!sub_images_[key].empty())
+            images.push_back({key_names_[key], wcs_.xwidth, wcs_.ywidth, &sub_images_[key], wcs_cards, (long) planes_});
+    }
+    write_fits_images(path, images);
+}
@@ -0,0 +1,110 @@
+/*
+Copyright (C) 2025  Neo Reinmann (neoreinmann@gmail.com)
+*/
+
+#ifndef SIXTE_FOCALPLANEIMAGE_H
+#define SIXTE_FOCALPLANEIMAGE_H
+
+#include "lib/XMLData.h"
+#include <cstddef>
+#include <span>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Pixel grid of the detector, from <detector><dimensions/><wcs/></detector> of the instrument XML.
+ * Like in SIXTE the reference values and pixel sizes are in meters, hit positions are in mm.
+ */
+struct DetectorWCS {
+    int xwidth = 0, ywidth = 0;
+    double xrpix = 0, yrpix = 0;    // reference pixel, 1-based FITS convention
+    double xrval = 0, yrval = 0;    // position of the reference pixel [m]
+    double xdelt = 0, ydelt = 0;    // pixel size [m]
+
+    static DetectorWCS from_xml(const XMLData &xml_data);
+
+    /**
+     * @brief 0-based column / row of a focal plane position in mm, -1 if it misses the detector.
+     */
+    [[nodiscard]] long column(double x_mm) const;
+    [[nodiscard]] long row(double y_mm) const;
+};
+
+/**
+ * @brief Focal plane image binned while tracing, instead of writing every photon and binning it afterwards.
+ *
+ * Besides the total image it can hold keyed sub-images, e.g. one per shell or per number of reflections.
+ * A sub-image is only allocated once something is added to its key. Images are meant to be used one
+ * per worker (PhotonEngine::trace_into) and merged at the end.
+ *
+ * In the spectral mode every image is a cube with one plane per energy bin, the weights of a hit
+ * (HitBatch::spectral) go into the planes of its pixel.
+ */
+class FocalPlaneImage {
+public:
+    /**
+     * @param key_names Names of the sub-images, used as EXTNAME in the FITS file
+     * @param energies Centers of equally wide energy bins [keV], one plane each. Empty for a plain image
+     */
+    explicit FocalPlaneImage(const DetectorWCS &wcs, std::vector<std::string> key_names = {},
+                             std::vector<double> energies = {});
+
+    /**
+     * @brief Adds a hit at (x_mm, y_mm) to the total image and, for key >= 0, to sub-image key.
+     * Hits outside the detector are only counted in outside(). Only for images with one plane.
+     */
+    void add(double x_mm, double y_mm, double weight = 1.0, int key = -1);
+
+    /**
+     * @brief Spectral form of add, weight * weights[k] goes into plane k. Needs one weight per plane.
+     */
+    void add(double x_mm, double y_mm, std::span<const float> weights, double weight = 1.0, int key = -1);
+
+    /**
+     * @brief Adds the images of other, which must have the same WCS and keys.
+     */
+    void merge(const FocalPlaneImage &other);
+
+    [[nodiscard]] const DetectorWCS &wcs() const { return wcs_; }
+    [[nodiscard]] const std::vector<std::string> &key_names() const { return key_names_; }
+
+    [[nodiscard]] std::size_t planes() const { return planes_; }
+
+    /**
+     * @brief Total image, row-major with xwidth values per row, plane after plane.
+     */
+    [[nodiscard]] const std::vector<double> &image() const { return image_; }
+
+    /**
+     * @brief Sub-image of key, empty if nothing was added to it.
+     */
+    [[nodiscard]] const std::vector<double> &sub_image(std::size_t key) const { return sub_images_[key]; }
+
+    // Sum of the weights on / off the detector, over all planes
+    [[nodiscard]] double total() const { return total_; }
+    [[nodiscard]] double outside() const { return outside_; }
+
+    /**
+     * @brief Writes the total image as primary HDU and every non-empty sub-image as IMAGE extension.
+     */
+    void write_fits(const std::string &path) const;
+
+private:
+    DetectorWCS wcs_;
+    std::vector<std::string> key_names_;
+    std::vector<double> energies_;
+    std::size_t planes_;
+    std::size_t pixels_;
+    std::vector<double> image_;
+    std::vector<std::vector<double>> sub_images_;
+    double total_ = 0;
+    double outside_ = 0;
+
+    // Index of the pixel at (x_mm, y_mm) within a plane, -1 if it misses the detector
+    [[nodiscard]] long pixel(double x_mm, double y_mm) const;
+    // Sub-image of key, allocated on first use
+    std::vector<double> &sub_image(int key);
+};
+
+
+#endif //SIXTE_FOCALPLANEIMAGE_H
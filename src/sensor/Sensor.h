@@ -6,6 +6,7 @@ Copyright (C) 2025  Neo Reinmann (neoreinmann@gmail.com)
 #define SIXTE_SENSOR_H
 
 #include "geometry/Ray.h"
+#include <embree4/rtcore.h>
 
 class Sensor {
 public:
@@ -14,6 +15,8 @@ public:
     std::string filename;
     Vec3fa position;
     unsigned int geomID = -1;
+    // Build quality of the mesh's BVH, <... bvh_quality>
+    RTCBuildQuality build_quality = RTC_BUILD_QUALITY_HIGH;
 };
 
 
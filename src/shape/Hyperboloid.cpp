@@ -9,116 +9,180 @@ Copyright (C) 2025  Neo Reinmann (neoreinmann@gmail.com)
 Hyperboloid::Hyperboloid(Hyperboloid_parameters hyperboloid_parameters) : a(hyperboloid_parameters.a),
     b(hyperboloid_parameters.b), c(hyperboloid_parameters.c), Xh_max(hyperboloid_parameters.Xh_max),
     Xh_min(hyperboloid_parameters.Xh_min), Yh_max(hyperboloid_parameters.Yh_max), Yh_min(hyperboloid_parameters.Yh_min),
-    theta(hyperboloid_parameters.theta), surface(hyperboloid_parameters.surface), hyperboloid_parameters(hyperboloid_parameters),
+    theta(hyperboloid_parameters.theta), hyperboloid_parameters(hyperboloid_parameters),
     geomID(hyperboloid_parameters.geomID)
 {}
 
 void Hyperboloid::hyperboloidBoundsFunc(const RTCBoundsFunctionArguments *args) {
-    const auto* para = (const Hyperboloid_parameters*) args->geometryUserPtr;
+    const auto* shell = (const PreparedHyperboloid*) args->geometryUserPtr;
+    const ShellSegmentation &segmentation = *shell->segmentation;
     RTCBounds* b = args->bounds_o;
 
     const float pad = 0.5f; // mm safety
 
-    // axial (Z)
-    b->lower_z = (float)para->Xh_min - pad;
-    b->upper_z = (float)para->Xh_max + pad;
-
-    // radial circle (X,Y), symmetric padding
-    float rmin = (float)para->Yh_min; // these are radii in your code
-    float rmax = (float)para->Yh_max;
-    float R    = std::max(rmin, rmax);
+    // axial (Z) from the primitive's band, radial from the band's annulus sector with symmetric padding
+    double z_lo, z_hi, r_lo, r_hi;
+    segmentation.band_range(args->primID, shell->z_min, shell->z_max, z_lo, z_hi);
+    shell->radial_range(z_lo, z_hi, r_lo, r_hi);
+    float lower[3], upper[3];
+    segmentation.sector_box(args->primID, r_lo, r_hi, lower, upper);
+    lower[0] -= pad;
+    lower[1] -= pad;
+    lower[2] = (float)z_lo - pad;
+    upper[0] += pad;
+    upper[1] += pad;
+    upper[2] = (float)z_hi + pad;
+
+    // the ranges are in the shell's frame, move the box to where the shell is
+    float world_lower[3], world_upper[3];
+    shell->frame.bounds_to_world(lower, upper, world_lower, world_upper);
+    b->lower_x = world_lower[0];
+    b->lower_y = world_lower[1];
+    b->lower_z = world_lower[2];
+    b->upper_x = world_upper[0];
+    b->upper_y = world_upper[1];
+    b->upper_z = world_upper[2];
+}
 
-    b->lower_x = -R - pad;
-    b->upper_x =  R + pad;
-    b->lower_y = -R - pad;
-    b->upper_y =  R + pad;
+PreparedHyperboloid Hyperboloid::prepare(const Hyperboloid_parameters &para, const ShellSegmentation &segmentation) {
+    PreparedHyperboloid shell{};
+    shell.frame = ShellFrame::make(para.angle_x, para.angle_y, para.origin);
+    shell.a2 = para.a * para.a;
+    shell.b2 = para.b * para.b;
+    shell.c = para.c;
+    shell.c_f = (float) para.c;
+    shell.z_min = para.Xh_min;
+    shell.z_max = para.Xh_max;
+    shell.r_min = (float) para.Yh_min;
+    shell.r_max = (float) para.Yh_max;
+    shell.geomID = para.geomID;
+    shell.segmentation = &segmentation;
+    return shell;
 }
 
 void Hyperboloid::hyperboloidIntersectFunc(const RTCIntersectFunctionNArguments* args) {
-    auto* rh = (RTCRayHit*)args->rayhit;
-    RTCRay& ray = rh->ray;
-    const auto* para = (const Hyperboloid_parameters*)args->geometryUserPtr;
-
-    // build basis (same as paraboloid)
-    auto Rm = get_rotation_matrix(para->angle_x, para->angle_y);
-    Vec3fa z_tilted = Rm * Vec3fa{0,0,1};
-    Vec3fa x_tilted = normalize(cross(z_tilted, Vec3fa{0,1,0}));
-    Vec3fa y_tilted = cross(z_tilted, x_tilted);
-    std::array<Vec3fa,3> basis = {x_tilted, y_tilted, z_tilted};
-
-    // world ray -> local ray
-    Vec3fa pW{ray.org_x, ray.org_y, ray.org_z};
-    Vec3fa vW{ray.dir_x, ray.dir_y, ray.dir_z};
-    Vec3fa pL = to_local(basis, para->origin, pW);
-    Vec3fa vL = dir_to_local(basis, vW);
-
-    // doubles for robustness
-    const double px = pL.x, py = pL.y, pz = pL.z;
-    const double dx = vL.x, dy = vL.y, dz = vL.z;
-
-    const double a  = para->a;
-    const double b  = para->b;
-    const double c  = para->c;
-    const double a2 = a*a;
-    const double b2 = b*b;
-
-    // x^2/b^2 + y^2/b^2 - (z-c)^2/a^2 = -1  -> A t^2 + B t + C = 0
-    const double A = (dx*dx + dy*dy)/b2 - (dz*dz)/a2;
-    const double B = 2.0 * ((px*dx + py*dy)/b2 - ((pz - c)*dz)/a2);
-    const double C = (px*px + py*py)/b2 - ((pz - c)*(pz - c))/a2 + 1.0;
-
-    auto accept = [&](double t)->bool {
-        if (!(t > (double)ray.tnear && t < (double)ray.tfar)) return false;
-        double zh = pz + dz*t; // local z!
-        return (zh >= para->Xh_min && zh <= para->Xh_max);
-    };
-
-    const double eps = 1e-18;
-    double tHit = std::numeric_limits<double>::infinity();
-
-    if (std::abs(A) < eps) {
-        if (std::abs(B) < eps) return; // no solution
-        double t = -C / B;
-        if (!accept(t)) return;
-        tHit = t;
-    } else {
-        double disc = B*B - 4.0*A*C;
-        if (disc < 0.0) return;
-        double sd = std::sqrt(disc);
-        double t0 = (-B - sd) / (2.0*A);
-        double t1 = (-B + sd) / (2.0*A);
-        if (t0 > t1) std::swap(t0, t1);
-
-        if      (accept(t0)) tHit = t0;
-        else if (accept(t1)) tHit = t1;
-        else return;
+    const auto* shell = (const PreparedHyperboloid*)args->geometryUserPtr;
+
+    const ShellSegment segment = shell->segmentation->segment(args->primID, shell->z_min, shell->z_max);
+
+    // Packet queries (rtcIntersect4/8/16) hand in up to N rays, only the valid lanes may be touched
+    dispatch_lanes(args, shell->geomID, [shell, &segment](const auto &rays, auto &hits) {
+        Hyperboloid::intersect_lanes(*shell, segment, rays, hits);
+    });
+}
+
+namespace {
+    template<bool Untilted, unsigned W>
+    void hyperboloid_lanes(const PreparedHyperboloid &shell, const ShellSegment &segment, const RayLanes<W> &rays,
+                           HitLanes<W> &hits) {
+        const ShellFrame &frame = shell.frame;
+        const double c  = shell.c;
+        const double a2 = shell.a2;
+        const double b2 = shell.b2;
+        const double eps = 1e-18;
+
+        // Every lane runs the same instructions, both roots are tested and the first accepted one is selected
+        for (unsigned l = 0; l < W; l++) {
+            // world ray -> local ray, doubles for robustness
+            float lpx, lpy, lpz, ldx, ldy, ldz;
+            frame.rotate_to_local<Untilted>(rays.org_x[l] - frame.origin[0], rays.org_y[l] - frame.origin[1],
+                                            rays.org_z[l] - frame.origin[2], lpx, lpy, lpz);
+            frame.rotate_to_local<Untilted>(rays.dir_x[l], rays.dir_y[l], rays.dir_z[l], ldx, ldy, ldz);
+            const double px = lpx, py = lpy, pz = lpz;
+            const double dx = ldx, dy = ldy, dz = ldz;
+
+            // x^2/b^2 + y^2/b^2 - (z-c)^2/a^2 = -1  -> A t^2 + B t + C = 0
+            const double A = (dx*dx + dy*dy)/b2 - (dz*dz)/a2;
+            const double B = 2.0 * ((px*dx + py*dy)/b2 - ((pz - c)*dz)/a2);
+            const double C = (px*px + py*py)/b2 - ((pz - c)*(pz - c))/a2 + 1.0;
+
+            auto accept = [&](double t)->bool {
+                const double zh = pz + dz*t; // local z!
+                const float xh = (float)(px + dx*t);
+                const float yh = (float)(py + dy*t);
+                return (t > rays.tnear[l]) & (t < rays.tfar[l]) & (zh >= shell.z_min) & (zh <= shell.z_max)
+                       & segment.contains(xh, yh, zh);
+            };
+
+            // degenerate: linear equation
+            const double t_lin = -C / B;
+
+            // otherwise the smaller accepted root
+            const double disc = B*B - 4.0*A*C;
+            const double sd = std::sqrt(disc >= 0.0 ? disc : 0.0);
+            const double t0 = (-B - sd) / (2.0*A);
+            const double t1 = (-B + sd) / (2.0*A);
+            const double t_lo = t0 > t1 ? t1 : t0;
+            const double t_hi = t0 > t1 ? t0 : t1;
+            const double t_quad = accept(t_lo) ? t_lo : t_hi;
+
+            const bool linear = std::abs(A) < eps;
+            const double tHit = linear ? t_lin : t_quad;
+            // no ternary on bools here, GCC does not if-convert that
+            const bool solvable = (linear & (std::abs(B) >= eps)) | (!linear & (disc >= 0.0));
+            hits.hit[l] = (rays.valid[l] != 0) & solvable & accept(tHit);
+            hits.t[l] = (float)tHit;
+
+            // local hit point (for normal)
+            const float hx = (float)(px + dx*tHit);
+            const float hy = (float)(py + dy*tHit);
+            const float hz = (float)(pz + dz*tHit);
+
+            // inward geometric normal in LOCAL space:
+            // n ∝ ( x/b^2, y/b^2, -(z-c)/a^2 )
+            double nx =  hx / b2;
+            double ny =  hy / b2;
+            double nz = -(hz - shell.c_f) / a2;
+            const double nlen = std::sqrt(nx*nx + ny*ny + nz*nz);
+            const double nscale = nlen > 0.0 ? nlen : 1.0;
+            nx /= nscale; ny /= nscale; nz /= nscale;
+
+            // transform normal to world and keep the sign convention
+            float wx, wy, wz;
+            frame.rotate_to_world<Untilted>((float)nx, (float)ny, (float)nz, wx, wy, wz);
+            hits.Ng_x[l] = -wx;
+            hits.Ng_y[l] = -wy;
+            hits.Ng_z[l] = -wz;
+        }
     }
+}
 
-    // commit hit (t is the same in world)
-    ray.tfar       = (float)tHit;
-    rh->hit.geomID = para->geomID;
-    rh->hit.primID = para->geomID;
-
-    // local hit point (for normal)
-    const float hx = (float)(px + dx*tHit);
-    const float hy = (float)(py + dy*tHit);
-    const float hz = (float)(pz + dz*tHit);
-
-    // inward geometric normal in LOCAL space:
-    // n ∝ ( x/b^2, y/b^2, -(z-c)/a^2 )
-    double nx =  hx / b2;
-    double ny =  hy / b2;
-    double nz = -(hz - (float)c) / a2;
-    double nlen = std::sqrt(nx*nx + ny*ny + nz*nz);
-    if (nlen > 0.0) { nx /= nlen; ny /= nlen; nz /= nlen; }
-
-    // transform normal to world and keep your sign convention
-    Vec3fa Nw = normal_to_world(basis, Vec3fa{(float)nx,(float)ny,(float)nz});
-    rh->hit.Ng_x = -Nw.x;
-    rh->hit.Ng_y = -Nw.y;
-    rh->hit.Ng_z = -Nw.z;
+template<unsigned W>
+void Hyperboloid::intersect_lanes(const PreparedHyperboloid &shell, const ShellSegment &segment,
+                                  const RayLanes<W> &rays, HitLanes<W> &hits) {
+    if (shell.frame.untilted)
+        hyperboloid_lanes<true>(shell, segment, rays, hits);
+    else
+        hyperboloid_lanes<false>(shell, segment, rays, hits);
 }
 
-void Hyperboloid::hyperboloidOccludedFunc([[maybe_unused]] const RTCOccludedFunctionNArguments *args) {
+template void Hyperboloid::intersect_lanes<1>(const PreparedHyperboloid &, const ShellSegment &,
+                                               const RayLanes<1> &, HitLanes<1> &);
+template void Hyperboloid::intersect_lanes<4>(const PreparedHyperboloid &, const ShellSegment &,
+                                               const RayLanes<4> &, HitLanes<4> &);
+template void Hyperboloid::intersect_lanes<8>(const PreparedHyperboloid &, const ShellSegment &,
+                                               const RayLanes<8> &, HitLanes<8> &);
+template void Hyperboloid::intersect_lanes<16>(const PreparedHyperboloid &, const ShellSegment &,
+                                               const RayLanes<16> &, HitLanes<16> &);
+
+bool Hyperboloid::intersect(const PreparedHyperboloid &shell, const Vec3fa &pW, const Vec3fa &vW, float tnear,
+                            float tfar, float &t_hit, Vec3fa &normal) {
+    RayLanes<1> rays{{pW.x}, {pW.y}, {pW.z}, {vW.x}, {vW.y}, {vW.z}, {tnear}, {tfar}, {1}};
+    HitLanes<1> hits;
+    intersect_lanes(shell, ShellSegment::whole(), rays, hits);
+    if (!hits.hit[0]) return false;
+    t_hit = hits.t[0];
+    normal = Vec3fa{hits.Ng_x[0], hits.Ng_y[0], hits.Ng_z[0]};
+    return true;
+}
+
+void Hyperboloid::hyperboloidOccludedFunc(const RTCOccludedFunctionNArguments *args) {
+    const auto* shell = (const PreparedHyperboloid*) args->geometryUserPtr;
+
+    const ShellSegment segment = shell->segmentation->segment(args->primID, shell->z_min, shell->z_max);
 
+    // Same kernel as the intersection, any hit in [tnear, tfar] blocks the ray
+    dispatch_lanes(args, shell->geomID, [shell, &segment](const auto &rays, auto &hits) {
+        Hyperboloid::intersect_lanes(*shell, segment, rays, hits);
+    });
 }
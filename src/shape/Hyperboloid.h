@@ -8,22 +8,52 @@ Copyright (C) 2025  Neo Reinmann (neoreinmann@gmail.com)
 #include "geometry/Ray.h"
 #include "surface/SurfaceModel.h"
 #include "surface/GaussSurface.h"
+#include "shape/RayLanes.h"
+#include "shape/ShellFrame.h"
+#include "shape/ShellSegmentation.h"
 #include <embree4/rtcore.h>
+#include <algorithm>
+#include <cmath>
 
 struct Hyperboloid_parameters {
     double a, b, c, Xh_max, Xh_min, Yh_max, Yh_min, theta;
-    std::shared_ptr<SurfaceModel> surface;
     RTCGeometry geometry;
     unsigned int geomID;
     double angle_x, angle_y;
     Vec3fa origin = Vec3fa{0.f, 0.f, 0.f};
 };
 
+/**
+ * @brief Hyperboloid_parameters baked once at scene setup, the only thing the intersect kernels read.
+ * One record per cache line, used as Embree user data of the shell.
+ */
+struct alignas(64) PreparedHyperboloid {
+    ShellFrame frame;
+    double a2, b2, c;       // a², b², c
+    float c_f;              // (float) c for the normal
+    double z_min, z_max;    // Xh_min, Xh_max in the local frame
+    float r_min, r_max;     // Yh_min, Yh_max
+    unsigned int geomID;
+    const ShellSegmentation *segmentation;  // primitives the shell is cut into
+
+    /**
+     * @brief Radius of the surface at local z, r² = b² ((z-c)²/a² - 1) grows with |z - c|.
+     */
+    [[nodiscard]] double radius(double z) const { return std::sqrt(std::max(0.0, b2 * ((z - c) * (z - c) / a2 - 1.0))); }
+
+    /**
+     * @brief Radial range of the surface between local z_lo and z_hi, the waist at z = c has radius 0.
+     */
+    void radial_range(double z_lo, double z_hi, double &r_lo, double &r_hi) const {
+        const double r_a = radius(z_lo), r_b = radius(z_hi);
+        r_lo = z_lo < c && c < z_hi ? 0.0 : std::min(r_a, r_b);
+        r_hi = std::max(r_a, r_b);
+    }
+};
 
 class Hyperboloid {
 public:
     double a, b, c, Xh_max, Xh_min, Yh_max, Yh_min, theta;
-    std::shared_ptr<SurfaceModel> surface;
     Hyperboloid_parameters hyperboloid_parameters{};
     unsigned int geomID;
 
@@ -34,6 +64,28 @@ public:
     static void hyperboloidIntersectFunc(const RTCIntersectFunctionNArguments *args);
 
     static void hyperboloidOccludedFunc(const RTCOccludedFunctionNArguments *args);
+
+    /**
+     * @brief Builds the record the intersect kernels work on, geomID is filled in once the shell is attached.
+     * The shell is registered with segmentation.primitives() primitives, segmentation has to outlive the record.
+     */
+    static PreparedHyperboloid prepare(const Hyperboloid_parameters &para, const ShellSegmentation &segmentation);
+
+    /**
+     * @brief W rays against one segment of a shell without branches, so the lane loop vectorizes.
+     * Instantiated for W = 1, 4, 8 and 16, hits.hit[l] is set for valid lanes hit in (tnear, tfar)
+     * within the segment.
+     */
+    template<unsigned W>
+    static void intersect_lanes(const PreparedHyperboloid &shell, const ShellSegment &segment,
+                                const RayLanes<W> &rays, HitLanes<W> &hits);
+
+    /**
+     * @brief Single ray against one whole shell.
+     * @return true if the shell is hit in (tnear, tfar), t_hit and the world space normal are set then
+     */
+    static bool intersect(const PreparedHyperboloid &shell, const Vec3fa &pW, const Vec3fa &vW, float tnear,
+                          float tfar, float &t_hit, Vec3fa &normal);
 };
 
 
@@ -18,6 +18,8 @@ public:
     std::string filename;
     Vec3fa position;
     unsigned int geomID = -1;
+    // Build quality of the mesh's BVH, <optical bvh_quality>
+    RTCBuildQuality build_quality = RTC_BUILD_QUALITY_HIGH;
 };
 
 
@@ -9,109 +9,169 @@ Copyright (C) 2025  Neo Reinmann (neoreinmann@gmail.com)
 
 Paraboloid::Paraboloid(Paraboloid_parameters paraboloid_parameters)
     : theta(paraboloid_parameters.theta), p(paraboloid_parameters.p), Yp_min(paraboloid_parameters.Yp_min),
-      Xp_min(paraboloid_parameters.Xp_min), Xp_max(paraboloid_parameters.Xp_max), Yp_max(paraboloid_parameters.Yp_max), surface(paraboloid_parameters.surface), paraboloid_parameters(paraboloid_parameters)
+      Xp_min(paraboloid_parameters.Xp_min), Xp_max(paraboloid_parameters.Xp_max), Yp_max(paraboloid_parameters.Yp_max), paraboloid_parameters(paraboloid_parameters)
 {}
 
 void Paraboloid::paraboloidBoundsFunc(const RTCBoundsFunctionArguments *args) {
-    const auto* para = (const Paraboloid_parameters*) args->geometryUserPtr;
+    const auto* shell = (const PreparedParaboloid*) args->geometryUserPtr;
+    const ShellSegmentation &segmentation = *shell->segmentation;
     RTCBounds* b = args->bounds_o;
 
     const float pad = 0.5f; // mm safety
 
-    // axial (Z) from paper’s Xp
-    b->lower_z = (float)para->Xp_min - pad;
-    b->upper_z = (float)para->Xp_max + pad;
-
-    // radial circle (X,Y) using the true max radius at Zmax
-    float rmax = (float)para->Yp_max;
+    // axial (Z) from the primitive's band of Xp, radial from the band's annulus sector, r grows with z
+    double z_lo, z_hi;
+    segmentation.band_range(args->primID, shell->z_min, shell->z_max, z_lo, z_hi);
+    float lower[3], upper[3];
+    segmentation.sector_box(args->primID, shell->radius(z_lo), shell->radius(z_hi), lower, upper);
+    lower[0] -= pad;
+    lower[1] -= pad;
+    lower[2] = (float)z_lo - pad;
+    upper[0] += pad;
+    upper[1] += pad;
+    upper[2] = (float)z_hi + pad;
+
+    // the ranges are in the shell's frame, move the box to where the shell is
+    float world_lower[3], world_upper[3];
+    shell->frame.bounds_to_world(lower, upper, world_lower, world_upper);
+    b->lower_x = world_lower[0];
+    b->lower_y = world_lower[1];
+    b->lower_z = world_lower[2];
+    b->upper_x = world_upper[0];
+    b->upper_y = world_upper[1];
+    b->upper_z = world_upper[2];
+}
 
-    b->lower_x = -rmax - pad;
-    b->upper_x =  rmax + pad;
-    b->lower_y = -rmax - pad;
-    b->upper_y =  rmax + pad;
+PreparedParaboloid Paraboloid::prepare(const Paraboloid_parameters &para, const ShellSegmentation &segmentation) {
+    PreparedParaboloid shell{};
+    shell.frame = ShellFrame::make(para.angle_x, para.angle_y, para.origin);
+    shell.p = para.p;
+    shell.p2 = para.p * para.p;
+    shell.two_p = 2.0 * para.p;
+    shell.p_f = float(para.p);
+    shell.z_min = para.Xp_min;
+    shell.z_max = para.Xp_max;
+    shell.r_min = (float) para.Yp_min;
+    shell.r_max = (float) para.Yp_max;
+    shell.geomID = para.geomID;
+    shell.segmentation = &segmentation;
+    return shell;
 }
 
 void Paraboloid::paraboloidIntersectFunc(const RTCIntersectFunctionNArguments *args) {
-    auto* rayhit = (RTCRayHit*) args->rayhit;
-    RTCRay& ray = rayhit->ray;
-    const auto* para  = (const Paraboloid_parameters*) args->geometryUserPtr;
-
-    // Build rotated frame
-    auto R = get_rotation_matrix(para->angle_x, para->angle_y); // columns
-    Vec3fa z_tilted = R * Vec3fa{0,0,1};
-    Vec3fa x_tilted = normalize(cross(z_tilted, Vec3fa{0,1,0}));
-    Vec3fa y_tilted = cross(z_tilted, x_tilted);
-    std::array<Vec3fa,3> basis = {x_tilted, y_tilted, z_tilted};
-
-    // World-space ray
-    Vec3fa pos{ray.org_x, ray.org_y, ray.org_z};
-    Vec3fa dir{ray.dir_x, ray.dir_y, ray.dir_z};
-
-    // subtract translation before rotating
-    Vec3fa pos_local = to_local(basis, para->origin, pos);
-    Vec3fa dir_local = dir_to_local(basis, dir);
-
-    // Ray components in LOCAL coordinates
-    float p_x = pos_local.x, p_y = pos_local.y, p_z = pos_local.z;
-    float v_x = dir_local.x, v_y = dir_local.y, v_z = dir_local.z;
-
-    // Paraboloid intersection in local frame
-    double A = double(v_x)*v_x + double(v_y)*v_y;
-    double B = 2.0 * (double(p_x)*v_x + double(p_y)*v_y - double(para->p)*v_z);
-    double C = double(p_x)*p_x + double(p_y)*p_y - double(para->p)*para->p - 2.0*double(para->p)*p_z;
-
-    const double eps = 1e-12;
-    double t = std::numeric_limits<double>::infinity();
-
-    if (std::abs(A) < eps) { // locally parallel to local z
-        if (std::abs(v_z) >= eps) {
-            t = (-double(para->p)*(double(para->p) + 2.0*double(p_z)) + double(p_x)*p_x + double(p_y)*p_y)
-                / (2.0*double(para->p)*double(v_z));
-        }
-    } else {
-        double D = B*B - 4.0*A*C;
-        if (D >= 0.0) {
-            double sD = std::sqrt(D);
-            double t1 = (-B + sD) / (2.0*A);
-            double t2 = (-B - sD) / (2.0*A);
-            t = std::min(t1, t2);
-            if (t < 0.0) t = std::max(t1, t2);
-        }
-    }
+    const auto* shell = (const PreparedParaboloid*) args->geometryUserPtr;
 
-    if (!std::isfinite(t)) return;
+    const ShellSegment segment = shell->segmentation->segment(args->primID, shell->z_min, shell->z_max);
 
-    // z check in LOCAL space
-    float zhit = float(p_z + t * v_z);
-    if (zhit < para->Xp_min || zhit > para->Xp_max) return;
+    // Packet queries (rtcIntersect4/8/16) hand in up to N rays, only the valid lanes may be touched
+    dispatch_lanes(args, shell->geomID, [shell, &segment](const auto &rays, auto &hits) {
+        Paraboloid::intersect_lanes(*shell, segment, rays, hits);
+    });
+}
 
-    // t-range check in WORLD space (same t)
-    if (t < ray.tnear || t > ray.tfar) return;
+namespace {
+    template<bool Untilted, unsigned W>
+    void paraboloid_lanes(const PreparedParaboloid &shell, const ShellSegment &segment, const RayLanes<W> &rays,
+                          HitLanes<W> &hits) {
+        const ShellFrame &frame = shell.frame;
+        const double p = shell.p;
+        const double eps = 1e-12;
+        const double inf = std::numeric_limits<double>::infinity();
+
+        // Every lane runs the same instructions, both solutions are computed and the valid one is selected
+        for (unsigned l = 0; l < W; l++) {
+            // subtract translation before rotating
+            float p_x, p_y, p_z, v_x, v_y, v_z;
+            frame.rotate_to_local<Untilted>(rays.org_x[l] - frame.origin[0], rays.org_y[l] - frame.origin[1],
+                                            rays.org_z[l] - frame.origin[2], p_x, p_y, p_z);
+            frame.rotate_to_local<Untilted>(rays.dir_x[l], rays.dir_y[l], rays.dir_z[l], v_x, v_y, v_z);
+
+            // Paraboloid intersection in local frame
+            const double A = double(v_x)*v_x + double(v_y)*v_y;
+            const double B = 2.0 * (double(p_x)*v_x + double(p_y)*v_y - p*v_z);
+            const double C = double(p_x)*p_x + double(p_y)*p_y - shell.p2 - shell.two_p*p_z;
+
+            // locally parallel to local z
+            const double t_axial = (-p*(p + 2.0*double(p_z)) + double(p_x)*p_x + double(p_y)*p_y) / (shell.two_p*double(v_z));
+            const double t_lin = std::abs(v_z) >= eps ? t_axial : inf;
+
+            const double D = B*B - 4.0*A*C;
+            const double sD = std::sqrt(D >= 0.0 ? D : 0.0);
+            const double t1 = (-B + sD) / (2.0*A);
+            const double t2 = (-B - sD) / (2.0*A);
+            const double t_min = t2 < t1 ? t2 : t1;
+            const double t_max = t1 < t2 ? t2 : t1;
+            const double t_quad = D >= 0.0 ? (t_min < 0.0 ? t_max : t_min) : inf;
+
+            const double t = std::abs(A) < eps ? t_lin : t_quad;
+
+            // Local hit point
+            const float hx = float(p_x + t * v_x);
+            const float hy = float(p_y + t * v_y);
+            const float zhit = float(p_z + t * v_z);
+
+            // z and segment check in LOCAL space, t-range check in WORLD space (same t)
+            hits.hit[l] = (rays.valid[l] != 0) & (t > -inf) & (t < inf)
+                          & (zhit >= shell.z_min) & (zhit <= shell.z_max) & segment.contains(hx, hy, zhit)
+                          & (t >= rays.tnear[l]) & (t <= rays.tfar[l]);
+            hits.t[l] = float(t);
+
+            // Normal
+            float nx =  hx / shell.p_f;
+            float ny =  hy / shell.p_f;
+            float nz = -1.0f;
+            const float invLen = 1.0f / std::sqrt(nx*nx + ny*ny + nz*nz);
+            nx *= invLen; ny *= invLen; nz *= invLen;
+
+            // Back to WORLD with the original flip
+            float wx, wy, wz;
+            frame.rotate_to_world<Untilted>(nx, ny, nz, wx, wy, wz);
+            hits.Ng_x[l] = -wx;
+            hits.Ng_y[l] = -wy;
+            hits.Ng_z[l] = -wz;
+        }
+    }
+}
 
-    // Commit the hit
-    ray.tfar = float(t);
-    rayhit->hit.primID = para->geomID;
-    rayhit->hit.geomID = para->geomID;
+template<unsigned W>
+void Paraboloid::intersect_lanes(const PreparedParaboloid &shell, const ShellSegment &segment, const RayLanes<W> &rays,
+                                 HitLanes<W> &hits) {
+    if (shell.frame.untilted)
+        paraboloid_lanes<true>(shell, segment, rays, hits);
+    else
+        paraboloid_lanes<false>(shell, segment, rays, hits);
+}
 
-    // Local hit point and normal
-    float hx = float(p_x + t * v_x);
-    float hy = float(p_y + t * v_y);
+template void Paraboloid::intersect_lanes<1>(const PreparedParaboloid &, const ShellSegment &, const RayLanes<1> &,
+                                              HitLanes<1> &);
+template void Paraboloid::intersect_lanes<4>(const PreparedParaboloid &, const ShellSegment &, const RayLanes<4> &,
+                                              HitLanes<4> &);
+template void Paraboloid::intersect_lanes<8>(const PreparedParaboloid &, const ShellSegment &, const RayLanes<8> &,
+                                              HitLanes<8> &);
+template void Paraboloid::intersect_lanes<16>(const PreparedParaboloid &, const ShellSegment &, const RayLanes<16> &,
+                                              HitLanes<16> &);
+
+bool Paraboloid::intersect(const PreparedParaboloid &shell, const Vec3fa &pos, const Vec3fa &dir, float tnear,
+                           float tfar, float &t_hit, Vec3fa &normal) {
+    RayLanes<1> rays{{pos.x}, {pos.y}, {pos.z}, {dir.x}, {dir.y}, {dir.z}, {tnear}, {tfar}, {1}};
+    HitLanes<1> hits;
+    intersect_lanes(shell, ShellSegment::whole(), rays, hits);
+    if (!hits.hit[0]) return false;
+    t_hit = hits.t[0];
+    normal = Vec3fa{hits.Ng_x[0], hits.Ng_y[0], hits.Ng_z[0]};
+    return true;
+}
 
-    float nx =  hx / float(para->p);
-    float ny =  hy / float(para->p);
-    float nz = -1.0f;
-    float invLen = 1.0f / std::sqrt(nx*nx + ny*ny + nz*nz);
-    nx *= invLen; ny *= invLen; nz *= invLen;
 
-    // Back to WORLD for the geometric normal
-    Vec3fa Nw = normal_to_world(basis, Vec3fa{nx, ny, nz});
-    // Keep your original flip if needed
-    rayhit->hit.Ng_x = -Nw.x;
-    rayhit->hit.Ng_y = -Nw.y;
-    rayhit->hit.Ng_z = -Nw.z;
-}
+void Paraboloid::paraboloidOccludedFunc(const RTCOccludedFunctionNArguments *args) {
+    const auto* shell = (const PreparedParaboloid*) args->geometryUserPtr;
 
+    const ShellSegment segment = shell->segmentation->segment(args->primID, shell->z_min, shell->z_max);
 
-void Paraboloid::paraboloidOccludedFunc([[maybe_unused]] const RTCOccludedFunctionNArguments *args) { }
+    // Same kernel as the intersection, any hit in [tnear, tfar] blocks the ray
+    dispatch_lanes(args, shell->geomID, [shell, &segment](const auto &rays, auto &hits) {
+        Paraboloid::intersect_lanes(*shell, segment, rays, hits);
+    });
+}
 
 
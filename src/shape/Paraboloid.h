@@ -13,18 +13,41 @@ RTC_NAMESPACE_USE
 #include "surface/SurfaceModel.h"
 #include "surface/GaussSurface.h"
 #include "surface/Microfacet.h"
+#include "shape/RayLanes.h"
+#include "shape/ShellFrame.h"
+#include "shape/ShellSegmentation.h"
 #include <embree4/rtcore.h>
+#include <algorithm>
 #include <array>
+#include <cmath>
 
 struct Paraboloid_parameters {
     double p, theta, Yp_min, Xp_min, Xp_max, Yp_max;
-    std::shared_ptr<SurfaceModel> surface;
     RTCGeometry geometry;
     unsigned int geomID;
     double angle_x, angle_y;
     Vec3fa origin = Vec3fa{0.f, 0.f, 0.f};
 };
 
+/**
+ * @brief Paraboloid_parameters baked once at scene setup, the only thing the intersect kernels read.
+ * One record per cache line, used as Embree user data of the shell.
+ */
+struct alignas(64) PreparedParaboloid {
+    ShellFrame frame;
+    double p, p2, two_p;    // p, p², 2p
+    float p_f;              // (float) p for the normal
+    double z_min, z_max;    // Xp_min, Xp_max in the local frame
+    float r_min, r_max;     // Yp_min, Yp_max
+    unsigned int geomID;
+    const ShellSegmentation *segmentation;  // primitives the shell is cut into
+
+    /**
+     * @brief Radius of the surface at local z, r² = p² + 2pz grows with z.
+     */
+    [[nodiscard]] double radius(double z) const { return std::sqrt(std::max(0.0, p2 + two_p * z)); }
+};
+
 class Paraboloid {
     // class for paraboloid equation:
     // z = (x²+y²)/2p - p/2
@@ -35,7 +58,6 @@ public:
     double Xp_min;
     double Xp_max;
     double Yp_max;
-    std::shared_ptr<SurfaceModel> surface;
     unsigned int geomID;
     Paraboloid_parameters paraboloid_parameters;
 
@@ -47,5 +69,27 @@ public:
 
     static void paraboloidOccludedFunc(const RTCOccludedFunctionNArguments *args);
 
+    /**
+     * @brief Builds the record the intersect kernels work on, geomID is filled in once the shell is attached.
+     * The shell is registered with segmentation.primitives() primitives, segmentation has to outlive the record.
+     */
+    static PreparedParaboloid prepare(const Paraboloid_parameters &para, const ShellSegmentation &segmentation);
+
+    /**
+     * @brief W rays against one segment of a shell without branches, so the lane loop vectorizes.
+     * Instantiated for W = 1, 4, 8 and 16, hits.hit[l] is set for valid lanes hit in [tnear, tfar]
+     * where the shell's first crossing lies in the segment.
+     */
+    template<unsigned W>
+    static void intersect_lanes(const PreparedParaboloid &shell, const ShellSegment &segment, const RayLanes<W> &rays,
+                                HitLanes<W> &hits);
+
+    /**
+     * @brief Single ray against one whole shell.
+     * @return true if the shell is hit in [tnear, tfar], t_hit and the world space normal are set then
+     */
+    static bool intersect(const PreparedParaboloid &shell, const Vec3fa &pos, const Vec3fa &dir, float tnear,
+                          float tfar, float &t_hit, Vec3fa &normal);
+
 };
 #endif //SIXTE_PARABOLOID_H
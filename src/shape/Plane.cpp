@@ -3,70 +3,98 @@ Copyright (C) 2025  Neo Reinmann (neoreinmann@gmail.com)
 */
 
 #include "Plane.h"
+#include <limits>
 
 Plane::Plane(){}
 
 Plane::Plane(const double a, const double b, const double c, const double d, const double sensor_x = -1,
              const double sensor_y = -1) : a_(a), b_(b), c_(c), d_(d), sensor_x_(sensor_x), sensor_y_(sensor_y),
-                                           planeParameters({a, b, c, d, sensor_x, sensor_y, 0, 0})
-{}
+                                           planeParameters({a, b, c, d, sensor_x, sensor_y, 0, 0, 0, 0, 0})
+{
+    float nx = (float) a_;
+    float ny = (float) b_;
+    float nz = (float) c_;
+
+    float len = std::sqrt(nx * nx + ny * ny + nz * nz);
+
+    if (len > 0.0f) {
+        nx /= len;
+        ny /= len;
+        nz /= len;
+    }
+
+    planeParameters.Ng_x = -1.0f*nx;
+    planeParameters.Ng_y = -1.0f*ny;
+    planeParameters.Ng_z = -1.0f*nz;
+}
 
 void Plane::planeBoundsFunc(const RTCBoundsFunctionArguments *args) {
     const auto* para = (const Plane_parameters*) args->geometryUserPtr;
-    RTCBounds* bounds = args->bounds_o;
+    *args->bounds_o = bounds(*para);
+}
 
+RTCBounds Plane::bounds(const Plane_parameters &para) {
+    RTCBounds bounds{};
 
-    bounds->lower_x = (float) -para->sensor_x/2;
-    bounds->lower_y = (float) -para->sensor_y/2;
-    bounds->lower_z = (float) -para->d-10;
+    bounds.lower_x = (float) -para.sensor_x/2;
+    bounds.lower_y = (float) -para.sensor_y/2;
+    bounds.lower_z = (float) -para.d-10;
 
-    bounds->upper_x = (float) para->sensor_x/2;
-    bounds->upper_y = (float) para->sensor_y/2;
-    bounds->upper_z = (float) -para->d;
+    bounds.upper_x = (float) para.sensor_x/2;
+    bounds.upper_y = (float) para.sensor_y/2;
+    bounds.upper_z = (float) -para.d;
+    return bounds;
 }
 
 void Plane::planeIntersectFunc(const RTCIntersectFunctionNArguments *args) {
-    auto* rayhit = (RTCRayHit*) args->rayhit;
-    RTCRay& ray = rayhit->ray;
     const auto* para  = (const Plane_parameters*) args->geometryUserPtr;
+    const unsigned int N = args->N;
+    RTCRayN* rays = RTCRayHitN_RayN(args->rayhit, N);
+    RTCHitN* hits = RTCRayHitN_HitN(args->rayhit, N);
 
     double a_ = para->a;
     double b_ = para->b;
     double c_ = para->c;
     double d_ = para->d;
 
-    double A = a_*ray.org_x + b_*ray.org_y + c_*ray.org_z + d_;
-    double B = a_*ray.dir_x + b_*ray.dir_y + c_*ray.dir_z;
-    // A + Bt = 0 -> Bt = -A -> t = -A/B
-    double t = -A/B;
-    if (t < ray.tnear || t > ray.tfar)
-        return;
-    ray.tfar = (float) t;
-
-    // Set hit information.
-    rayhit->hit.primID = para->geomID;
-    rayhit->hit.geomID = para->geomID;
-
-
-    float nx = (float) a_;
-    float ny = (float) b_;
-    float nz = (float) c_;
-
-    float len = std::sqrt(nx * nx + ny * ny + nz * nz);
-
-    if (len > 0.0f) {
-        nx /= len;
-        ny /= len;
-        nz /= len;
+    for (unsigned int i = 0; i < N; i++) {
+        if (args->valid[i] != -1) continue;
+
+        double A = a_*RTCRayN_org_x(rays, N, i) + b_*RTCRayN_org_y(rays, N, i) + c_*RTCRayN_org_z(rays, N, i) + d_;
+        double B = a_*RTCRayN_dir_x(rays, N, i) + b_*RTCRayN_dir_y(rays, N, i) + c_*RTCRayN_dir_z(rays, N, i);
+        // A + Bt = 0 -> Bt = -A -> t = -A/B
+        double t = -A/B;
+        if (t < RTCRayN_tnear(rays, N, i) || t > RTCRayN_tfar(rays, N, i))
+            continue;
+        RTCRayN_tfar(rays, N, i) = (float) t;
+
+        // Set hit information.
+        RTCHitN_primID(hits, N, i) = para->geomID;
+        RTCHitN_geomID(hits, N, i) = para->geomID;
+        RTCHitN_instID(hits, N, i, 0) = args->context->instID[0];
+
+        RTCHitN_Ng_x(hits, N, i) = para->Ng_x;
+        RTCHitN_Ng_y(hits, N, i) = para->Ng_y;
+        RTCHitN_Ng_z(hits, N, i) = para->Ng_z;
     }
-
-    rayhit->hit.Ng_x = -1.0*nx;
-    rayhit->hit.Ng_y = -1.0*ny;
-    rayhit->hit.Ng_z = -1.0*nz;
 }
 
-void Plane::planeOccludedFunc([[maybe_unused]] const RTCOccludedFunctionNArguments *args) {
-
+void Plane::planeOccludedFunc(const RTCOccludedFunctionNArguments *args) {
+    const auto* para  = (const Plane_parameters*) args->geometryUserPtr;
+    const unsigned int N = args->N;
+    RTCRayN* rays = args->ray;
+
+    for (unsigned int i = 0; i < N; i++) {
+        if (args->valid[i] != -1) continue;
+
+        // Same test as planeIntersectFunc, a blocked ray gets tfar = -inf
+        double A = para->a*RTCRayN_org_x(rays, N, i) + para->b*RTCRayN_org_y(rays, N, i) + para->c*RTCRayN_org_z(rays, N, i) + para->d;
+        double B = para->a*RTCRayN_dir_x(rays, N, i) + para->b*RTCRayN_dir_y(rays, N, i) + para->c*RTCRayN_dir_z(rays, N, i);
+        double t = -A/B;
+        if (t < RTCRayN_tnear(rays, N, i) || t > RTCRayN_tfar(rays, N, i))
+            continue;
+        RTCRayN_tfar(rays, N, i) = -std::numeric_limits<float>::infinity();
+    }
 }
 
 
@@ -84,20 +112,9 @@ double Plane::planeIntersect(Ray &rayhit) const {
     double B = a_*ray.dir_x + b_*ray.dir_y + c_*ray.dir_z;
     // A + Bt = 0 -> Bt = -A -> t = -A/B
     double t = -A/B;
-    float nx = (float) a_;
-    float ny = (float) b_;
-    float nz = (float) c_;
-
-    float len = std::sqrt(nx * nx + ny * ny + nz * nz);
-
-    if (len > 0.0f) {
-        nx /= len;
-        ny /= len;
-        nz /= len;
-    }
 
-    rayhit.rayhit.hit.Ng_x = -1.0*nx;
-    rayhit.rayhit.hit.Ng_y = -1.0*ny;
-    rayhit.rayhit.hit.Ng_z = -1.0*nz;
+    rayhit.rayhit.hit.Ng_x = planeParameters.Ng_x;
+    rayhit.rayhit.hit.Ng_y = planeParameters.Ng_y;
+    rayhit.rayhit.hit.Ng_z = planeParameters.Ng_z;
     return t;
 }
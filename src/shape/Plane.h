@@ -13,6 +13,8 @@ struct Plane_parameters {
     double a, b, c, d, sensor_x, sensor_y;
     RTCGeometry geometry;
     unsigned int geomID;
+    // geometric normal reported on a hit, -normalize(a, b, c), set up by the Plane constructor
+    float Ng_x, Ng_y, Ng_z;
 };
 
 
@@ -28,6 +30,11 @@ public:
 
     static void planeBoundsFunc(const RTCBoundsFunctionArguments *args);
 
+    /**
+     * @brief The box planeBoundsFunc reports: the sensor area and 10 mm below it.
+     */
+    static RTCBounds bounds(const Plane_parameters &para);
+
     static void planeIntersectFunc(const RTCIntersectFunctionNArguments *args);
 
     static void planeOccludedFunc(const RTCOccludedFunctionNArguments *args);
@@ -9,7 +9,7 @@ Pore::Pore() {
 
 }
 
-Pore::Pore(double pwidth, double plength, Vec3fa protation, Vec3fa ptranslation,  [[maybe_unused]] std::string material_path, [[maybe_unused]] std::string material) {
+Pore::Pore(double pwidth, double plength, Vec3fa protation, Vec3fa ptranslation) {
     width = pwidth;
     length = plength;
     rotation = protation;
@@ -38,7 +38,11 @@ void Pore::set_length(double plength) {
     length = plength;
 }
 
-int Pore::findInterection(Ray &ray) {
+void Pore::set_weighting(const Weighting &pore_weighting) {
+    weighting = pore_weighting;
+}
+
+int Pore::findInterection(Ray &ray) const {
     double t = std::numeric_limits<double>::infinity();
     int wall_number = -1;
     Vec3fa dir = ray.direction();
@@ -106,7 +110,7 @@ double Pore::generateRandomDouble(double m, double n) {
     return m + (n-m) * uniform_number;
 }
 
-bool Pore::ray_trace(Ray &ray, int depth) {
+bool Pore::ray_trace(Ray &ray, int depth, const CoatingContext &coating) const {
     // float theta = get_angle(ray.normal(), {0, 0, 1});
     Vec3fa hit = ray.position();
     Vec3fa normal_exact = normalize(hit);
@@ -120,20 +124,21 @@ bool Pore::ray_trace(Ray &ray, int depth) {
     ray.set_direction(normalize(transformed_incoming));
 
     Vec3fa old_position = ray.position();
-    double x = generateRandomDouble(width, 0);
-    double y = generateRandomDouble(width, 0);
+    const auto [u, v] = random_stream().uniform2();
+    double x = width * (1 - u);
+    double y = width * (1 - v);
     ray.set_position(Vec3fa(x, y, length));
 
-    depth = 10;
+    depth = max_depth;
     while (depth > 0) {
         int wall_number = findInterection(ray);
 
         if (wall_number == -1) {
             return false;
         }
-        ray.raytracing_history.emplace_back((short) wall_number+10,
-                                            ray.position(),
-                                            ray.direction());
+        ray.raytracing_history.record((short) wall_number+10,
+                                      ray.position(),
+                                      ray.direction());
 
         if (wall_number == 5) {
             old_position = old_position - normal_exact * length;
@@ -156,14 +161,17 @@ bool Pore::ray_trace(Ray &ray, int depth) {
             return false;
 
         //TODO: surface roughness here before reflection.
-        reflect_ray(ray);
+        if (!reflect_ray(ray, coating))
+            return false;
 
         depth--;
     }
     return false;
 }
 
-bool Pore::reflect_ray(Ray &ray) {
+bool Pore::reflect_ray(Ray &ray, const CoatingContext &coating) const {
+    if (!coating.apply(ray, weighting))
+        return false;
     ray.set_position(ray.position() + ray.rayhit.ray.tfar * ray.direction());
     ray.set_direction(reflect(ray.direction(), ray.normal()));
     ray.rayhit.ray.tnear = 0.0001;
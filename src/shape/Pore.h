@@ -10,13 +10,15 @@ Copyright (C) 2025  Neo Reinmann (neoreinmann@gmail.com)
 #include "Plane.h"
 #include "lib/random.h"
 #include "surface/SurfaceStrategy.h"
+#include "surface/Reflectivity.h"
+#include "surface/Weighting.h"
 
 
 class Pore {
 public:
     Pore();
 
-    Pore(double pwidth, double plength, Vec3fa protation, Vec3fa ptranslation, std::string material_path, std::string material);
+    Pore(double pwidth, double plength, Vec3fa protation, Vec3fa ptranslation);
 
     void set_rotation(Vec3fa protation);
 
@@ -26,20 +28,30 @@ public:
 
     void set_length(double length);
 
-    bool ray_trace(Ray &ray, int depth);
+    // Analog or weighted wall losses
+    void set_weighting(const Weighting &pore_weighting);
+
+    // Wall reflections inside one pore
+    static constexpr int max_depth = 10;
+
+    // Passage through one pore, coating are the walls of the calling trace context
+    bool ray_trace(Ray &ray, int depth, const CoatingContext &coating) const;
 
     double generateRandomDouble(double m, double n);
 
+    // Nearest wall (1-4, 5 the exit) the ray in pore coordinates hits beyond tnear, -1 if none; sets tfar and the normal
+    int findInterection(Ray &ray) const;
+
 
 private:
     double width, length;
     Vec3fa rotation{};
     Vec3fa translation{};
     Plane wall1, wall2, wall3, wall4, floor;
+    Weighting weighting{};
 
 
-    int findInterection(Ray &ray);
-    bool reflect_ray(Ray &ray);
+    bool reflect_ray(Ray &ray, const CoatingContext &coating) const;
 };
 
 
@@ -0,0 +1,138 @@
+/*
+Copyright (C) 2025  Neo Reinmann (neoreinmann@gmail.com)
+*/
+
+#ifndef SIXTE_RAYLANES_H
+#define SIXTE_RAYLANES_H
+#if defined(RTC_NAMESPACE_USE)
+RTC_NAMESPACE_USE
+#endif
+
+#include <embree4/rtcore.h>
+#include <limits>
+
+/**
+ * @brief W rays of an intersect or occluded query in SoA layout, the input of the N-wide quadric kernels.
+ * Lanes with valid[l] == 0 hold whatever Embree passed in and must not produce a hit.
+ */
+template<unsigned W>
+struct RayLanes {
+    alignas(64) float org_x[W];
+    alignas(64) float org_y[W];
+    alignas(64) float org_z[W];
+    alignas(64) float dir_x[W];
+    alignas(64) float dir_y[W];
+    alignas(64) float dir_z[W];
+    alignas(64) float tnear[W];
+    alignas(64) float tfar[W];
+    alignas(64) int valid[W];
+
+    void gather(const RTCIntersectFunctionNArguments *args, unsigned int first) {
+        gather(RTCRayHitN_RayN(args->rayhit, args->N), args->N, args->valid, first);
+    }
+
+    void gather(const RTCOccludedFunctionNArguments *args, unsigned int first) {
+        gather(args->ray, args->N, args->valid, first);
+    }
+
+    void gather(RTCRayN *rays, unsigned int N, const int *valid_in, unsigned int first) {
+        for (unsigned int l = 0; l < W; l++) {
+            const unsigned int i = first + l;
+            org_x[l] = RTCRayN_org_x(rays, N, i);
+            org_y[l] = RTCRayN_org_y(rays, N, i);
+            org_z[l] = RTCRayN_org_z(rays, N, i);
+            dir_x[l] = RTCRayN_dir_x(rays, N, i);
+            dir_y[l] = RTCRayN_dir_y(rays, N, i);
+            dir_z[l] = RTCRayN_dir_z(rays, N, i);
+            tnear[l] = RTCRayN_tnear(rays, N, i);
+            tfar[l] = RTCRayN_tfar(rays, N, i);
+            valid[l] = valid_in[i] == -1;
+        }
+    }
+};
+
+/**
+ * @brief Result of an N-wide quadric kernel, Ng is the world space geometric normal.
+ */
+template<unsigned W>
+struct HitLanes {
+    alignas(64) float t[W];
+    alignas(64) float Ng_x[W];
+    alignas(64) float Ng_y[W];
+    alignas(64) float Ng_z[W];
+    alignas(64) int hit[W];
+
+    void scatter(const RTCIntersectFunctionNArguments *args, unsigned int first, unsigned int geomID) const {
+        const unsigned int N = args->N;
+        RTCRayN *rays = RTCRayHitN_RayN(args->rayhit, N);
+        RTCHitN *hits = RTCRayHitN_HitN(args->rayhit, N);
+        for (unsigned int l = 0; l < W; l++) {
+            if (!hit[l]) continue;
+            const unsigned int i = first + l;
+            RTCRayN_tfar(rays, N, i) = t[l];
+            RTCHitN_primID(hits, N, i) = geomID;
+            RTCHitN_geomID(hits, N, i) = geomID;
+            RTCHitN_instID(hits, N, i, 0) = args->context->instID[0];
+            RTCHitN_Ng_x(hits, N, i) = Ng_x[l];
+            RTCHitN_Ng_y(hits, N, i) = Ng_y[l];
+            RTCHitN_Ng_z(hits, N, i) = Ng_z[l];
+        }
+    }
+
+    /**
+     * @brief Any-hit result: marks the hit lanes of an occluded query as blocked (tfar = -inf).
+     */
+    void occlude(const RTCOccludedFunctionNArguments *args, unsigned int first) const {
+        for (unsigned int l = 0; l < W; l++)
+            if (hit[l])
+                RTCRayN_tfar(args->ray, args->N, first + l) = -std::numeric_limits<float>::infinity();
+    }
+};
+
+template<unsigned W, typename Kernel>
+inline void run_lanes(const RTCIntersectFunctionNArguments *args, unsigned int first, unsigned int geomID,
+                      Kernel &kernel) {
+    RayLanes<W> rays;
+    HitLanes<W> hits;
+    rays.gather(args, first);
+    kernel(rays, hits);
+    hits.scatter(args, first, geomID);
+}
+
+template<unsigned W, typename Kernel>
+inline void run_lanes(const RTCOccludedFunctionNArguments *args, unsigned int first,
+                      [[maybe_unused]] unsigned int geomID, Kernel &kernel) {
+    RayLanes<W> rays;
+    HitLanes<W> hits;
+    rays.gather(args, first);
+    kernel(rays, hits);
+    hits.occlude(args, first);
+}
+
+/**
+ * @brief Runs kernel(RayLanes<W>&, HitLanes<W>&) over the N rays of an intersect query and commits the
+ * hits, or of an occluded query and marks the blocked rays. Packets of 4, 8 and 16 rays are processed
+ * in one go, anything else lane by lane.
+ */
+template<typename Arguments, typename Kernel>
+inline void dispatch_lanes(const Arguments *args, unsigned int geomID, Kernel &&kernel) {
+    switch (args->N) {
+        case 16:
+            run_lanes<16>(args, 0, geomID, kernel);
+            break;
+        case 8:
+            run_lanes<8>(args, 0, geomID, kernel);
+            break;
+        case 4:
+            run_lanes<4>(args, 0, geomID, kernel);
+            break;
+        default:
+            for (unsigned int i = 0; i < args->N; i++)
+                if (args->valid[i] == -1)
+                    run_lanes<1>(args, i, geomID, kernel);
+            break;
+    }
+}
+
+
+#endif //SIXTE_RAYLANES_H
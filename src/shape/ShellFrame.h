@@ -0,0 +1,93 @@
+/*
+Copyright (C) 2025  Neo Reinmann (neoreinmann@gmail.com)
+*/
+
+#ifndef SIXTE_SHELLFRAME_H
+#define SIXTE_SHELLFRAME_H
+
+#include "geometry/Vec3fa.h"
+#include <algorithm>
+#include <limits>
+
+/**
+ * @brief Tilted local frame of a mirror shell, precomputed from angle_x/angle_y and the origin.
+ *
+ * The axes are the ones the shells always used: z_tilted = R(angle_x, angle_y) * z,
+ * x_tilted = normalize(z_tilted × y), y_tilted = z_tilted × x_tilted.
+ */
+struct ShellFrame {
+    float to_local[3][3];   // rows: x/y/z_tilted, world -> local (inverse basis)
+    float to_world[3][3];   // rows: world x/y/z in local components, local -> world (basis)
+    float origin[3];
+    bool untilted;          // no tilt: the local frame is the world frame turned by 180° around z
+
+    static ShellFrame make(double angle_x, double angle_y, const Vec3fa &origin) {
+        auto R = get_rotation_matrix(angle_x, angle_y); // columns
+        Vec3fa z_tilted = R * Vec3fa{0,0,1};
+        Vec3fa x_tilted = normalize(cross(z_tilted, Vec3fa{0,1,0}));
+        Vec3fa y_tilted = cross(z_tilted, x_tilted);
+        const Vec3fa axes[3] = {x_tilted, y_tilted, z_tilted};
+
+        ShellFrame frame{};
+        for (int i = 0; i < 3; i++) {
+            for (int j = 0; j < 3; j++) {
+                frame.to_local[i][j] = axes[i][j];
+                frame.to_world[j][i] = axes[i][j];
+            }
+        }
+        frame.origin[0] = origin.x;
+        frame.origin[1] = origin.y;
+        frame.origin[2] = origin.z;
+        frame.untilted = x_tilted.x == -1.f && x_tilted.y == 0.f && x_tilted.z == 0.f
+                         && y_tilted.x == 0.f && y_tilted.y == -1.f && y_tilted.z == 0.f
+                         && z_tilted.x == 0.f && z_tilted.y == 0.f && z_tilted.z == 1.f;
+        return frame;
+    }
+
+    /**
+     * @brief World space box around the local box [lower, upper], i.e. around its 8 corners put into place.
+     */
+    void bounds_to_world(const float lower[3], const float upper[3], float world_lower[3], float world_upper[3]) const {
+        for (int i = 0; i < 3; i++) {
+            world_lower[i] = std::numeric_limits<float>::infinity();
+            world_upper[i] = -std::numeric_limits<float>::infinity();
+        }
+        for (int corner = 0; corner < 8; corner++) {
+            float w[3];
+            rotate_to_world<false>(corner & 1 ? upper[0] : lower[0], corner & 2 ? upper[1] : lower[1],
+                                   corner & 4 ? upper[2] : lower[2], w[0], w[1], w[2]);
+            for (int i = 0; i < 3; i++) {
+                world_lower[i] = std::min(world_lower[i], w[i] + origin[i]);
+                world_upper[i] = std::max(world_upper[i], w[i] + origin[i]);
+            }
+        }
+    }
+
+    /**
+     * @brief Rotates (x, y, z) into the local frame, Untilted skips the matrix product.
+     */
+    template<bool Untilted>
+    void rotate_to_local(float x, float y, float z, float &lx, float &ly, float &lz) const {
+        if constexpr (Untilted) {
+            lx = -x; ly = -y; lz = z;
+        } else {
+            lx = x * to_local[0][0] + y * to_local[0][1] + z * to_local[0][2];
+            ly = x * to_local[1][0] + y * to_local[1][1] + z * to_local[1][2];
+            lz = x * to_local[2][0] + y * to_local[2][1] + z * to_local[2][2];
+        }
+    }
+
+    template<bool Untilted>
+    void rotate_to_world(float x, float y, float z, float &wx, float &wy, float &wz) const {
+        if constexpr (Untilted) {
+            wx = -x; wy = -y; wz = z;
+        } else {
+            wx = to_world[0][0] * x + to_world[0][1] * y + to_world[0][2] * z;
+            wy = to_world[1][0] * x + to_world[1][1] * y + to_world[1][2] * z;
+            wz = to_world[2][0] * x + to_world[2][1] * y + to_world[2][2] * z;
+        }
+    }
+};
+
+
+#endif //SIXTE_SHELLFRAME_H
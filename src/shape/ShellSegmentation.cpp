@@ -0,0 +1,81 @@
+/*
+Copyright (C) 2025  Neo Reinmann (neoreinmann@gmail.com)
+*/
+
+#include "ShellSegmentation.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+ShellSegmentation::ShellSegmentation(unsigned int sectors, unsigned int bands) : sectors_(sectors), bands_(bands) {
+    if (sectors == 0 || sectors == 2)
+        throw std::runtime_error("ShellSegmentation: sectors must be 1 or at least 3");
+    if (bands == 0)
+        throw std::runtime_error("ShellSegmentation: bands must be at least 1");
+
+    for (unsigned int k = 0; k < sectors; k++) {
+        const double phi = 2 * M_PI * k / sectors;
+        edge_x_.push_back((float) std::cos(phi));
+        edge_y_.push_back((float) std::sin(phi));
+    }
+    // Close the turn with the very same floats, the last sector ends where the first starts
+    edge_x_.push_back(edge_x_.front());
+    edge_y_.push_back(edge_y_.front());
+}
+
+double ShellSegmentation::band_edge(unsigned int band, double z_min, double z_max) const {
+    return z_min + (z_max - z_min) * band / bands_;
+}
+
+ShellSegment ShellSegmentation::segment(unsigned int primID, double z_min, double z_max) const {
+    constexpr double inf = std::numeric_limits<double>::infinity();
+    const unsigned int sector = primID % sectors_;
+    const unsigned int band = primID / sectors_;
+
+    ShellSegment segment{};
+    segment.edge_lo_x = edge_x_[sector];
+    segment.edge_lo_y = edge_y_[sector];
+    segment.edge_hi_x = edge_x_[sector + 1];
+    segment.edge_hi_y = edge_y_[sector + 1];
+    segment.z_lo = band == 0 ? -inf : band_edge(band, z_min, z_max);
+    segment.z_hi = band + 1 == bands_ ? inf : band_edge(band + 1, z_min, z_max);
+    segment.whole_turn = sectors_ == 1;
+    return segment;
+}
+
+void ShellSegmentation::band_range(unsigned int primID, double z_min, double z_max, double &z_lo, double &z_hi) const {
+    const unsigned int band = primID / sectors_;
+    z_lo = band_edge(band, z_min, z_max);
+    z_hi = band + 1 == bands_ ? z_max : band_edge(band + 1, z_min, z_max);
+}
+
+void ShellSegmentation::sector_box(unsigned int primID, double r_lo, double r_hi, float lower[2], float upper[2]) const {
+    const unsigned int sector = primID % sectors_;
+    const double phi_lo = 2 * M_PI * sector / sectors_;
+    const double phi_hi = 2 * M_PI * (sector + 1) / sectors_;
+
+    double x_lo = std::numeric_limits<double>::infinity(), x_hi = -x_lo;
+    double y_lo = x_lo, y_hi = -x_lo;
+    auto include = [&](double r, double phi) {
+        x_lo = std::min(x_lo, r * std::cos(phi));
+        x_hi = std::max(x_hi, r * std::cos(phi));
+        y_lo = std::min(y_lo, r * std::sin(phi));
+        y_hi = std::max(y_hi, r * std::sin(phi));
+    };
+
+    // Corners of the sector, then the outer arc wherever it crosses an axis
+    for (double r : {r_lo, r_hi})
+        for (double phi : {phi_lo, phi_hi})
+            include(r, phi);
+    for (int quarter = 0; quarter <= 4; quarter++) {
+        const double phi = quarter * M_PI / 2;
+        if (phi > phi_lo && phi < phi_hi)
+            include(r_hi, phi);
+    }
+
+    lower[0] = (float) x_lo;
+    lower[1] = (float) y_lo;
+    upper[0] = (float) x_hi;
+    upper[1] = (float) y_hi;
+}
@@ -0,0 +1,81 @@
+/*
+Copyright (C) 2025  Neo Reinmann (neoreinmann@gmail.com)
+*/
+
+#ifndef SIXTE_SHELLSEGMENTATION_H
+#define SIXTE_SHELLSEGMENTATION_H
+
+#include <limits>
+#include <vector>
+
+/**
+ * @brief The piece of a shell one Embree primitive stands for, in the shell's local frame:
+ * the angular sector between edge_lo and edge_hi and the axial band z_lo <= z < z_hi.
+ */
+struct ShellSegment {
+    float edge_lo_x, edge_lo_y;     // direction of the sector's first edge
+    float edge_hi_x, edge_hi_y;     // direction of the next sector's first edge
+    double z_lo, z_hi;
+    int whole_turn;                 // only one sector, no angular test
+
+    /**
+     * @brief The complete shell, for queries outside of Embree.
+     */
+    static ShellSegment whole() {
+        constexpr double inf = std::numeric_limits<double>::infinity();
+        return {1.f, 0.f, 1.f, 0.f, -inf, inf, 1};
+    }
+
+    /**
+     * @brief Whether the local point belongs to this segment, branch-free for the lane kernels.
+     * Neighbouring segments evaluate the same expression for their common edge, so every point
+     * belongs to exactly one of them.
+     */
+    [[nodiscard]] int contains(float x, float y, double z) const {
+        const float side_lo = edge_lo_x * y - edge_lo_y * x;
+        const float side_hi = edge_hi_x * y - edge_hi_y * x;
+        return (whole_turn | ((side_lo >= 0.f) & (side_hi < 0.f))) & (z >= z_lo) & (z < z_hi);
+    }
+};
+
+/**
+ * @brief How every shell is cut into Embree primitives: sectors around the shell axis times bands
+ * along it, primitive id = band * sectors + sector. Each primitive gets a box around its own piece
+ * instead of the full disk, so the BVH can skip shells far from a ray.
+ */
+class ShellSegmentation {
+public:
+    /**
+     * @brief sectors must be 1 or at least 3 (a sector has to be narrower than half a turn), bands at least 1.
+     */
+    explicit ShellSegmentation(unsigned int sectors = 1, unsigned int bands = 1);
+
+    [[nodiscard]] unsigned int sectors() const { return sectors_; }
+    [[nodiscard]] unsigned int bands() const { return bands_; }
+    [[nodiscard]] unsigned int primitives() const { return sectors_ * bands_; }
+
+    /**
+     * @brief Segment of primitive primID on a shell spanning [z_min, z_max] in its local frame.
+     * The outer bands are open ended, the shell's own z range check clips them.
+     */
+    [[nodiscard]] ShellSegment segment(unsigned int primID, double z_min, double z_max) const;
+
+    /**
+     * @brief Axial range [z_lo, z_hi] of primitive primID's band.
+     */
+    void band_range(unsigned int primID, double z_min, double z_max, double &z_lo, double &z_hi) const;
+
+    /**
+     * @brief Local x/y box of primitive primID's sector of the annulus r_lo <= r <= r_hi.
+     */
+    void sector_box(unsigned int primID, double r_lo, double r_hi, float lower[2], float upper[2]) const;
+
+private:
+    [[nodiscard]] double band_edge(unsigned int band, double z_min, double z_max) const;
+
+    unsigned int sectors_, bands_;
+    std::vector<float> edge_x_, edge_y_;    // sectors_ + 1 edges, the last one is the first again
+};
+
+
+#endif //SIXTE_SHELLSEGMENTATION_H
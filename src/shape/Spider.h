@@ -7,6 +7,7 @@ Copyright (C) 2025  Neo Reinmann (neoreinmann@gmail.com)
 
 #include "geometry/Vec3fa.h"
 #include <string>
+#include <embree4/rtcore.h>
 
 class Spider {
 public:
@@ -15,6 +16,8 @@ public:
     std::string filename;
     Vec3fa position;
     unsigned int geomID = -1;
+    // Build quality of the mesh's BVH, <... bvh_quality>
+    RTCBuildQuality build_quality = RTC_BUILD_QUALITY_HIGH;
 
 
 };
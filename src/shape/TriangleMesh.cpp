@@ -0,0 +1,242 @@
+/*
+Copyright (C) 2025  Neo Reinmann (neoreinmann@gmail.com)
+*/
+
+#include "TriangleMesh.h"
+#include "lib/random.h"
+#include "lib/stl_reader.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define SIXTE_MESH_CACHE_MMAP 1
+#endif
+
+namespace {
+    // Bump when the layout of a cache file changes, old files then miss
+    constexpr char cache_magic[8] = {'S', 'X', 'M', 'E', 'S', 'H', '0', '1'};
+
+    // Start of a cache file, the buffers follow at 16 byte aligned offsets
+    struct CacheHeader {
+        char magic[8];
+        std::uint64_t key;
+        std::uint64_t vertex_count;
+        std::uint64_t triangle_count;
+        std::uint64_t vertex_offset;    // (3 * vertex_count + 1) floats
+        std::uint64_t index_offset;     // 3 * triangle_count uint32
+        std::uint64_t file_size;
+    };
+
+    std::uint64_t align16(std::uint64_t offset) {
+        return (offset + 15) & ~std::uint64_t{15};
+    }
+
+    CacheHeader layout(std::uint64_t key, std::size_t vertex_count, std::size_t triangle_count) {
+        CacheHeader header{};
+        std::memcpy(header.magic, cache_magic, sizeof(cache_magic));
+        header.key = key;
+        header.vertex_count = vertex_count;
+        header.triangle_count = triangle_count;
+        header.vertex_offset = align16(sizeof(CacheHeader));
+        header.index_offset = align16(header.vertex_offset + (3 * vertex_count + 1) * sizeof(float));
+        header.file_size = header.index_offset + 3 * triangle_count * sizeof(std::uint32_t);
+        return header;
+    }
+
+    // Same magic, key and layout as a file written for these counts, and not truncated
+    bool valid(const CacheHeader &header, std::uint64_t key, std::uint64_t file_size) {
+        const CacheHeader expected = layout(key, header.vertex_count, header.triangle_count);
+        return std::memcmp(&header, &expected, sizeof(header)) == 0 && expected.file_size == file_size;
+    }
+
+    // Hash of the file contents and the position, the name of the cache file
+    std::uint64_t cache_key(const std::string &path, const Vec3fa &position) {
+        std::ifstream file(path, std::ios::binary);
+        if (!file)
+            throw std::runtime_error("TriangleMesh: cannot open " + path);
+        std::uint64_t hash = mix_seed(0x5354u);
+        std::vector<char> buffer(1 << 20);
+        std::uint64_t size = 0;
+        while (file) {
+            file.read(buffer.data(), (std::streamsize) buffer.size());
+            const auto n = (std::size_t) file.gcount();
+            std::size_t i = 0;
+            for (; i + 8 <= n; i += 8) {
+                std::uint64_t word;
+                std::memcpy(&word, buffer.data() + i, 8);
+                hash = mix_seed(hash ^ word);
+            }
+            for (; i < n; i++)
+                hash = mix_seed(hash ^ (unsigned char) buffer[i]);
+            size += n;
+        }
+        std::uint32_t bits[3];
+        std::memcpy(&bits[0], &position.x, 4);
+        std::memcpy(&bits[1], &position.y, 4);
+        std::memcpy(&bits[2], &position.z, 4);
+        hash = mix_seed(hash ^ size);
+        hash = mix_seed(hash ^ (((std::uint64_t) bits[0] << 32) | bits[1]));
+        return mix_seed(hash ^ bits[2]);
+    }
+}
+
+TriangleMesh::~TriangleMesh() {
+#ifdef SIXTE_MESH_CACHE_MMAP
+    if (mapping_ != nullptr)
+        munmap(mapping_, mapping_size_);
+#endif
+}
+
+std::shared_ptr<const TriangleMesh> TriangleMesh::load(const std::string &path, const Vec3fa &position,
+                                                       const std::string &cache_dir) {
+    if (cache_dir.empty())
+        return parse(path, position);
+
+    const std::uint64_t key = cache_key(path, position);
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.mesh", (unsigned long long) key);
+    const std::string cache_file = (std::filesystem::path(cache_dir) / name).string();
+    if (auto mesh = map(cache_file, key))
+        return mesh;
+
+    auto mesh = parse(path, position);
+    mesh->write(cache_file, key);
+    return mesh;
+}
+
+std::string TriangleMesh::cache_dir_from_xml(const XMLData &xml_data) {
+    const auto details = xml_data.child("telescope").child("raytracer").child("simulation_details");
+    if (details.hasAttribute("mesh_cache")) {
+        const std::string dir = details.attributeAsString("mesh_cache");
+        return dir == "off" ? std::string() : dir;
+    }
+    if (const char *xdg = std::getenv("XDG_CACHE_HOME"); xdg != nullptr && *xdg != '\0')
+        return (std::filesystem::path(xdg) / "sixte_raytracing" / "meshes").string();
+    if (const char *home = std::getenv("HOME"); home != nullptr && *home != '\0')
+        return (std::filesystem::path(home) / ".cache" / "sixte_raytracing" / "meshes").string();
+    return {};
+}
+
+RTCGeometry TriangleMesh::create_geometry(RTCDevice device, RTCBuildQuality quality) const {
+    RTCGeometry geometry = rtcNewGeometry(device, RTC_GEOMETRY_TYPE_TRIANGLE);
+    rtcSetGeometryBuildQuality(geometry, quality);
+    rtcSetSharedGeometryBuffer(geometry, RTC_BUFFER_TYPE_INDEX, 0, RTC_FORMAT_UINT3, indices_, 0,
+                               3 * sizeof(std::uint32_t), triangle_count_);
+    rtcSetSharedGeometryBuffer(geometry, RTC_BUFFER_TYPE_VERTEX, 0, RTC_FORMAT_FLOAT3, vertices_, 0,
+                               3 * sizeof(float), vertex_count_);
+    rtcCommitGeometry(geometry);
+    return geometry;
+}
+
+std::shared_ptr<TriangleMesh> TriangleMesh::parse(const std::string &path, const Vec3fa &position) {
+    // stl_reader merges the corners that several triangles share
+    stl_reader::StlMesh<float, unsigned int> stl(path);
+    std::shared_ptr<TriangleMesh> mesh(new TriangleMesh());
+    mesh->vertex_count_ = stl.num_vrts();
+    mesh->triangle_count_ = stl.num_tris();
+    mesh->vertex_storage_.assign(3 * mesh->vertex_count_ + 1, 0.f);
+    const float offset[3] = {position.x, position.y, position.z};
+    const float *coords = stl.raw_coords();
+    for (std::size_t i = 0; i < 3 * mesh->vertex_count_; i++)
+        mesh->vertex_storage_[i] = coords[i] + offset[i % 3];
+    mesh->index_storage_.assign(stl.raw_tris(), stl.raw_tris() + 3 * mesh->triangle_count_);
+    mesh->vertices_ = mesh->vertex_storage_.data();
+    mesh->indices_ = mesh->index_storage_.data();
+    return mesh;
+}
+
+std::shared_ptr<TriangleMesh> TriangleMesh::map(const std::string &cache_file, std::uint64_t key) {
+#ifdef SIXTE_MESH_CACHE_MMAP
+    const int fd = open(cache_file.c_str(), O_RDONLY);
+    if (fd < 0)
+        return nullptr;
+    struct stat status{};
+    void *mapping = MAP_FAILED;
+    if (fstat(fd, &status) == 0 && (std::size_t) status.st_size >= sizeof(CacheHeader))
+        mapping = mmap(nullptr, (std::size_t) status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+        return nullptr;
+    CacheHeader header{};
+    std::memcpy(&header, mapping, sizeof(header));
+    if (!valid(header, key, (std::uint64_t) status.st_size)) {
+        munmap(mapping, (std::size_t) status.st_size);
+        return nullptr;
+    }
+    std::shared_ptr<TriangleMesh> mesh(new TriangleMesh());
+    mesh->mapping_ = mapping;
+    mesh->mapping_size_ = (std::size_t) status.st_size;
+    mesh->vertex_count_ = header.vertex_count;
+    mesh->triangle_count_ = header.triangle_count;
+    mesh->vertices_ = reinterpret_cast<const float *>(static_cast<const char *>(mapping) + header.vertex_offset);
+    mesh->indices_ = reinterpret_cast<const std::uint32_t *>(static_cast<const char *>(mapping) + header.index_offset);
+    return mesh;
+#else
+    // Without mmap the buffers are read into memory
+    std::ifstream file(cache_file, std::ios::binary | std::ios::ate);
+    if (!file)
+        return nullptr;
+    const auto file_size = (std::uint64_t) file.tellg();
+    CacheHeader header{};
+    file.seekg(0);
+    if (file_size < sizeof(header) || !file.read(reinterpret_cast<char *>(&header), sizeof(header))
+        || !valid(header, key, file_size))
+        return nullptr;
+    std::shared_ptr<TriangleMesh> mesh(new TriangleMesh());
+    mesh->vertex_count_ = header.vertex_count;
+    mesh->triangle_count_ = header.triangle_count;
+    mesh->vertex_storage_.resize(3 * header.vertex_count + 1);
+    mesh->index_storage_.resize(3 * header.triangle_count);
+    file.seekg((std::streamoff) header.vertex_offset);
+    file.read(reinterpret_cast<char *>(mesh->vertex_storage_.data()),
+              (std::streamsize) (mesh->vertex_storage_.size() * sizeof(float)));
+    file.seekg((std::streamoff) header.index_offset);
+    file.read(reinterpret_cast<char *>(mesh->index_storage_.data()),
+              (std::streamsize) (mesh->index_storage_.size() * sizeof(std::uint32_t)));
+    if (!file)
+        return nullptr;
+    mesh->vertices_ = mesh->vertex_storage_.data();
+    mesh->indices_ = mesh->index_storage_.data();
+    return mesh;
+#endif
+}
+
+void TriangleMesh::write(const std::string &cache_file, std::uint64_t key) const {
+    const CacheHeader header = layout(key, vertex_count_, triangle_count_);
+    // Written under a unique name and renamed, concurrent runs never see a partial file
+    std::random_device rd;
+    const std::string temporary = cache_file + ".tmp" + std::to_string(rd());
+    std::error_code error;
+    std::filesystem::create_directories(std::filesystem::path(cache_file).parent_path(), error);
+    {
+        std::ofstream file(temporary, std::ios::binary);
+        const std::vector<char> padding(16, 0);
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        file.write(padding.data(), (std::streamsize) (header.vertex_offset - sizeof(header)));
+        file.write(reinterpret_cast<const char *>(vertices_), (std::streamsize) ((3 * vertex_count_ + 1) * sizeof(float)));
+        const std::uint64_t vertex_end = header.vertex_offset + (3 * vertex_count_ + 1) * sizeof(float);
+        file.write(padding.data(), (std::streamsize) (header.index_offset - vertex_end));
+        file.write(reinterpret_cast<const char *>(indices_), (std::streamsize) (3 * triangle_count_ * sizeof(std::uint32_t)));
+        if (!file) {
+            std::cerr << "mesh cache: cannot write " << temporary << ", the mesh is parsed again next time\n";
+            file.close();
+            std::filesystem::remove(temporary, error);
+            return;
+        }
+    }
+    std::filesystem::rename(temporary, cache_file, error);
+    if (error) {
+        std::cerr << "mesh cache: cannot write " << cache_file << ": " << error.message() << "\n";
+        std::filesystem::remove(temporary, error);
+    }
+}
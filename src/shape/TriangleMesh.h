@@ -0,0 +1,77 @@
+/*
+Copyright (C) 2025  Neo Reinmann (neoreinmann@gmail.com)
+*/
+
+#ifndef SIXTE_TRIANGLEMESH_H
+#define SIXTE_TRIANGLEMESH_H
+
+#include "geometry/Vec3fa.h"
+#include "lib/XMLData.h"
+#include <embree4/rtcore.h>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Indexed triangles of an STL file moved to their position in the scene, duplicate vertices merged.
+ *
+ * Meshes are loaded through an on-disk cache keyed by a hash of the file contents and the position. The first
+ * load parses the STL and writes the buffers as one binary file, later loads map that file and hand its buffers
+ * to Embree without copying them (rtcSetSharedGeometryBuffer), so a start only reads the file. A mesh has to
+ * outlive the geometries made from it.
+ */
+class TriangleMesh {
+public:
+    TriangleMesh(const TriangleMesh &) = delete;
+    TriangleMesh &operator=(const TriangleMesh &) = delete;
+    ~TriangleMesh();
+
+    /**
+     * @param cache_dir Directory of the cache files, created if missing. Empty parses the STL every time.
+     * A cache that can not be read or written is skipped with a note on stderr.
+     */
+    static std::shared_ptr<const TriangleMesh> load(const std::string &path, const Vec3fa &position,
+                                                    const std::string &cache_dir);
+
+    /**
+     * @brief Cache directory of <simulation_details mesh_cache="...">: a path, "off" for none, or by default
+     * $XDG_CACHE_HOME/sixte_raytracing/meshes, else ~/.cache/sixte_raytracing/meshes (none without $HOME).
+     */
+    static std::string cache_dir_from_xml(const XMLData &xml_data);
+
+    /**
+     * @brief New committed triangle geometry on device that shares the buffers of the mesh.
+     */
+    [[nodiscard]] RTCGeometry create_geometry(RTCDevice device, RTCBuildQuality quality = RTC_BUILD_QUALITY_HIGH) const;
+
+    [[nodiscard]] std::size_t vertex_count() const { return vertex_count_; }
+    [[nodiscard]] std::size_t triangle_count() const { return triangle_count_; }
+    // x, y, z of every vertex, followed by one float of padding for Embree's 16 byte loads
+    [[nodiscard]] const float *vertices() const { return vertices_; }
+    // Three vertex indices per triangle
+    [[nodiscard]] const std::uint32_t *indices() const { return indices_; }
+    // True if the buffers are mapped from a cache file
+    [[nodiscard]] bool mapped() const { return mapping_ != nullptr; }
+
+private:
+    TriangleMesh() = default;
+
+    std::size_t vertex_count_ = 0, triangle_count_ = 0;
+    const float *vertices_ = nullptr;
+    const std::uint32_t *indices_ = nullptr;
+    // Buffers of a parsed mesh
+    std::vector<float> vertex_storage_;
+    std::vector<std::uint32_t> index_storage_;
+    // Mapped cache file
+    void *mapping_ = nullptr;
+    std::size_t mapping_size_ = 0;
+
+    static std::shared_ptr<TriangleMesh> parse(const std::string &path, const Vec3fa &position);
+    static std::shared_ptr<TriangleMesh> map(const std::string &cache_file, std::uint64_t key);
+    void write(const std::string &cache_file, std::uint64_t key) const;
+};
+
+
+#endif //SIXTE_TRIANGLEMESH_H
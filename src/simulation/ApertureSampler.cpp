@@ -0,0 +1,51 @@
+/*
+Copyright (C) 2025  Neo Reinmann (neoreinmann@gmail.com)
+*/
+
+#include "ApertureSampler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+ApertureSampler::ApertureSampler(const std::vector<Annulus> &annuli, std::size_t n_photons, std::size_t block)
+        : n_photons_(n_photons), block_(block) {
+    if (block == 0)
+        throw std::runtime_error("ApertureSampler: block must be positive");
+    std::vector<Annulus> sorted;
+    for (const Annulus &annulus : annuli) {
+        if (!(annulus.r_hi > annulus.r_lo))
+            continue;
+        sorted.push_back({std::max(0.0, annulus.r_lo), annulus.r_hi});
+    }
+    if (sorted.empty())
+        throw std::runtime_error("ApertureSampler: no annulus with positive area");
+    std::sort(sorted.begin(), sorted.end(), [](const Annulus &a, const Annulus &b) { return a.r_lo < b.r_lo; });
+
+    // Overlapping annuli would be sampled twice
+    for (const Annulus &annulus : sorted) {
+        if (!annuli_.empty() && annulus.r_lo <= annuli_.back().r_hi)
+            annuli_.back().r_hi = std::max(annuli_.back().r_hi, annulus.r_hi);
+        else
+            annuli_.push_back(annulus);
+    }
+    for (const Annulus &annulus : annuli_) {
+        cumulative_.push_back(area_);
+        area_ += annulus.area();
+    }
+}
+
+std::pair<double, double> ApertureSampler::sample(std::size_t i, double u, double v) const {
+    const std::size_t first = i / block_ * block_;
+    const std::size_t size = first + block_ <= n_photons_ || n_photons_ <= first ? block_ : n_photons_ - first;
+    const double a = area_ * ((double) (i - first) + u) / (double) size;
+
+    auto it = std::upper_bound(cumulative_.begin(), cumulative_.end(), a);
+    const auto k = (std::size_t) (it - cumulative_.begin()) - 1;
+    const Annulus &annulus = annuli_[k];
+    // Uniform in area: r^2 is uniform between r_lo^2 and r_hi^2
+    const double r = std::sqrt(std::min(annulus.r_hi * annulus.r_hi,
+                                        annulus.r_lo * annulus.r_lo + (a - cumulative_[k]) / M_PI));
+    const double phi = 2 * M_PI * v;
+    return {r * std::cos(phi), r * std::sin(phi)};
+}
@@ -0,0 +1,52 @@
+/*
+Copyright (C) 2025  Neo Reinmann (neoreinmann@gmail.com)
+*/
+
+#ifndef SIXTE_APERTURESAMPLER_H
+#define SIXTE_APERTURESAMPLER_H
+
+#include "geometry/Annulus.h"
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Photon start positions spread over a set of annuli instead of a square around the whole module.
+ *
+ * The photons are split into blocks of block() consecutive ids. Within a block, photon j gets the j-th of
+ * equal slices of the total area, the annuli in order of radius. So every block covers every annulus in
+ * proportion to its area (stratified allocation), while each photon is still uniform over its slice. All
+ * photons carry the same weight area() / photons, and any run that ends at a block boundary or at
+ * n_photons is an unbiased sample of the annuli.
+ */
+class ApertureSampler {
+public:
+    /**
+     * @param annuli May overlap and come in any order, they are merged
+     * @param n_photons Photons of the run, the last, shorter block is stratified over what is left
+     * @param block Photons per stratified block
+     */
+    ApertureSampler(const std::vector<Annulus> &annuli, std::size_t n_photons, std::size_t block = 1000);
+
+    /**
+     * @brief Start position (x, y) of photon i, from two uniform numbers in [0, 1).
+     */
+    [[nodiscard]] std::pair<double, double> sample(std::size_t i, double u, double v) const;
+
+    /**
+     * @brief Area sampled, for the effective area of a run [mm^2].
+     */
+    [[nodiscard]] double area() const { return area_; }
+
+    [[nodiscard]] const std::vector<Annulus> &annuli() const { return annuli_; }
+    [[nodiscard]] std::size_t block() const { return block_; }
+
+private:
+    std::vector<Annulus> annuli_;       // disjoint, sorted by radius
+    std::vector<double> cumulative_;    // area of all annuli before annuli_[k]
+    double area_ = 0;
+    std::size_t n_photons_, block_;
+};
+
+
+#endif //SIXTE_APERTURESAMPLER_H
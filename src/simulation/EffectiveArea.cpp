@@ -0,0 +1,142 @@
+/*
+Copyright (C) 2025  Neo Reinmann (neoreinmann@gmail.com)
+*/
+
+#include "EffectiveArea.h"
+
+#include "output/Fits.h"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+EnergyGrid EnergyGrid::linear(double e_min, double e_max, std::size_t bins) {
+    if (bins == 0 || !(e_min >= 0) || !(e_max > e_min))
+        throw std::runtime_error("EnergyGrid: need 0 <= e_min < e_max and at least one bin");
+    EnergyGrid grid;
+    grid.lo.resize(bins);
+    grid.hi.resize(bins);
+    const double width = (e_max - e_min) / (double) bins;
+    for (std::size_t i = 0; i < bins; i++) {
+        grid.lo[i] = e_min + width * (double) i;
+        grid.hi[i] = i + 1 == bins ? e_max : e_min + width * (double) (i + 1);
+    }
+    return grid;
+}
+
+std::optional<EnergyGrid> EnergyGrid::spectrum_from_xml(const XMLData &xml_data) {
+    auto node = xml_data.child("telescope").child("raytracer").optionalChild("spectrum");
+    if (!node)
+        return std::nullopt;
+    const int bins = node->attributeAsIntOr("bins", 100);
+    if (bins <= 1)
+        throw std::runtime_error("spectrum: bins must be at least 2");
+    return linear(node->attributeAsDoubleOr("e_min", 0.1), node->attributeAsDoubleOr("e_max", 12.0), (std::size_t) bins);
+}
+
+std::vector<double> EnergyGrid::mids() const {
+    std::vector<double> energies(size());
+    for (std::size_t i = 0; i < size(); i++)
+        energies[i] = mid(i);
+    return energies;
+}
+
+std::optional<EffectiveAreaOptions> EffectiveAreaOptions::from_xml(const XMLData &xml_data) {
+    auto node = xml_data.child("telescope").child("raytracer").optionalChild("effective_area");
+    if (!node)
+        return std::nullopt;
+    EffectiveAreaOptions options;
+    const int bins = node->attributeAsIntOr("bins", 1000);
+    if (bins <= 0)
+        throw std::runtime_error("effective_area: bins must be positive");
+    options.grid = EnergyGrid::linear(node->attributeAsDoubleOr("e_min", 0.1), node->attributeAsDoubleOr("e_max", 12.0),
+                                      (std::size_t) bins);
+    options.reflectivity = node->attributeAsDoubleOr("reflectivity", options.reflectivity);
+    if (options.reflectivity < 0 || options.reflectivity > 1)
+        throw std::runtime_error("effective_area: reflectivity must be in [0, 1]");
+    options.filename = node->attributeAsStringOr("filename", options.filename);
+    options.telescope = xml_data.root().attributeAsStringOr("telescop", "");
+    options.instrument = xml_data.root().attributeAsStringOr("instrume", "");
+    return options;
+}
+
+EffectiveAreaAccumulator::EffectiveAreaAccumulator(const EnergyGrid &grid, const Reflectivity &reflectivity)
+        : grid_(&grid), reflectivity_(&reflectivity), sum_(grid.size(), 0.0), sum2_(grid.size(), 0.0) {}
+
+void EffectiveAreaAccumulator::add(const GrazingAngles &angles, double weight) {
+    hits_++;
+    for (std::size_t bin = 0; bin < grid_->size(); bin++) {
+        const double energy = grid_->mid(bin);
+        double throughput = weight;
+        for (std::size_t i = 0; i < angles.size() && throughput > 0; i++)
+            throughput *= reflectivity_->reflectivity(energy, angles[i]);
+        sum_[bin] += throughput;
+        sum2_[bin] += throughput * throughput;
+    }
+}
+
+void EffectiveAreaAccumulator::add(const SpectralWeights &weights, double weight) {
+    if (weights.size() != sum_.size())
+        throw std::runtime_error("EffectiveAreaAccumulator: " + std::to_string(weights.size()) +
+                                 " spectral weights for " + std::to_string(sum_.size()) + " energy bins");
+    hits_++;
+    for (std::size_t bin = 0; bin < sum_.size(); bin++) {
+        const double throughput = weight * weights[bin];
+        sum_[bin] += throughput;
+        sum2_[bin] += throughput * throughput;
+    }
+}
+
+void EffectiveAreaAccumulator::merge(const EffectiveAreaAccumulator &other) {
+    if (other.sum_.size() != sum_.size())
+        throw std::runtime_error("EffectiveAreaAccumulator: cannot merge different energy grids");
+    for (std::size_t bin = 0; bin < sum_.size(); bin++) {
+        sum_[bin] += other.sum_[bin];
+        sum2_[bin] += other.sum2_[bin];
+    }
+    hits_ += other.hits_;
+}
+
+std::vector<double> EffectiveAreaAccumulator::effective_area(double aperture_area, std::size_t photons) const {
+    std::vector<double> area(sum_.size(), 0.0);
+    if (photons == 0)
+        return area;
+    for (std::size_t bin = 0; bin < sum_.size(); bin++)
+        area[bin] = aperture_area * sum_[bin] / (double) photons;
+    return area;
+}
+
+std::vector<double> EffectiveAreaAccumulator::effective_area_error(double aperture_area, std::size_t photons) const {
+    std::vector<double> error(sum_.size(), 0.0);
+    if (photons == 0)
+        return error;
+    const auto n = (double) photons;
+    for (std::size_t bin = 0; bin < sum_.size(); bin++) {
+        // Missed photons contribute 0 to both moments
+        const double mean = sum_[bin] / n;
+        const double variance = std::max(0.0, sum2_[bin] / n - mean * mean);
+        error[bin] = aperture_area * std::sqrt(variance / n);
+    }
+    return error;
+}
+
+void write_arf(const std::string &path, const EnergyGrid &grid, const std::vector<double> &area,
+               const std::vector<double> &error, const std::string &telescope, const std::string &instrument) {
+    if (area.size() != grid.size() || error.size() != grid.size())
+        throw std::runtime_error("write_arf: area and error need one value per energy bin");
+    FitsTable table;
+    table.extname = "SPECRESP";
+    table.columns = {{"ENERG_LO", "keV", &grid.lo},
+                     {"ENERG_HI", "keV", &grid.hi},
+                     {"SPECRESP", "cm**2", &area},
+                     {"SPECRESP_ERR", "cm**2", &error}};
+    table.cards = {FitsCard::string("TELESCOP", telescope.empty() ? "UNKNOWN" : telescope, "mission name"),
+                   FitsCard::string("INSTRUME", instrument.empty() ? "UNKNOWN" : instrument, "instrument name"),
+                   FitsCard::string("FILTER", "NONE"),
+                   FitsCard::string("HDUCLASS", "OGIP", "format conforms to OGIP standard"),
+                   FitsCard::string("HDUCLAS1", "RESPONSE"),
+                   FitsCard::string("HDUCLAS2", "SPECRESP"),
+                   FitsCard::string("HDUVERS", "1.1.0"),
+                   FitsCard::string("ARFVERSN", "1992a", "obsolete"),
+                   FitsCard::string("CREATOR", "raytracing", "telescope_simulation_tool")};
+    write_fits_tables(path, {}, {table});
+}
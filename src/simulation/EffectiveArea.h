@@ -0,0 +1,105 @@
+/*
+Copyright (C) 2025  Neo Reinmann (neoreinmann@gmail.com)
+*/
+
+#ifndef SIXTE_EFFECTIVEAREA_H
+#define SIXTE_EFFECTIVEAREA_H
+
+#include "geometry/GrazingAngles.h"
+#include "lib/XMLData.h"
+#include "surface/Reflectivity.h"
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Energy bins of an ARF or of the spectral mode [keV].
+ */
+struct EnergyGrid {
+    std::vector<double> lo, hi;
+
+    /**
+     * @brief bins equally wide bins from e_min to e_max.
+     */
+    static EnergyGrid linear(double e_min, double e_max, std::size_t bins);
+
+    /**
+     * @brief Grid of the spectral mode from <spectrum e_min=".." e_max=".." bins=".."/> under <raytracer>,
+     * std::nullopt if there is no such element. docs/spectral_mode.md
+     */
+    static std::optional<EnergyGrid> spectrum_from_xml(const XMLData &xml_data);
+
+    [[nodiscard]] std::size_t size() const { return lo.size(); }
+    [[nodiscard]] double mid(std::size_t i) const { return (lo[i] + hi[i]) / 2; }
+    [[nodiscard]] std::vector<double> mids() const;
+};
+
+struct EffectiveAreaOptions {
+    EnergyGrid grid;
+    double reflectivity = 1.0;      // constant reflectivity of every mirror
+    std::string filename = "effective_area.arf";
+    std::string telescope, instrument;    // TELESCOP and INSTRUME of the ARF, from <instrument>
+
+    /**
+     * @brief Reads <effective_area e_min=".." e_max=".." bins=".." reflectivity=".." filename=".."/> under
+     * <raytracer>, std::nullopt if there is no such element.
+     */
+    static std::optional<EffectiveAreaOptions> from_xml(const XMLData &xml_data);
+};
+
+/**
+ * @brief Throughput of the traced photons at every energy of a grid, from one geometric trace.
+ *
+ * A photon on the sensor contributes prod_i R(E, grazing angle i) at energy E, a photon that missed
+ * contributes 0. The mean over all traced photons times the aperture area is the effective area,
+ * its error follows from the second moment. Meant to be used one per worker (PhotonEngine::trace_into)
+ * and merged at the end.
+ */
+class EffectiveAreaAccumulator {
+public:
+    EffectiveAreaAccumulator(const EnergyGrid &grid, const Reflectivity &reflectivity);
+
+    /**
+     * @brief Adds a photon that reached the sensor after the reflections in angles.
+     */
+    void add(const GrazingAngles &angles, double weight = 1.0);
+
+    /**
+     * @brief Adds a photon of the spectral mode that reached the sensor, weight * weights holds the
+     * throughput at every energy of the grid.
+     */
+    void add(const SpectralWeights &weights, double weight = 1.0);
+
+    void merge(const EffectiveAreaAccumulator &other);
+
+    [[nodiscard]] std::size_t hits() const { return hits_; }
+
+    /**
+     * @brief Effective area per energy bin, in the unit of aperture_area.
+     * @param photons Number of traced photons, hits or not
+     */
+    [[nodiscard]] std::vector<double> effective_area(double aperture_area, std::size_t photons) const;
+
+    /**
+     * @brief Standard error of effective_area per energy bin.
+     */
+    [[nodiscard]] std::vector<double> effective_area_error(double aperture_area, std::size_t photons) const;
+
+private:
+    const EnergyGrid *grid_;
+    const Reflectivity *reflectivity_;
+    std::vector<double> sum_, sum2_;
+    std::size_t hits_ = 0;
+};
+
+/**
+ * @brief Writes an OGIP ARF (SPECRESP extension, CAL/GEN/92-002) with an extra SPECRESP_ERR column.
+ * @param area Effective area per bin [cm^2]
+ * @param error Standard error per bin [cm^2]
+ */
+void write_arf(const std::string &path, const EnergyGrid &grid, const std::vector<double> &area,
+               const std::vector<double> &error, const std::string &telescope, const std::string &instrument);
+
+
+#endif //SIXTE_EFFECTIVEAREA_H
@@ -0,0 +1,131 @@
+/*
+Copyright (C) 2025  Neo Reinmann (neoreinmann@gmail.com)
+*/
+
+#include "HitBatch.h"
+
+#include <stdexcept>
+#include <string>
+
+namespace {
+    constexpr std::size_t capacity = RayHistory::capacity;
+
+    template<typename T>
+    void append_column(std::vector<T> &to, const std::vector<T> &from) {
+        to.insert(to.end(), from.begin(), from.end());
+    }
+}
+
+std::size_t HitBatch::bytes_per_hit(HistoryLevel history, std::size_t spectral_bins) {
+    std::size_t bytes = sizeof(std::uint64_t) + 2 * sizeof(Vec3fa) + 2 * sizeof(double)
+                        + spectral_bins * sizeof(float);
+    if (history != HistoryLevel::off)
+        bytes += sizeof(std::uint8_t) + capacity * sizeof(short);
+    if (history == HistoryLevel::full)
+        bytes += 2 * capacity * sizeof(Vec3fa);
+    return bytes;
+}
+
+void HitBatch::push_back(std::uint64_t photon, const Ray &ray) {
+    index.push_back(photon);
+    position.push_back(ray.position());
+    direction.push_back(ray.direction());
+    energy.push_back(ray.energy);
+    weight.push_back(ray.weight);
+
+    if (history != HistoryLevel::off) {
+        const RayHistory &path = ray.raytracing_history;
+        history_len.push_back((std::uint8_t) path.size());
+        for (std::size_t i = 0; i < capacity; i++)
+            history_id.push_back(i < path.size() ? path.id(i) : (short) -1);
+        if (history == HistoryLevel::full) {
+            const auto origins = path.origins(), directions = path.directions();
+            for (std::size_t i = 0; i < capacity; i++) {
+                history_origin.push_back(i < origins.size() ? origins[i] : Vec3fa{});
+                history_direction.push_back(i < directions.size() ? directions[i] : Vec3fa{});
+            }
+        }
+    }
+
+    if (spectral_bins > 0) {
+        const SpectralWeights &weights = ray.spectral_weights;
+        if (weights.size() != spectral_bins)
+            throw std::runtime_error("HitBatch: hit with " + std::to_string(weights.size()) +
+                                     " spectral weights, the batch has " + std::to_string(spectral_bins));
+        for (std::size_t k = 0; k < spectral_bins; k++)
+            spectral_weights.push_back(weights[k]);
+    }
+}
+
+void HitBatch::append(const HitBatch &other) {
+    if (other.history != history || other.spectral_bins != spectral_bins)
+        throw std::runtime_error("HitBatch: appending a batch with other columns");
+    append_column(index, other.index);
+    append_column(position, other.position);
+    append_column(direction, other.direction);
+    append_column(energy, other.energy);
+    append_column(weight, other.weight);
+    append_column(history_len, other.history_len);
+    append_column(history_id, other.history_id);
+    append_column(history_origin, other.history_origin);
+    append_column(history_direction, other.history_direction);
+    append_column(spectral_weights, other.spectral_weights);
+}
+
+void HitBatch::reserve(std::size_t hits) {
+    index.reserve(hits);
+    position.reserve(hits);
+    direction.reserve(hits);
+    energy.reserve(hits);
+    weight.reserve(hits);
+    if (history != HistoryLevel::off) {
+        history_len.reserve(hits);
+        history_id.reserve(hits * capacity);
+    }
+    if (history == HistoryLevel::full) {
+        history_origin.reserve(hits * capacity);
+        history_direction.reserve(hits * capacity);
+    }
+    spectral_weights.reserve(hits * spectral_bins);
+}
+
+void HitBatch::resize(std::size_t hits) {
+    if (hits >= size())
+        return;
+    index.resize(hits);
+    position.resize(hits);
+    direction.resize(hits);
+    energy.resize(hits);
+    weight.resize(hits);
+    if (history != HistoryLevel::off) {
+        history_len.resize(hits);
+        history_id.resize(hits * capacity);
+    }
+    if (history == HistoryLevel::full) {
+        history_origin.resize(hits * capacity);
+        history_direction.resize(hits * capacity);
+    }
+    spectral_weights.resize(hits * spectral_bins);
+}
+
+std::span<const short> HitBatch::history_ids(std::size_t i) const {
+    if (history == HistoryLevel::off)
+        return {};
+    return {history_id.data() + i * capacity, history_len[i]};
+}
+
+std::span<const Vec3fa> HitBatch::history_origins(std::size_t i) const {
+    if (history != HistoryLevel::full)
+        return {};
+    return {history_origin.data() + i * capacity, history_len[i]};
+}
+
+std::span<const Vec3fa> HitBatch::history_directions(std::size_t i) const {
+    if (history != HistoryLevel::full)
+        return {};
+    return {history_direction.data() + i * capacity, history_len[i]};
+}
+
+std::span<const float> HitBatch::spectral(std::size_t i) const {
+    return {spectral_weights.data() + i * spectral_bins, spectral_bins};
+}
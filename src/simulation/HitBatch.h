@@ -0,0 +1,64 @@
+/*
+Copyright (C) 2025  Neo Reinmann (neoreinmann@gmail.com)
+*/
+
+#ifndef SIXTE_HITBATCH_H
+#define SIXTE_HITBATCH_H
+
+#include "geometry/Ray.h"
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+/**
+ * @brief Sensor hits of a batch as columns, only the part of the rays that goes into the output.
+ *
+ * The worker that traced a chunk copies its hits in here, so the streamed batches and the writer queue hold
+ * these columns instead of whole rays. The history columns are filled at HistoryLevel ids and full (origins and
+ * directions only at full), spectral_weights only in the spectral mode.
+ */
+struct HitBatch {
+    explicit HitBatch(HistoryLevel history = HistoryLevel::off, std::size_t spectral_bins = 0)
+            : history(history), spectral_bins(spectral_bins) {}
+
+    /**
+     * @brief Bytes one hit takes in a batch with this history level and number of spectral bins.
+     */
+    static std::size_t bytes_per_hit(HistoryLevel history, std::size_t spectral_bins);
+
+    void push_back(std::uint64_t photon, const Ray &ray);
+    /**
+     * @brief Appends the hits of other, which has the same columns.
+     */
+    void append(const HitBatch &other);
+    void reserve(std::size_t hits);
+    /**
+     * @brief Keeps the first hits, drops the rest.
+     */
+    void resize(std::size_t hits);
+
+    [[nodiscard]] std::size_t size() const { return index.size(); }
+    [[nodiscard]] bool empty() const { return index.empty(); }
+    [[nodiscard]] std::size_t bytes() const { return size() * bytes_per_hit(history, spectral_bins); }
+
+    // History of hit i, the origins and directions are empty below HistoryLevel::full
+    [[nodiscard]] std::span<const short> history_ids(std::size_t i) const;
+    [[nodiscard]] std::span<const Vec3fa> history_origins(std::size_t i) const;
+    [[nodiscard]] std::span<const Vec3fa> history_directions(std::size_t i) const;
+    // Weights of hit i in the spectral mode, empty outside it
+    [[nodiscard]] std::span<const float> spectral(std::size_t i) const;
+
+    HistoryLevel history;
+    std::size_t spectral_bins;
+    std::vector<std::uint64_t> index;       // photon id
+    std::vector<Vec3fa> position, direction;
+    std::vector<double> energy, weight;
+    std::vector<std::uint8_t> history_len;
+    std::vector<short> history_id;          // RayHistory::capacity per hit
+    std::vector<Vec3fa> history_origin, history_direction;     // RayHistory::capacity per hit
+    std::vector<float> spectral_weights;    // spectral_bins per hit
+};
+
+
+#endif //SIXTE_HITBATCH_H
@@ -0,0 +1,158 @@
+/*
+Copyright (C) 2025  Neo Reinmann (neoreinmann@gmail.com)
+*/
+
+#include "PhotonEngine.h"
+
+#include <stdexcept>
+#include <string>
+
+namespace {
+    unsigned threads_from_xml(const XMLData &xml_data) {
+        int threads = xml_data.child("telescope").child("raytracer").child("simulation_details")
+                .attributeAsIntOr("threads", 0);
+        if (threads < 0)
+            throw std::runtime_error("simulation_details: threads must not be negative");
+        return (unsigned) threads;
+    }
+
+    std::uint64_t seed_from_xml(const XMLData &xml_data) {
+        auto details = xml_data.child("telescope").child("raytracer").child("simulation_details");
+        if (details.hasAttribute("seed"))
+            return (std::uint64_t) details.attributeAsInt("seed");
+        std::random_device rd;
+        return ((std::uint64_t) rd() << 32) | rd();
+    }
+
+    std::size_t chunk_size_from_xml(const XMLData &xml_data) {
+        int chunk_size = xml_data.child("telescope").child("raytracer").child("simulation_details")
+                .attributeAsIntOr("chunk_size", 4096);
+        if (chunk_size <= 0)
+            throw std::runtime_error("simulation_details: chunk_size must be positive");
+        return (std::size_t) chunk_size;
+    }
+
+    bool wavefront_from_xml(const XMLData &xml_data) {
+        return xml_data.child("telescope").child("raytracer").child("simulation_details")
+                .attributeAsStringOr("wavefront", "false") == "true";
+    }
+
+    std::size_t batch_bytes_from_xml(const XMLData &xml_data) {
+        int batch_mb = xml_data.child("telescope").child("raytracer").child("simulation_details")
+                .attributeAsIntOr("batch_mb", (int) (PhotonEngine::default_batch_bytes >> 20));
+        if (batch_mb <= 0)
+            throw std::runtime_error("simulation_details: batch_mb must be positive");
+        return (std::size_t) batch_mb << 20;
+    }
+
+    Sampling sampling_from_xml(const XMLData &xml_data) {
+        const std::string sampling = xml_data.child("telescope").child("raytracer").child("simulation_details")
+                .attributeAsStringOr("sampling", "random");
+        if (sampling == "random")
+            return Sampling::random;
+        if (sampling == "sobol")
+            return Sampling::sobol;
+        throw std::runtime_error("simulation_details: sampling must be random or sobol, not " + sampling);
+    }
+}
+
+PhotonEngine::PhotonEngine(MirrorModule &telescope, unsigned n_threads, std::uint64_t seed, std::size_t chunk_size,
+                           bool wavefront, std::size_t batch_bytes, Sampling sampling)
+: telescope_(telescope), pool_(n_threads), seed_(seed), chunk_size_(chunk_size), wavefront_(wavefront),
+  batch_bytes_(batch_bytes), sampling_(sampling) {
+    if (batch_bytes_ == 0)
+        batch_bytes_ = default_batch_bytes;
+    // Worker 0 traces on the telescope itself, every other worker gets a clone sharing its scene
+    for (unsigned w = 1; w < pool_.size(); w++)
+        contexts_.emplace_back(telescope_.clone());
+}
+
+PhotonEngine::PhotonEngine(MirrorModule &telescope, const XMLData &xml_data)
+: PhotonEngine(telescope, threads_from_xml(xml_data), seed_from_xml(xml_data), chunk_size_from_xml(xml_data),
+               wavefront_from_xml(xml_data), batch_bytes_from_xml(xml_data), sampling_from_xml(xml_data)) {}
+
+MirrorModule &PhotonEngine::telescope() {
+    return telescope_;
+}
+
+unsigned PhotonEngine::n_threads() const {
+    return pool_.size();
+}
+
+std::uint64_t PhotonEngine::seed() const {
+    return seed_;
+}
+
+bool PhotonEngine::wavefront() const {
+    return wavefront_;
+}
+
+std::size_t PhotonEngine::batch_bytes() const {
+    return batch_bytes_;
+}
+
+Sampling PhotonEngine::sampling() const {
+    return sampling_;
+}
+
+std::size_t PhotonEngine::truncated_histories() const {
+    return truncated_;
+}
+
+std::uint64_t PhotonEngine::run_key(std::uint64_t run) const {
+    return mix_seed(seed_ ^ mix_seed(run));
+}
+
+MirrorModule &PhotonEngine::context(unsigned worker) {
+    if (worker == 0)
+        return telescope_;
+    return *contexts_[worker - 1];
+}
+
+std::uint64_t PhotonEngine::begin_run() {
+    for (auto &context : contexts_)
+        context->set_surface(telescope_.surface());
+    return run_key(run_++);
+}
+
+std::size_t PhotonEngine::batch_chunks(std::size_t result_bytes) const {
+    const std::size_t fit = batch_bytes_ / std::max<std::size_t>(1, chunk_size_ * result_bytes);
+    return std::max<std::size_t>(fit, pool_.size());
+}
+
+HitBatch PhotonEngine::empty_batch() const {
+    const auto &spectrum = telescope_.spectrum();
+    return HitBatch(telescope_.history_level(), spectrum != nullptr ? spectrum->size() : 0);
+}
+
+HitBatch PhotonEngine::trace(std::size_t n_photons, const std::function<Ray(std::size_t)> &source) {
+    const std::size_t n_chunks = (n_photons + chunk_size_ - 1) / chunk_size_;
+    return run_chunks<HitBatch>(begin_run(), n_photons, 0, n_chunks, empty_batch(), trace_chunk(source));
+}
+
+std::size_t PhotonEngine::trace(std::size_t n_photons, const std::function<Ray(std::size_t)> &source,
+                                const std::function<void(HitBatch &&)> &sink) {
+    std::size_t n_hits = 0;
+    trace_until(n_photons, source, [&](HitBatch &&hits, std::size_t) {
+        n_hits += hits.size();
+        sink(std::move(hits));
+        return true;
+    });
+    return n_hits;
+}
+
+std::size_t PhotonEngine::trace_until(std::size_t max_photons, const std::function<Ray(std::size_t)> &source,
+                                      const std::function<bool(HitBatch &&, std::size_t)> &sink) {
+    const HitBatch empty = empty_batch();
+    return stream<HitBatch>(max_photons, HitBatch::bytes_per_hit(empty.history, empty.spectral_bins), empty,
+                            trace_chunk(source), sink);
+}
+
+ChunkFunction<HitBatch> PhotonEngine::trace_chunk(const std::function<Ray(std::size_t)> &source) const {
+    return [this, &source](MirrorModule &trace_context, std::uint64_t key, std::size_t begin, std::size_t end,
+                           HitBatch &hits) {
+        trace_photons(trace_context, key, begin, end, source, [&](std::uint64_t photon, const Ray &ray) {
+            hits.push_back(photon, ray);
+        });
+    };
+}
@@ -0,0 +1,329 @@
+/*
+Copyright (C) 2025  Neo Reinmann (neoreinmann@gmail.com)
+*/
+
+#ifndef SIXTE_PHOTONENGINE_H
+#define SIXTE_PHOTONENGINE_H
+
+#include "mirror_module/MirrorModule.h"
+#include "simulation/HitBatch.h"
+#include "lib/WorkStealingPool.h"
+#include "lib/XMLData.h"
+#include "lib/random.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <vector>
+
+// chunk(trace context, run key, begin, end, results) handles photons [begin, end) of a run and adds its results
+template<typename Results>
+using ChunkFunction = std::function<void(MirrorModule &, std::uint64_t, std::size_t, std::size_t, Results &)>;
+
+/**
+ * @brief Traces photons in parallel, one trace context (MirrorModule::clone) per worker.
+ *
+ * Photons are grouped into chunks of fixed size which are handed out by a WorkStealingPool.
+ * Before a photon is traced the worker's RandomStream is positioned at (run key, photon id), and
+ * results are merged in chunk order, so the output only depends on the seed but not on the number
+ * of threads, the chunk size or on which worker traced which chunk.
+ */
+class PhotonEngine {
+public:
+    // Default memory bound of a streamed batch, see batch_bytes
+    static constexpr std::size_t default_batch_bytes = std::size_t(256) << 20;
+
+    /**
+     * @param wavefront Trace every chunk as one batch with MirrorModule::ray_trace_batch instead of ray by ray
+     * @param batch_bytes Bound of the results of one streamed batch, 0 selects default_batch_bytes
+     * @param sampling Set on the random stream of every worker, see RandomStream::uniform2
+     */
+    PhotonEngine(MirrorModule &telescope, unsigned n_threads, std::uint64_t seed, std::size_t chunk_size = 4096,
+                 bool wavefront = false, std::size_t batch_bytes = 0, Sampling sampling = Sampling::random);
+
+    /**
+     * @brief Reads threads, seed, chunk_size, wavefront, batch_mb and sampling ("random" or "sobol")
+     * from <simulation_details>.
+     * threads="0" (default) uses all cores, a missing seed is drawn from std::random_device.
+     */
+    PhotonEngine(MirrorModule &telescope, const XMLData &xml_data);
+
+    /**
+     * @brief The telescope the engine was created for. Surface parameters set on it between runs reach all contexts.
+     */
+    MirrorModule &telescope();
+
+    [[nodiscard]] unsigned n_threads() const;
+    [[nodiscard]] std::uint64_t seed() const;
+    [[nodiscard]] bool wavefront() const;
+    /**
+     * @brief Bound of the results of one streamed batch. A batch has as many chunks as fit if every photon
+     * gives a result, but at least one per thread, so workers do not idle on small bounds.
+     */
+    [[nodiscard]] std::size_t batch_bytes() const;
+    [[nodiscard]] Sampling sampling() const;
+
+    /**
+     * @brief Rays traced so far whose path had more surfaces than RayHistory::capacity, only the first ones of
+     * these are in their history. Counts the rays of every trace, on the sensor or not, but none at history="off".
+     */
+    [[nodiscard]] std::size_t truncated_histories() const;
+
+    /**
+     * @brief Key of the random streams of the n-th call to trace/map. Together with the photon id it
+     * regenerates any single photon: random_stream().begin_photon(run_key(run), photon_id).
+     */
+    [[nodiscard]] std::uint64_t run_key(std::uint64_t run) const;
+
+    /**
+     * @brief Traces photons [0, n_photons) and returns the sensor hits ordered by photon index.
+     * Both the scalar and the wavefront mode give the same hits.
+     * @param source Creates the ray of the given photon, runs on the worker threads
+     */
+    HitBatch trace(std::size_t n_photons, const std::function<Ray(std::size_t)> &source);
+
+    /**
+     * @brief Streaming form of trace: the hits are handed to sink in photon order, one batch of at most about
+     * batch_bytes() at a time, so the engine never holds more than one batch and memory does not grow with
+     * n_photons. sink runs on the calling thread between batches; the hits are the same as those of trace.
+     * @return Number of hits
+     */
+    std::size_t trace(std::size_t n_photons, const std::function<Ray(std::size_t)> &source,
+                      const std::function<void(HitBatch &&)> &sink);
+
+    /**
+     * @brief Streaming trace that can stop early: after every batch sink(hits, photons) gets the hits of the batch
+     * and the number of photons traced so far, tracing stops once it returns false or max_photons are traced.
+     * Batches end at multiples of the chunk size, to stop at a photon count that does not depend
+     * on the batch size, drop the hits past it in sink (see PsfStatistics::consume).
+     * @return Number of photons traced
+     */
+    std::size_t trace_until(std::size_t max_photons, const std::function<Ray(std::size_t)> &source,
+                            const std::function<bool(HitBatch &&, std::size_t)> &sink);
+
+    /**
+     * @brief Traces photons [0, n_photons) without keeping the hits: add(partials[worker], ray) runs on the worker
+     * that traced the ray, with that worker's own partial result, so accumulating needs no locking.
+     * The caller merges the partials. Which hits end up in which partial depends on the scheduling,
+     * the hits themselves are those of trace.
+     * @param partials One partial result per thread, at least n_threads() entries
+     */
+    template<typename Partial>
+    void trace_into(std::size_t n_photons, const std::function<Ray(std::size_t)> &source,
+                    std::vector<Partial> &partials, const std::function<void(Partial &, const Ray &)> &add);
+
+    /**
+     * @brief Generic form of trace: photon(context, i) runs on a worker with that worker's trace context,
+     * results that are not std::nullopt are returned ordered by photon index.
+     */
+    template<typename Result>
+    std::vector<Result> map(std::size_t n_photons,
+                            const std::function<std::optional<Result>(MirrorModule &, std::size_t)> &photon);
+
+    /**
+     * @brief Chunk level form of map: chunk(context, run key, begin, end, results) handles photons [begin, end)
+     * and appends its results, which are concatenated in chunk order. Positioning the random streams is up to chunk.
+     */
+    template<typename Result>
+    std::vector<Result> map_chunks(std::size_t n_photons, const ChunkFunction<std::vector<Result>> &chunk);
+
+    /**
+     * @brief Streaming form of map_chunks: the results of every batch, at most about batch_bytes() of them, are
+     * handed to consumer(results, photons) in chunk order before the next batch starts, photons is the number of
+     * photons done so far. Returning false stops the run after that batch. All batches share one run key, so the
+     * results are the same as those of map_chunks.
+     * @return Number of photons done
+     */
+    template<typename Result>
+    std::size_t stream_chunks(std::size_t n_photons, const ChunkFunction<std::vector<Result>> &chunk,
+                              const std::function<bool(std::vector<Result> &&, std::size_t)> &consumer);
+
+private:
+    MirrorModule &telescope_;
+    std::vector<std::unique_ptr<MirrorModule>> contexts_;
+    WorkStealingPool pool_;
+    std::uint64_t seed_;
+    std::size_t chunk_size_;
+    bool wavefront_;
+    std::size_t batch_bytes_;
+    Sampling sampling_;
+    std::uint64_t run_ = 0;
+    mutable std::atomic<std::size_t> truncated_{0};
+
+    MirrorModule &context(unsigned worker);
+    /**
+     * @brief Key of the next run. Hands the telescope's current surface model to the other contexts first,
+     * no worker traces between runs.
+     */
+    std::uint64_t begin_run();
+
+    // Chunks per streamed batch if every photon gives a result of result_bytes
+    [[nodiscard]] std::size_t batch_chunks(std::size_t result_bytes) const;
+
+    // Empty batch with the columns of the telescope's hits
+    [[nodiscard]] HitBatch empty_batch() const;
+
+    // Traces photons [begin, end) of a run, scalar or wavefront, and calls hit(photon, ray) for the rays on the sensor
+    template<typename Hit>
+    void trace_photons(MirrorModule &trace_context, std::uint64_t key, std::size_t begin, std::size_t end,
+                       const std::function<Ray(std::size_t)> &source, const Hit &hit) const;
+
+    // Chunk function of trace, collects the hits of a chunk as columns
+    ChunkFunction<HitBatch> trace_chunk(const std::function<Ray(std::size_t)> &source) const;
+
+    // Streams the results of batches of chunks of result_bytes per photon to consumer, see stream_chunks
+    template<typename Results>
+    std::size_t stream(std::size_t n_photons, std::size_t result_bytes, const Results &empty,
+                       const ChunkFunction<Results> &chunk,
+                       const std::function<bool(Results &&, std::size_t)> &consumer);
+
+    // Runs chunks [first, first + count) of a run and concatenates their results in chunk order
+    template<typename Results>
+    Results run_chunks(std::uint64_t key, std::size_t n_photons, std::size_t first, std::size_t count,
+                       const Results &empty, const ChunkFunction<Results> &chunk);
+};
+
+// Appends the results of a chunk to those of the chunks before it
+template<typename Result>
+void append_results(std::vector<Result> &results, std::vector<Result> &&chunk) {
+    results.insert(results.end(), std::make_move_iterator(chunk.begin()), std::make_move_iterator(chunk.end()));
+}
+
+inline void append_results(HitBatch &results, HitBatch &&chunk) {
+    results.append(chunk);
+}
+
+template<typename Partial>
+void PhotonEngine::trace_into(std::size_t n_photons, const std::function<Ray(std::size_t)> &source,
+                              std::vector<Partial> &partials,
+                              const std::function<void(Partial &, const Ray &)> &add) {
+    if (partials.size() < pool_.size())
+        throw std::runtime_error("PhotonEngine::trace_into: needs one partial result per thread");
+    const std::size_t n_chunks = (n_photons + chunk_size_ - 1) / chunk_size_;
+    const std::uint64_t key = begin_run();
+
+    pool_.run(n_chunks, [&](unsigned worker, std::size_t c) {
+        const std::size_t begin = c * chunk_size_;
+        const std::size_t end = std::min(n_photons, begin + chunk_size_);
+        random_stream().set_sampling(sampling_);
+        trace_photons(context(worker), key, begin, end, source, [&](std::uint64_t, const Ray &ray) {
+            add(partials[worker], ray);
+        });
+    });
+}
+
+template<typename Result>
+std::vector<Result> PhotonEngine::map(std::size_t n_photons,
+                                      const std::function<std::optional<Result>(MirrorModule &, std::size_t)> &photon) {
+    return map_chunks<Result>(n_photons, [&](MirrorModule &trace_context, std::uint64_t key, std::size_t begin,
+                                             std::size_t end, std::vector<Result> &results) {
+        RandomStream &stream = random_stream();
+        for (std::size_t i = begin; i < end; i++) {
+            stream.begin_photon(key, i);
+            std::optional<Result> result = photon(trace_context, i);
+            if (result)
+                results.push_back(std::move(*result));
+        }
+    });
+}
+
+template<typename Result>
+std::vector<Result> PhotonEngine::map_chunks(std::size_t n_photons, const ChunkFunction<std::vector<Result>> &chunk) {
+    const std::size_t n_chunks = (n_photons + chunk_size_ - 1) / chunk_size_;
+    return run_chunks<std::vector<Result>>(begin_run(), n_photons, 0, n_chunks, {}, chunk);
+}
+
+template<typename Result>
+std::size_t PhotonEngine::stream_chunks(std::size_t n_photons, const ChunkFunction<std::vector<Result>> &chunk,
+                                        const std::function<bool(std::vector<Result> &&, std::size_t)> &consumer) {
+    return stream<std::vector<Result>>(n_photons, sizeof(Result), {}, chunk, consumer);
+}
+
+template<typename Hit>
+void PhotonEngine::trace_photons(MirrorModule &trace_context, std::uint64_t key, std::size_t begin, std::size_t end,
+                                 const std::function<Ray(std::size_t)> &source, const Hit &hit) const {
+    RandomStream &stream = random_stream();
+    std::size_t truncated = 0;
+    if (!wavefront_) {
+        // The hits are handed over right away, so all rays share one slot
+        RayStorage storage = trace_context.ray_storage(1);
+        for (std::size_t i = begin; i < end; i++) {
+            stream.begin_photon(key, i);
+            Ray ray = source(i);
+            storage.bind(ray, 0);
+            const bool on_sensor = trace_context.ray_trace(ray).has_value();
+            truncated += ray.raytracing_history.truncated();
+            if (on_sensor)
+                hit((std::uint64_t) i, ray);
+        }
+        truncated_ += truncated;
+        return;
+    }
+
+    // Generate the whole chunk first, the aperture samples use bounce 0 of every photon's stream
+    RayStorage storage = trace_context.ray_storage(end - begin);
+    std::vector<Ray> rays;
+    rays.reserve(end - begin);
+    for (std::size_t i = begin; i < end; i++) {
+        stream.begin_photon(key, i);
+        rays.push_back(source(i));
+        storage.bind(rays.back(), i - begin);
+    }
+
+    std::vector<char> on_sensor;
+    trace_context.ray_trace_batch(rays, key, begin, on_sensor);
+    for (std::size_t k = 0; k < rays.size(); k++) {
+        truncated += rays[k].raytracing_history.truncated();
+        if (on_sensor[k])
+            hit((std::uint64_t) (begin + k), rays[k]);
+    }
+    truncated_ += truncated;
+}
+
+template<typename Results>
+std::size_t PhotonEngine::stream(std::size_t n_photons, std::size_t result_bytes, const Results &empty,
+                                 const ChunkFunction<Results> &chunk,
+                                 const std::function<bool(Results &&, std::size_t)> &consumer) {
+    const std::size_t n_chunks = (n_photons + chunk_size_ - 1) / chunk_size_;
+    const std::size_t per_batch = batch_chunks(result_bytes);
+    const std::uint64_t key = begin_run();
+    for (std::size_t first = 0; first < n_chunks; first += per_batch) {
+        const std::size_t count = std::min(per_batch, n_chunks - first);
+        Results batch = run_chunks<Results>(key, n_photons, first, count, empty, chunk);
+        const std::size_t done = std::min(n_photons, (first + count) * chunk_size_);
+        if (!consumer(std::move(batch), done))
+            return done;
+    }
+    return n_photons;
+}
+
+template<typename Results>
+Results PhotonEngine::run_chunks(std::uint64_t key, std::size_t n_photons, std::size_t first, std::size_t count,
+                                 const Results &empty, const ChunkFunction<Results> &chunk) {
+    std::vector<Results> chunk_results(count, empty);
+
+    pool_.run(count, [&](unsigned worker, std::size_t c) {
+        const std::size_t begin = (first + c) * chunk_size_;
+        const std::size_t end = std::min(n_photons, begin + chunk_size_);
+        random_stream().set_sampling(sampling_);
+        chunk(context(worker), key, begin, end, chunk_results[c]);
+    });
+
+    std::size_t total = 0;
+    for (const auto &results : chunk_results)
+        total += results.size();
+    Results merged = empty;
+    merged.reserve(total);
+    for (auto &results : chunk_results) {
+        append_results(merged, std::move(results));
+        // Give the chunk back right away, so merging needs little more than the merged batch
+        results = Results(empty);
+    }
+    return merged;
+}
+
+#endif //SIXTE_PHOTONENGINE_H
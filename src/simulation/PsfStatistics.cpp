@@ -0,0 +1,213 @@
+/*
+Copyright (C) 2025  Neo Reinmann (neoreinmann@gmail.com)
+*/
+
+#include "PsfStatistics.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+namespace {
+    constexpr double infinity = std::numeric_limits<double>::infinity();
+
+    // z with P(|N(0,1)| < z) = confidence, by bisection on erf
+    double normal_quantile(double confidence) {
+        double lo = 0, hi = 10;
+        for (int i = 0; i < 100; i++) {
+            const double mid = (lo + hi) / 2;
+            if (std::erf(mid / std::sqrt(2.0)) < confidence)
+                lo = mid;
+            else
+                hi = mid;
+        }
+        return (lo + hi) / 2;
+    }
+}
+
+double Estimate::relative() const {
+    if (value == 0 || !std::isfinite(value) || !std::isfinite(half_width()))
+        return infinity;
+    return half_width() / std::abs(value);
+}
+
+std::optional<PsfStatisticsOptions> PsfStatisticsOptions::from_xml(const XMLData &xml_data) {
+    auto node = xml_data.child("telescope").child("raytracer").optionalChild("statistics");
+    if (!node)
+        return std::nullopt;
+    PsfStatisticsOptions options;
+    options.precision = node->attributeAsDoubleOr("precision", options.precision);
+    options.confidence = node->attributeAsDoubleOr("confidence", options.confidence);
+    const int check_every = node->attributeAsIntOr("check_every", (int) options.check_every);
+    const int min_hits = node->attributeAsIntOr("min_hits", (int) options.min_hits);
+    options.max_radius = node->attributeAsDoubleOr("max_radius", options.max_radius);
+    const int radial_bins = node->attributeAsIntOr("radial_bins", (int) options.radial_bins);
+    if (options.precision <= 0)
+        throw std::runtime_error("statistics: precision must be positive");
+    if (options.confidence <= 0 || options.confidence >= 1)
+        throw std::runtime_error("statistics: confidence must be in (0, 1)");
+    if (check_every <= 0 || min_hits <= 0 || radial_bins <= 0)
+        throw std::runtime_error("statistics: check_every, min_hits and radial_bins must be positive");
+    if (options.max_radius <= 0)
+        throw std::runtime_error("statistics: max_radius must be positive");
+    options.check_every = (std::size_t) check_every;
+    options.min_hits = (std::size_t) min_hits;
+    options.radial_bins = (std::size_t) radial_bins;
+    return options;
+}
+
+PsfStatistics::PsfStatistics(double aperture_area, PsfStatisticsOptions options)
+        : aperture_area_(aperture_area), options_(options), z_(normal_quantile(options.confidence)),
+          radial_(options.radial_bins, 0.0), next_check_(options.check_every) {
+    pending_.reserve(options_.min_hits);
+}
+
+void PsfStatistics::add(double x, double y, double weight) {
+    hits_++;
+    sum_w_ += weight;
+    sum_w2_ += weight * weight;
+    // Weighted Welford update of the centroid
+    const double dx = x - mean_x_;
+    const double dy = y - mean_y_;
+    mean_x_ += weight / sum_w_ * dx;
+    mean_y_ += weight / sum_w_ * dy;
+    m2_x_ += weight * dx * (x - mean_x_);
+    m2_y_ += weight * dy * (y - mean_y_);
+
+    if (centered_) {
+        fill(x, y, weight);
+        return;
+    }
+    pending_.push_back({x, y, weight});
+    if (pending_.size() < options_.min_hits)
+        return;
+    centered_ = true;
+    center_x_ = mean_x_;
+    center_y_ = mean_y_;
+    for (const PendingHit &hit : pending_)
+        fill(hit.x, hit.y, hit.weight);
+    pending_ = {};
+}
+
+void PsfStatistics::fill(double x, double y, double weight) {
+    const double r = std::hypot(x - center_x_, y - center_y_);
+    const double bin = r / options_.max_radius * (double) radial_.size();
+    if (bin < (double) radial_.size())
+        radial_[(std::size_t) bin] += weight;
+    else
+        overflow_ += weight;
+}
+
+bool PsfStatistics::consume(HitBatch &batch, std::size_t photons_done) {
+    if (stopped_) {
+        batch.resize(0);
+        return false;
+    }
+    // Checks every boundary up to end, hits of photons before a boundary are in by then
+    auto check_until = [&](std::size_t end) {
+        while (!stopped_ && next_check_ <= end) {
+            photons_ = next_check_;
+            if (converged())
+                stopped_ = true;
+            else
+                next_check_ += options_.check_every;
+        }
+    };
+
+    std::size_t kept = 0;
+    for (; kept < batch.size(); kept++) {
+        check_until((std::size_t) batch.index[kept]);
+        if (stopped_)
+            break;
+        add(batch.position[kept].x, batch.position[kept].y, batch.weight[kept]);
+    }
+    check_until(photons_done);
+    if (!stopped_)
+        photons_ = photons_done;
+    batch.resize(kept);
+    return !stopped_;
+}
+
+double PsfStatistics::effective_hits() const {
+    return sum_w2_ > 0 ? sum_w_ * sum_w_ / sum_w2_ : 0.0;
+}
+
+Estimate PsfStatistics::centroid(double mean, double m2) const {
+    const double n = effective_hits();
+    if (n < 2)
+        return {mean, -infinity, infinity};
+    const double error = z_ * std::sqrt(m2 / sum_w_ / n);
+    return {mean, mean - error, mean + error};
+}
+
+Estimate PsfStatistics::centroid_x() const {
+    return centroid(mean_x_, m2_x_);
+}
+
+Estimate PsfStatistics::centroid_y() const {
+    return centroid(mean_y_, m2_y_);
+}
+
+Estimate PsfStatistics::effective_area() const {
+    if (photons_ == 0)
+        return {0, 0, infinity};
+    // Mean weight per photon, misses count as 0
+    const double n = (double) photons_;
+    const double mean = sum_w_ / n;
+    const double variance = std::max(0.0, sum_w2_ / n - mean * mean) / n;
+    const double error = z_ * std::sqrt(variance);
+    return {aperture_area_ * mean, aperture_area_ * (mean - error), aperture_area_ * (mean + error)};
+}
+
+double PsfStatistics::quantile_radius(double fraction) const {
+    const double total = sum_w_;
+    if (!centered_ || total <= 0)
+        return infinity;
+    const double target = std::clamp(fraction, 0.0, 1.0) * total;
+    const double bin_width = options_.max_radius / (double) radial_.size();
+    double cumulative = 0;
+    for (std::size_t i = 0; i < radial_.size(); i++) {
+        if (radial_[i] > 0 && cumulative + radial_[i] >= target) {
+            // Linear within the bin
+            return bin_width * ((double) i + (target - cumulative) / radial_[i]);
+        }
+        cumulative += radial_[i];
+    }
+    return target <= cumulative ? options_.max_radius : infinity;
+}
+
+Estimate PsfStatistics::encircled_radius(double fraction) const {
+    const double n = effective_hits();
+    const double error = n > 0 ? z_ * std::sqrt(fraction * (1 - fraction) / n) : 1.0;
+    return {quantile_radius(fraction), quantile_radius(fraction - error), quantile_radius(fraction + error)};
+}
+
+Estimate PsfStatistics::hew() const {
+    const Estimate radius = encircled_radius(0.5);
+    return {2 * radius.value, 2 * radius.lower, 2 * radius.upper};
+}
+
+double PsfStatistics::eef(double radius) const {
+    if (!centered_ || sum_w_ <= 0)
+        return 0;
+    const double bins = radius / options_.max_radius * (double) radial_.size();
+    const std::size_t full = (std::size_t) std::clamp(bins, 0.0, (double) radial_.size());
+    double enclosed = 0;
+    for (std::size_t i = 0; i < full; i++)
+        enclosed += radial_[i];
+    if (full < radial_.size())
+        enclosed += radial_[full] * (bins - (double) full);
+    return enclosed / sum_w_;
+}
+
+bool PsfStatistics::converged() const {
+    if (hits_ < options_.min_hits || !centered_)
+        return false;
+    const Estimate width = hew();
+    const double precision = options_.precision;
+    return width.relative() <= precision
+           && effective_area().relative() <= precision
+           && centroid_x().half_width() <= precision * width.value
+           && centroid_y().half_width() <= precision * width.value;
+}
@@ -0,0 +1,140 @@
+/*
+Copyright (C) 2025  Neo Reinmann (neoreinmann@gmail.com)
+*/
+
+#ifndef SIXTE_PSFSTATISTICS_H
+#define SIXTE_PSFSTATISTICS_H
+
+#include "simulation/HitBatch.h"
+#include "lib/XMLData.h"
+#include <cstddef>
+#include <optional>
+#include <vector>
+
+/**
+ * @brief Value with a confidence interval, see PsfStatisticsOptions::confidence.
+ */
+struct Estimate {
+    double value = 0;
+    double lower = 0;
+    double upper = 0;
+
+    [[nodiscard]] double half_width() const { return (upper - lower) / 2; }
+
+    /**
+     * @brief half_width / |value|, infinite if the value is 0 or not known yet.
+     */
+    [[nodiscard]] double relative() const;
+};
+
+struct PsfStatisticsOptions {
+    double precision = 0.01;            // target relative half width of the confidence intervals
+    double confidence = 0.95;           // confidence level of the intervals
+    std::size_t check_every = 100000;   // photons between two convergence checks
+    std::size_t min_hits = 1000;        // hits before the first check, their centroid centers the radial histogram
+    double max_radius = 20;             // extent of the radial histogram [mm]
+    std::size_t radial_bins = 20000;
+
+    /**
+     * @brief Reads <statistics precision=".." confidence=".." check_every=".." .../> under <raytracer>,
+     * std::nullopt if there is no such element.
+     */
+    static std::optional<PsfStatisticsOptions> from_xml(const XMLData &xml_data);
+};
+
+/**
+ * @brief Streaming estimators of the PSF on the sensor: centroid, encircled energy, half energy width and
+ * effective area, each with a confidence interval.
+ *
+ * Radii are measured from a fixed center, the centroid of the first min_hits hits, in a histogram of
+ * radial_bins bins up to max_radius. Intervals of radii come from the binomial error of the encircled
+ * fraction, the others from the normal approximation of a mean, all with Kish's effective number of
+ * hits so that weighted rays are handled too.
+ */
+class PsfStatistics {
+public:
+    /**
+     * @param aperture_area Area the source photons are drawn from [mm^2], effective area = aperture_area * hits / photons
+     */
+    explicit PsfStatistics(double aperture_area, PsfStatisticsOptions options = {});
+
+    /**
+     * @brief Adds a hit on the sensor at (x, y) [mm].
+     */
+    void add(double x, double y, double weight = 1.0);
+
+    /**
+     * @brief Sets the number of photons traced so far, hits or not.
+     */
+    void set_photons(std::size_t photons) { photons_ = photons; }
+
+    /**
+     * @brief Feeds one batch of PhotonEngine::trace_until. Hits are added in photon order and convergence is
+     * checked at every multiple of check_every photons; once converged, the hits of the photons past that
+     * point are removed from batch, so the result does not depend on the batch size.
+     * @param photons_done Number of photons traced including this batch
+     * @return false once converged, to stop tracing
+     */
+    bool consume(HitBatch &batch, std::size_t photons_done);
+
+    /**
+     * @brief All estimates are within the target precision, the centroid relative to the HEW.
+     */
+    [[nodiscard]] bool converged() const;
+
+    // Set once consume found convergence, photons() is then the photon count it stopped at
+    [[nodiscard]] bool stopped() const { return stopped_; }
+
+    [[nodiscard]] std::size_t photons() const { return photons_; }
+    [[nodiscard]] std::size_t hits() const { return hits_; }
+
+    [[nodiscard]] Estimate centroid_x() const;
+    [[nodiscard]] Estimate centroid_y() const;
+    [[nodiscard]] Estimate effective_area() const;
+
+    /**
+     * @brief Radius around the center that encloses fraction of the hits, infinite beyond max_radius.
+     */
+    [[nodiscard]] Estimate encircled_radius(double fraction) const;
+
+    /**
+     * @brief Half energy width, the diameter enclosing half of the hits.
+     */
+    [[nodiscard]] Estimate hew() const;
+
+    /**
+     * @brief Encircled energy fraction within radius of the center.
+     */
+    [[nodiscard]] double eef(double radius) const;
+
+private:
+    struct PendingHit {
+        double x, y, weight;
+    };
+
+    void fill(double x, double y, double weight);
+    [[nodiscard]] double quantile_radius(double fraction) const;
+    [[nodiscard]] double effective_hits() const;
+    [[nodiscard]] Estimate centroid(double mean, double m2) const;
+
+    double aperture_area_;
+    PsfStatisticsOptions options_;
+    double z_;                          // two sided normal quantile of the confidence level
+
+    std::size_t photons_ = 0;
+    std::size_t hits_ = 0;
+    double sum_w_ = 0, sum_w2_ = 0;
+    double mean_x_ = 0, mean_y_ = 0, m2_x_ = 0, m2_y_ = 0;
+
+    std::vector<PendingHit> pending_;   // hits until the center is fixed
+    bool centered_ = false;
+    double center_x_ = 0, center_y_ = 0;
+    std::vector<double> radial_;
+    double overflow_ = 0;
+
+    std::size_t next_check_;
+    bool stopped_ = false;
+};
+
+
+#endif //SIXTE_PSFSTATISTICS_H
@@ -0,0 +1,86 @@
+/*
+Copyright (C) 2025  Neo Reinmann (neoreinmann@gmail.com)
+*/
+
+#include "Vignetting.h"
+
+#include "output/Fits.h"
+#include <algorithm>
+#include <stdexcept>
+
+std::optional<VignettingOptions> VignettingOptions::from_xml(const XMLData &xml_data) {
+    auto node = xml_data.child("telescope").child("raytracer").optionalChild("vignetting");
+    if (!node)
+        return std::nullopt;
+    VignettingOptions options;
+    const int bins = node->attributeAsIntOr("bins", 100);
+    const int theta_bins = node->attributeAsIntOr("theta_bins", 13);
+    const int phi_bins = node->attributeAsIntOr("phi_bins", 1);
+    const double theta_max = node->attributeAsDoubleOr("theta_max", 30.0);
+    if (bins <= 0 || theta_bins <= 0 || phi_bins <= 0)
+        throw std::runtime_error("vignetting: bins, theta_bins and phi_bins must be positive");
+    if (!(theta_max >= 0) || (theta_bins > 1 && theta_max == 0))
+        throw std::runtime_error("vignetting: theta_max must be positive");
+    options.grid = EnergyGrid::linear(node->attributeAsDoubleOr("e_min", 0.1), node->attributeAsDoubleOr("e_max", 12.0),
+                                      (std::size_t) bins);
+    for (int t = 0; t < theta_bins; t++)
+        options.theta.push_back(theta_bins == 1 ? theta_max : theta_max * t / (theta_bins - 1));
+    for (int p = 0; p < phi_bins; p++)
+        options.phi.push_back(360.0 * p / phi_bins);
+    options.reflectivity = node->attributeAsDoubleOr("reflectivity", options.reflectivity);
+    if (options.reflectivity < 0 || options.reflectivity > 1)
+        throw std::runtime_error("vignetting: reflectivity must be in [0, 1]");
+    options.filename = node->attributeAsStringOr("filename", options.filename);
+    options.telescope = xml_data.root().attributeAsStringOr("telescop", "");
+    options.instrument = xml_data.root().attributeAsStringOr("instrume", "");
+    return options;
+}
+
+VignettingMap::VignettingMap(const VignettingOptions &options)
+        : options_(&options), area_(options.grid.size() * options.theta.size() * options.phi.size(), 0.0),
+          on_axis_(options.grid.size(), 0.0) {}
+
+void VignettingMap::set(std::size_t t, std::size_t p, const std::vector<double> &area) {
+    const std::size_t energies = options_->grid.size();
+    if (area.size() != energies || t >= options_->theta.size() || p >= options_->phi.size())
+        throw std::runtime_error("VignettingMap: area or angle out of range");
+    std::copy(area.begin(), area.end(), area_.begin() + (std::ptrdiff_t) ((p * options_->theta.size() + t) * energies));
+}
+
+std::vector<double> VignettingMap::vignetting() const {
+    const std::size_t energies = options_->grid.size();
+    std::vector<double> result(area_.size(), 0.0);
+    for (std::size_t i = 0; i < area_.size(); i++) {
+        const double on_axis = on_axis_[i % energies];
+        result[i] = on_axis > 0 ? area_[i] / on_axis : 0.0;
+    }
+    return result;
+}
+
+void VignettingMap::write_fits(const std::string &path) const {
+    const std::size_t energies = options_->grid.size();
+    const std::size_t thetas = options_->theta.size();
+    const std::size_t phis = options_->phi.size();
+    std::vector<double> theta_deg;
+    for (double theta : options_->theta)
+        theta_deg.push_back(theta / 60);
+    const std::vector<double> vignet = vignetting();
+
+    FitsTable table;
+    table.extname = "VIGNET";
+    table.columns = {{"ENERG_LO", "keV", &options_->grid.lo, energies},
+                     {"ENERG_HI", "keV", &options_->grid.hi, energies},
+                     {"THETA", "deg", &theta_deg, thetas},
+                     {"PHI", "deg", &options_->phi, phis},
+                     {"VIGNET", "", &vignet, vignet.size(),
+                      "(" + std::to_string(energies) + "," + std::to_string(thetas) + "," + std::to_string(phis) + ")"}};
+    const std::string &telescope = options_->telescope, &instrument = options_->instrument;
+    table.cards = {FitsCard::string("TELESCOP", telescope.empty() ? "UNKNOWN" : telescope, "mission name"),
+                   FitsCard::string("INSTRUME", instrument.empty() ? "UNKNOWN" : instrument, "instrument name"),
+                   FitsCard::string("HDUCLASS", "OGIP", "format conforms to OGIP standard"),
+                   FitsCard::string("HDUCLAS1", "RESPONSE"),
+                   FitsCard::string("HDUCLAS2", "VIGNET"),
+                   FitsCard::string("HDUVERS", "1.0.0"),
+                   FitsCard::string("CREATOR", "raytracing", "telescope_simulation_tool")};
+    write_fits_tables(path, {}, {table});
+}
@@ -0,0 +1,65 @@
+/*
+Copyright (C) 2025  Neo Reinmann (neoreinmann@gmail.com)
+*/
+
+#ifndef SIXTE_VIGNETTING_H
+#define SIXTE_VIGNETTING_H
+
+#include "EffectiveArea.h"
+#include "lib/XMLData.h"
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <vector>
+
+struct VignettingOptions {
+    EnergyGrid grid;
+    std::vector<double> theta;      // off-axis angles [arcmin], from 0 to theta_max
+    std::vector<double> phi;        // azimuths [deg], equally spaced in [0, 360)
+    double reflectivity = 1.0;      // constant reflectivity of every mirror without <reflectivity/>
+    std::string filename = "vignetting.fits";
+    std::string telescope, instrument;
+
+    /**
+     * @brief Reads <vignetting theta_max=".." theta_bins=".." phi_bins=".." e_min=".." e_max=".." bins=".."
+     * reflectivity=".." filename=".."/> under <raytracer>, std::nullopt if there is no such element.
+     */
+    static std::optional<VignettingOptions> from_xml(const XMLData &xml_data);
+};
+
+/**
+ * @brief Effective area over energy x off-axis angle x azimuth, and the vignetting function from it.
+ */
+class VignettingMap {
+public:
+    explicit VignettingMap(const VignettingOptions &options);
+
+    /**
+     * @brief Sets the effective area per energy bin at theta[t], phi[p].
+     */
+    void set(std::size_t t, std::size_t p, const std::vector<double> &area);
+
+    /**
+     * @brief Sets the on-axis effective area per energy bin that the map is normalised to.
+     */
+    void set_on_axis(const std::vector<double> &area) { on_axis_ = area; }
+
+    /**
+     * @brief area / on-axis area, energy fastest then theta then phi, 0 where the on-axis area is 0.
+     */
+    [[nodiscard]] std::vector<double> vignetting() const;
+
+    /**
+     * @brief Writes the VIGNET binary table SIXTE reads: one row with the vector columns ENERG_LO,
+     * ENERG_HI [keV], THETA, PHI [deg] and VIGNET with TDIM (energies, thetas, phis).
+     */
+    void write_fits(const std::string &path) const;
+
+private:
+    const VignettingOptions *options_;
+    std::vector<double> area_;      // energy fastest, then theta, then phi
+    std::vector<double> on_axis_;
+};
+
+
+#endif //SIXTE_VIGNETTING_H
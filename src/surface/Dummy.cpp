@@ -4,7 +4,7 @@ Copyright (C) 2025  Neo Reinmann (neoreinmann@gmail.com)
 
 #include "Dummy.h"
 
-bool Dummy::simulate_surface([[maybe_unused]] Ray &ray) const {
+bool Dummy::simulate_surface([[maybe_unused]] Ray &ray, [[maybe_unused]] const Weighting &weighting) const {
     return true;
 }
 
@@ -11,7 +11,8 @@ class Dummy final : public SurfaceStrategy {
 public:
     explicit Dummy() {};
     ~Dummy() override = default;
-    bool simulate_surface(Ray &ray) const override;
+    [[nodiscard]] std::unique_ptr<SurfaceStrategy> clone() const override { return std::make_unique<Dummy>(*this); }
+    bool simulate_surface(Ray &ray, const Weighting &weighting) const override;
     void set_surface_parameter(std::string model, std::string shadowing, double factor, double shadowing_factor) override;
 };
 
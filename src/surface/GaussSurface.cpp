@@ -5,7 +5,7 @@ Copyright (C) 2025  Neo Reinmann (neoreinmann@gmail.com)
 #include "GaussSurface.h"
 
 
-bool GaussSurface::simulate_surface(Ray &ray) const
+bool GaussSurface::simulate_surface(Ray &ray, [[maybe_unused]] const Weighting &weighting) const
 {
     Vec3fa new_normal ={static_cast<float>(ray.normal().x + ray.normal().x * factor_ * easy_uniform_random()),
                static_cast<float>(ray.normal().y + ray.normal().y * factor_ * easy_uniform_random()),
@@ -14,7 +14,8 @@ class GaussSurface final : public SurfaceStrategy {
 public:
     explicit GaussSurface(const double factor) : factor_(factor) {};
     ~GaussSurface() override = default;
-    bool simulate_surface(Ray &ray) const override;
+    [[nodiscard]] std::unique_ptr<SurfaceStrategy> clone() const override { return std::make_unique<GaussSurface>(*this); }
+    bool simulate_surface(Ray &ray, const Weighting &weighting) const override;
     void set_surface_parameter(std::string model, std::string shadowing, double factor, double shadowing_factor) override;
 private:
     double factor_;
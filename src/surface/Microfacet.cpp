@@ -9,7 +9,7 @@ Copyright (C) 2025  Neo Reinmann (neoreinmann@gmail.com)
 Microfacet::Microfacet(double palpha, double palpha_shadowing, bool pggx, bool pggx_shadowing) :
 alpha(palpha), alpha_shadowing(palpha_shadowing), ggx(pggx), ggx_shadowing(pggx_shadowing) {}
 
-bool Microfacet::simulate_surface(Ray & ray) const {
+bool Microfacet::simulate_surface(Ray & ray, const Weighting &weighting) const {
     const Vec3fa z(0.0f, 0.0f, 1.0f);
     const Vec3fa n = normalize(ray.normal());
     float c = dot(n, z);                   // cos(theta)
@@ -37,7 +37,8 @@ bool Microfacet::simulate_surface(Ray & ray) const {
     } else {
         prob_shadowing = beckmann_shadowing_term(outcoming, m);
     }
-    if (easy_uniform_random() > prob_shadowing * prob_masking) {
+    // Shadowed or masked by the neighbouring microfacets
+    if (!weighting.survives(ray, prob_shadowing * prob_masking)) {
         return false;
     }
     m = apply_rodrigues_rotation(axis, m, -theta);
@@ -47,8 +48,7 @@ bool Microfacet::simulate_surface(Ray & ray) const {
 }
 
 Vec3fa Microfacet::get_gxx_m() const {
-    double xi_1 = easy_uniform_random();
-    double xi_2 = easy_uniform_random();
+    const auto [xi_1, xi_2] = random_stream().uniform2();
     double theta_m = atan((alpha * sqrt(xi_1))/ sqrt(1 - xi_1));
     double phi_m = 2*M_PI*xi_2;
     return {(float) (sin(theta_m) * cos(phi_m)), (float) (sin(theta_m) * sin(phi_m)), (float) cos(theta_m)};
@@ -64,8 +64,7 @@ double Microfacet::positive_characteristic_function(double a) {
 }
 
 Vec3fa Microfacet::get_beckmann_m() const {
-    double xi_1 = easy_uniform_random();
-    double xi_2 = easy_uniform_random();
+    const auto [xi_1, xi_2] = random_stream().uniform2();
     double theta_m = atan(sqrt(-pow(alpha, 2) * log(1 - xi_1)));
     double phi_m = 2*M_PI*xi_2;
     return {(float) (sin(theta_m) * cos(phi_m)), (float) (sin(theta_m) * sin(phi_m)), (float) cos(theta_m)};
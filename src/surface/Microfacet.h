@@ -17,7 +17,8 @@ public:
     explicit Microfacet() {};
     explicit Microfacet(double palpha, double palpha_shadowing, bool pggx, bool pggx_shadowing);
     ~Microfacet() override = default;
-    bool simulate_surface(Ray & ray) const override;
+    [[nodiscard]] std::unique_ptr<SurfaceStrategy> clone() const override { return std::make_unique<Microfacet>(*this); }
+    bool simulate_surface(Ray & ray, const Weighting &weighting) const override;
     void set_surface_parameter(std::string model, std::string shadowing, double factor, double shadowing_factor) override;
 private:
 
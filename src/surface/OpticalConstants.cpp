@@ -0,0 +1,96 @@
+/*
+Copyright (C) 2025  Neo Reinmann (neoreinmann@gmail.com)
+*/
+
+#include "OpticalConstants.h"
+
+#include "output/Fits.h"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <map>
+#include <stdexcept>
+
+namespace {
+    constexpr double classical_electron_radius = 2.8179403262e-15;  // [m]
+    constexpr double planck_times_c = 1.23984198e-9;                // [keV m]
+    constexpr double avogadro = 6.02214076e23;                      // [1/mol]
+
+    struct Element {
+        double density;         // [g/cm^3]
+        double atomic_weight;   // [g/mol]
+    };
+
+    // Bulk values of the usual coating and substrate elements, for files without DENSITY and ATOMWT
+    const std::map<std::string, Element> &known_elements() {
+        static const std::map<std::string, Element> elements = {
+                {"AL", {2.699, 26.982}}, {"AU", {19.32, 196.967}}, {"C", {2.2, 12.011}},
+                {"CR", {7.19, 51.996}}, {"IR", {22.56, 192.217}}, {"MO", {10.28, 95.95}},
+                {"NI", {8.908, 58.693}}, {"PD", {12.02, 106.42}}, {"PT", {21.45, 195.084}},
+                {"SI", {2.329, 28.085}}, {"TI", {4.506, 47.867}}, {"W", {19.25, 183.84}},
+        };
+        return elements;
+    }
+
+    std::string upper(std::string text) {
+        std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c) { return (char) std::toupper(c); });
+        return text;
+    }
+}
+
+OpticalConstants::OpticalConstants(std::string name, std::vector<double> energies, std::vector<double> f1,
+                                   std::vector<double> f2, double density, double atomic_weight)
+        : name_(std::move(name)), f1_(std::move(f1)), f2_(std::move(f2)), density_(density) {
+    if (energies.size() < 2 || energies.size() != f1_.size() || energies.size() != f2_.size())
+        throw std::runtime_error("OpticalConstants " + name_ + ": need f1 and f2 at two or more energies");
+    if (!(density > 0) || !(atomic_weight > 0))
+        throw std::runtime_error("OpticalConstants " + name_ + ": density and atomic weight must be positive");
+    log_energies_.reserve(energies.size());
+    for (std::size_t i = 0; i < energies.size(); i++) {
+        if (!(energies[i] > 0) || (i > 0 && !(energies[i] > energies[i - 1])))
+            throw std::runtime_error("OpticalConstants " + name_ + ": energies must be positive and ascending");
+        log_energies_.push_back(std::log(energies[i]));
+    }
+    // g/cm^3 -> g/m^3
+    atoms_per_volume_ = density * 1e6 / atomic_weight * avogadro;
+}
+
+OpticalConstants OpticalConstants::from_fits(const std::string &path, const std::string &material, double density) {
+    const FitsTableData table = read_fits_table(path, material);
+
+    std::string energy_column = table.columns.count("ENERGY") ? "ENERGY" : "E";
+    std::vector<double> energies = table.column(energy_column);
+    auto unit = table.units.find(energy_column);
+    if (unit == table.units.end() || upper(unit->second) != "KEV")
+        for (double &energy : energies)
+            energy /= 1000;
+
+    double atomic_weight = table.number("ATOMWT").value_or(0);
+    double table_density = table.number("DENSITY").value_or(0);
+    auto known = known_elements().find(upper(material));
+    if (known != known_elements().end()) {
+        if (atomic_weight <= 0)
+            atomic_weight = known->second.atomic_weight;
+        if (table_density <= 0)
+            table_density = known->second.density;
+    }
+    if (atomic_weight <= 0 || (density <= 0 && table_density <= 0))
+        throw std::runtime_error("OpticalConstants: " + path + " gives no density or atomic weight for " + material);
+    return {upper(material), std::move(energies), table.column("F1"), table.column("F2"),
+            density > 0 ? density : table_density, atomic_weight};
+}
+
+std::complex<double> OpticalConstants::refractive_index(double energy) const {
+    const double log_energy = std::clamp(std::log(energy), log_energies_.front(), log_energies_.back());
+    const auto upper_it = std::upper_bound(log_energies_.begin() + 1, log_energies_.end() - 1, log_energy);
+    const auto i = (std::size_t) (upper_it - log_energies_.begin()) - 1;
+    const double t = (log_energy - log_energies_[i]) / (log_energies_[i + 1] - log_energies_[i]);
+    const double f1 = f1_[i] + t * (f1_[i + 1] - f1_[i]);
+    const double f2 = f2_[i] + t * (f2_[i + 1] - f2_[i]);
+
+    const double wavelength = planck_times_c / std::clamp(energy, std::exp(log_energies_.front()),
+                                                          std::exp(log_energies_.back()));
+    const double factor = classical_electron_radius * wavelength * wavelength / (2 * M_PI) * atoms_per_volume_;
+    // delta = factor * f1, beta = factor * f2
+    return {1 - factor * f1, factor * f2};
+}
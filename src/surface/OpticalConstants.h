@@ -0,0 +1,54 @@
+/*
+Copyright (C) 2025  Neo Reinmann (neoreinmann@gmail.com)
+*/
+
+#ifndef SIXTE_OPTICALCONSTANTS_H
+#define SIXTE_OPTICALCONSTANTS_H
+
+#include <complex>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Atomic scattering factors f1, f2 of one element over energy, and its refractive index
+ * n = 1 - delta + i beta from them (Henke et al. 1993).
+ */
+class OpticalConstants {
+public:
+    OpticalConstants() = default;
+
+    /**
+     * @param energies Tabulated energies [keV], ascending
+     * @param density [g/cm^3]
+     * @param atomic_weight [g/mol]
+     */
+    OpticalConstants(std::string name, std::vector<double> energies, std::vector<double> f1, std::vector<double> f2,
+                     double density, double atomic_weight);
+
+    /**
+     * @brief Reads the binary table named material from an AtomicScatteringFactors file.
+     *
+     * The table has an energy column (ENERGY or E, eV unless TUNIT says keV) and columns F1 and F2.
+     * Density and atomic weight come from the keywords DENSITY and ATOMWT, else from a built-in list of
+     * common coating elements. density > 0 overrides the density, e.g. for sputtered films.
+     */
+    static OpticalConstants from_fits(const std::string &path, const std::string &material, double density = 0);
+
+    /**
+     * @brief Complex refractive index at energy [keV], f1 and f2 interpolated linearly in log energy.
+     * Clamped to the tabulated range.
+     */
+    [[nodiscard]] std::complex<double> refractive_index(double energy) const;
+
+    [[nodiscard]] const std::string &name() const { return name_; }
+    [[nodiscard]] double density() const { return density_; }
+
+private:
+    std::string name_;
+    std::vector<double> log_energies_, f1_, f2_;
+    double density_ = 0;
+    double atoms_per_volume_ = 0;   // [1/m^3]
+};
+
+
+#endif //SIXTE_OPTICALCONSTANTS_H
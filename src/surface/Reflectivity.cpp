@@ -0,0 +1,20 @@
+/*
+Copyright (C) 2025  Neo Reinmann (neoreinmann@gmail.com)
+*/
+
+#include "Reflectivity.h"
+
+bool CoatingContext::apply(Ray &ray, const Weighting &weighting) const {
+    const float grazing_angle = GrazingAngles::between(ray.direction(), ray.normal());
+    if (grazing_angles)
+        ray.grazing_angles.record(grazing_angle);
+    if (reflectivity == nullptr)
+        return true;
+    // The spectral mode keeps the ray and records the loss at every energy instead
+    if (spectrum != nullptr) {
+        reflectivity->attenuate(ray.spectral_weights, *spectrum, grazing_angle);
+        return true;
+    }
+    // Absorbed with probability 1 - R, ray energies are in eV
+    return weighting.survives(ray, reflectivity->reflectivity(ray.energy / 1000, grazing_angle));
+}
@@ -0,0 +1,76 @@
+/*
+Copyright (C) 2025  Neo Reinmann (neoreinmann@gmail.com)
+*/
+
+#ifndef SIXTE_REFLECTIVITY_H
+#define SIXTE_REFLECTIVITY_H
+
+#include "geometry/Ray.h"
+#include "geometry/SpectralWeights.h"
+#include "surface/Weighting.h"
+#include <vector>
+
+class SurfaceModel;
+
+/**
+ * @brief Reflectivity of a mirror coating as function of photon energy and grazing angle.
+ * Evaluated per reflection, so implementations should be cheap and thread safe (const).
+ */
+class Reflectivity {
+public:
+    virtual ~Reflectivity() = default;
+
+    /**
+     * @param energy Photon energy [keV]
+     * @param grazing_angle Angle between ray and surface [rad]
+     * @return Reflected fraction in [0, 1]
+     */
+    [[nodiscard]] virtual double reflectivity(double energy, double grazing_angle) const = 0;
+
+    /**
+     * @brief Multiplies weights[k] by the reflectivity at energies[k] [keV], one reflection of the spectral mode.
+     */
+    void attenuate(SpectralWeights &weights, const std::vector<double> &energies, double grazing_angle) const {
+        for (std::size_t k = 0; k < weights.size(); k++)
+            weights[k] *= (float) reflectivity(energies[k], grazing_angle);
+    }
+};
+
+/**
+ * @brief Same reflectivity at every energy and angle, 1 is a perfect mirror.
+ */
+class ConstantReflectivity final : public Reflectivity {
+public:
+    explicit ConstantReflectivity(double value = 1.0) : value_(value) {}
+
+    [[nodiscard]] double reflectivity([[maybe_unused]] double energy, [[maybe_unused]] double grazing_angle) const override {
+        return value_;
+    }
+
+private:
+    double value_;
+};
+
+/**
+ * @brief Coating and surface a trace applies at every reflection, and what the reflections record. Kept per trace
+ * context (MirrorModule clone) and handed to the shared scene with every trace, so replacing them on one context
+ * leaves the others alone.
+ */
+struct CoatingContext {
+    const Reflectivity *reflectivity = nullptr;     // nullptr for lossless reflections
+    const std::vector<double> *spectrum = nullptr;  // energies of the spectral mode [keV], nullptr outside it
+    bool grazing_angles = false;                    // record every grazing angle in Ray::grazing_angles
+    const SurfaceModel *surface = nullptr;          // roughness of the mirrors, nullptr for ideal ones
+    bool blocker_prepass = false;                   // drop rays a blocker stops before the mirrors up front
+
+    /**
+     * @brief Applies the coating to a ray reflecting at its normal: records the grazing angle if asked to and
+     * either absorbs the ray with probability 1 - R (through weighting) or, in the spectral mode, multiplies
+     * its weights by R at every energy. Leaves position and direction alone.
+     * @return False if the ray was absorbed
+     */
+    bool apply(Ray &ray, const Weighting &weighting) const;
+};
+
+
+#endif //SIXTE_REFLECTIVITY_H
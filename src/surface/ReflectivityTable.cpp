@@ -0,0 +1,122 @@
+/*
+Copyright (C) 2025  Neo Reinmann (neoreinmann@gmail.com)
+*/
+
+#include "ReflectivityTable.h"
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <stdexcept>
+
+namespace {
+    constexpr double planck_times_c = 1.23984198;   // [keV nm]
+
+    // Refractive indices of one energy, from the top layer down to the substrate
+    std::vector<std::complex<double>> indices(const Coating &coating, double energy) {
+        std::vector<std::complex<double>> n;
+        n.reserve(coating.layers.size() + 1);
+        for (const CoatingLayer &layer : coating.layers)
+            n.push_back(layer.material.refractive_index(energy));
+        n.push_back(coating.substrate.refractive_index(energy));
+        return n;
+    }
+
+    // Parratt recursion from the substrate up, n[j] is the medium below interface j, vacuum above interface 0
+    double parratt(const Coating &coating, const std::vector<std::complex<double>> &n, double energy, double angle) {
+        const double k = 2 * M_PI * energy / planck_times_c;    // [1/nm]
+        const double cos2 = std::cos(angle) * std::cos(angle);
+        const std::size_t n_layers = coating.layers.size();
+
+        std::complex<double> kz_below = k * std::sqrt(n[n_layers] * n[n_layers] - cos2);
+        std::complex<double> reflected = 0;     // nothing comes back from inside the substrate
+        for (std::size_t j = n_layers + 1; j-- > 0;) {
+            const std::complex<double> kz_above = j == 0 ? std::complex<double>(k * std::sin(angle))
+                                                         : k * std::sqrt(n[j - 1] * n[j - 1] - cos2);
+            const double roughness = j == n_layers ? coating.substrate_roughness : coating.layers[j].roughness;
+            std::complex<double> r = (kz_above - kz_below) / (kz_above + kz_below);
+            if (roughness > 0)
+                r *= std::exp(-2.0 * kz_above * kz_below * roughness * roughness);
+            // Phase across the medium below, the substrate has no thickness but reflects nothing from below
+            const std::complex<double> phase = j == n_layers ? std::complex<double>(0)
+                                                             : std::exp(std::complex<double>(0, 2) * kz_below *
+                                                                        coating.layers[j].thickness);
+            reflected = (r + reflected * phase) / (1.0 + r * reflected * phase);
+            kz_below = kz_above;
+        }
+        return std::norm(reflected);
+    }
+}
+
+double Coating::reflectivity(double energy, double grazing_angle) const {
+    return parratt(*this, indices(*this, energy), energy, grazing_angle);
+}
+
+ReflectivityTable::ReflectivityTable(const Coating &coating, const ReflectivityGrid &grid) : grid_(grid) {
+    if (grid.energies < 2 || grid.angles < 2 || !(grid.e_min > 0) || !(grid.e_max > grid.e_min) || !(grid.max_angle > 0))
+        throw std::runtime_error("ReflectivityTable: need 0 < e_min < e_max, max_angle > 0 and two or more energies and angles");
+    energy_step_ = (grid.e_max - grid.e_min) / (double) (grid.energies - 1);
+    angle_step_ = grid.max_angle * M_PI / 180 / (double) (grid.angles - 1);
+
+    table_.resize(grid.energies * grid.angles);
+    for (std::size_t e = 0; e < grid.energies; e++) {
+        const double energy = grid.e_min + energy_step_ * (double) e;
+        const auto n = indices(coating, energy);
+        for (std::size_t a = 0; a < grid.angles; a++)
+            table_[e * grid.angles + a] = (float) parratt(coating, n, energy, angle_step_ * (double) a);
+    }
+}
+
+double ReflectivityTable::reflectivity(double energy, double grazing_angle) const {
+    const double u = std::clamp((energy - grid_.e_min) / energy_step_, 0.0, (double) (grid_.energies - 1));
+    const double v = std::clamp(grazing_angle / angle_step_, 0.0, (double) (grid_.angles - 1));
+    const std::size_t e = std::min((std::size_t) u, grid_.energies - 2);
+    const std::size_t a = std::min((std::size_t) v, grid_.angles - 2);
+    const double s = u - (double) e, t = v - (double) a;
+
+    const float *row = table_.data() + e * grid_.angles + a;
+    const float *next = row + grid_.angles;
+    return (1 - s) * ((1 - t) * row[0] + t * row[1]) + s * ((1 - t) * next[0] + t * next[1]);
+}
+
+std::shared_ptr<const ReflectivityTable> ReflectivityTable::from_xml(const XMLData &xml_data) {
+    const auto raytracing = xml_data.child("telescope").child("raytracer");
+    auto node = raytracing.optionalChild("reflectivity");
+    if (!node)
+        return nullptr;
+    const auto surface = raytracing.child("surface");
+    const std::string material_path = surface.attributeAsString("material_path");
+
+    ReflectivityGrid grid;
+    grid.e_min = node->attributeAsDoubleOr("e_min", grid.e_min);
+    grid.e_max = node->attributeAsDoubleOr("e_max", grid.e_max);
+    grid.max_angle = node->attributeAsDoubleOr("max_angle", grid.max_angle);
+    const int energies = node->attributeAsIntOr("energies", (int) grid.energies);
+    const int angles = node->attributeAsIntOr("angles", (int) grid.angles);
+    if (energies < 2 || angles < 2)
+        throw std::runtime_error("reflectivity: energies and angles must be at least 2");
+    grid.energies = (std::size_t) energies;
+    grid.angles = (std::size_t) angles;
+
+    // Every material is read from the file once, however many layers use it
+    std::map<std::string, OpticalConstants> materials;
+    auto material = [&](const std::string &name, double density) {
+        const std::string key = name + "@" + std::to_string(density);
+        auto it = materials.find(key);
+        if (it == materials.end())
+            it = materials.emplace(key, OpticalConstants::from_fits(material_path, name, density)).first;
+        return it->second;
+    };
+
+    Coating coating;
+    coating.substrate = material(surface.attributeAsString("material"), node->attributeAsDoubleOr("density", 0));
+    coating.substrate_roughness = node->attributeAsDoubleOr("roughness", 0);
+    for (const XMLNode &layer : node->children("layer")) {
+        const double thickness = layer.attributeAsDouble("thickness");
+        if (!(thickness > 0))
+            throw std::runtime_error("reflectivity: layer thickness must be positive");
+        coating.layers.push_back({material(layer.attributeAsString("material"), layer.attributeAsDoubleOr("density", 0)),
+                                  thickness, layer.attributeAsDoubleOr("roughness", 0)});
+    }
+    return std::make_shared<const ReflectivityTable>(coating, grid);
+}
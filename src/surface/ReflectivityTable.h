@@ -0,0 +1,80 @@
+/*
+Copyright (C) 2025  Neo Reinmann (neoreinmann@gmail.com)
+*/
+
+#ifndef SIXTE_REFLECTIVITYTABLE_H
+#define SIXTE_REFLECTIVITYTABLE_H
+
+#include "Reflectivity.h"
+#include "OpticalConstants.h"
+#include "lib/XMLData.h"
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+/**
+ * @brief One film of a coating, from the top.
+ */
+struct CoatingLayer {
+    OpticalConstants material;
+    double thickness = 0;   // [nm]
+    double roughness = 0;   // rms of the top of the layer [nm]
+};
+
+/**
+ * @brief Coating on a substrate: no layers is a bare mirror, one layer an overcoat, many a multilayer.
+ */
+struct Coating {
+    std::vector<CoatingLayer> layers;
+    OpticalConstants substrate;
+    double substrate_roughness = 0;     // rms of the top of the substrate [nm]
+
+    /**
+     * @brief Exact reflectivity by Parratt recursion, with Nevot-Croce roughness factors. Unpolarised,
+     * s and p coincide to well below a percent at grazing incidence, so the s reflectivity is returned.
+     * @param energy [keV]
+     * @param grazing_angle [rad]
+     */
+    [[nodiscard]] double reflectivity(double energy, double grazing_angle) const;
+};
+
+/**
+ * @brief Energy and grazing angle grid of a ReflectivityTable, both equally spaced.
+ */
+struct ReflectivityGrid {
+    double e_min = 0.05, e_max = 15;    // [keV]
+    std::size_t energies = 1500;
+    double max_angle = 3;               // [deg], the grid starts at 0
+    std::size_t angles = 600;
+};
+
+/**
+ * @brief Reflectivity of a coating tabulated once on an energy x grazing angle grid and looked up with
+ * bilinear interpolation, cheap enough to be evaluated at every reflection.
+ *
+ * Energies and angles outside the grid are clamped to its edges.
+ */
+class ReflectivityTable final : public Reflectivity {
+public:
+    ReflectivityTable(const Coating &coating, const ReflectivityGrid &grid);
+
+    /**
+     * @brief Table of the <reflectivity/> element under <raytracer>, nullptr if there is none.
+     *
+     * The substrate is material of <surface> from its material_path, <layer material thickness
+     * [density] [roughness]/> children put films on top, the first one outermost.
+     */
+    static std::shared_ptr<const ReflectivityTable> from_xml(const XMLData &xml_data);
+
+    [[nodiscard]] double reflectivity(double energy, double grazing_angle) const override;
+
+    [[nodiscard]] const ReflectivityGrid &grid() const { return grid_; }
+
+private:
+    ReflectivityGrid grid_;
+    double energy_step_, angle_step_;   // [keV], [rad]
+    std::vector<float> table_;          // row per energy, grid_.angles values per row
+};
+
+
+#endif //SIXTE_REFLECTIVITYTABLE_H
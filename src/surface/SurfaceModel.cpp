@@ -5,9 +5,9 @@ Copyright (C) 2025  Neo Reinmann (neoreinmann@gmail.com)
 #include "SurfaceModel.h"
 
 
-bool SurfaceModel::simulate_surface(Ray &ray) const
+bool SurfaceModel::simulate_surface(Ray &ray, const Weighting &weighting) const
 {
-    return surface_strategy_->simulate_surface(ray);
+    return surface_strategy_->simulate_surface(ray, weighting);
 }
 
 void
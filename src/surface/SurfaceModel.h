@@ -15,7 +15,9 @@ class SurfaceModel {
 public:
     explicit SurfaceModel(std::unique_ptr<SurfaceStrategy> surface_strategy)
         : surface_strategy_(std::move(surface_strategy)) {}
-    bool simulate_surface(Ray &ray) const;
+    // Deep copy, set_surface_parameter on the copy leaves the original alone
+    SurfaceModel(const SurfaceModel &other) : surface_strategy_(other.surface_strategy_->clone()) {}
+    bool simulate_surface(Ray &ray, const Weighting &weighting) const;
     void set_surface_parameter(std::string model, std::string shadowing, double factor, double shadowing_factor);
 private:
     std::unique_ptr<SurfaceStrategy> surface_strategy_;
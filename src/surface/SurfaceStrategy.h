@@ -6,13 +6,19 @@ Copyright (C) 2025  Neo Reinmann (neoreinmann@gmail.com)
 #define SURFACESTRATEGY_H
 
 #include "geometry/Ray.h"
+#include "Weighting.h"
+#include <memory>
 #include <optional>
 
 
 class SurfaceStrategy {
 public:
     virtual ~SurfaceStrategy() = default;
-    virtual bool simulate_surface(Ray & ray) const = 0;
+    /**
+     * @brief Applies the surface to the ray at its hit, losses go through weighting. false if the ray is lost.
+     */
+    virtual bool simulate_surface(Ray & ray, const Weighting &weighting) const = 0;
+    [[nodiscard]] virtual std::unique_ptr<SurfaceStrategy> clone() const = 0;
     virtual void set_surface_parameter(std::string model, std::string shadowing, double factor, double shadowing_factor) = 0;
 };
 
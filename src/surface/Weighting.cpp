@@ -0,0 +1,35 @@
+/*
+Copyright (C) 2025  Neo Reinmann (neoreinmann@gmail.com)
+*/
+
+#include "Weighting.h"
+
+#include "lib/random.h"
+#include <stdexcept>
+
+Weighting Weighting::from_xml(const XMLData &xml_data) {
+    auto details = xml_data.child("telescope").child("raytracer").child("simulation_details");
+    Weighting weighting;
+    const std::string mode = details.attributeAsStringOr("weighting", "analog");
+    if (mode != "analog" && mode != "weighted")
+        throw std::runtime_error("simulation_details: weighting must be analog or weighted, not " + mode);
+    weighting.weighted = mode == "weighted";
+    weighting.roulette = details.attributeAsDoubleOr("roulette", weighting.roulette);
+    if (weighting.roulette < 0 || weighting.roulette > 1)
+        throw std::runtime_error("simulation_details: roulette must be in [0, 1]");
+    return weighting;
+}
+
+bool Weighting::survives(Ray &ray, double probability) const {
+    if (!weighted)
+        return random_stream().uniform() < probability;
+    ray.weight *= probability;
+    if (!(ray.weight > 0))
+        return false;
+    if (ray.weight >= roulette)
+        return true;
+    if (random_stream().uniform() * roulette >= ray.weight)
+        return false;
+    ray.weight = roulette;
+    return true;
+}
@@ -0,0 +1,35 @@
+/*
+Copyright (C) 2025  Neo Reinmann (neoreinmann@gmail.com)
+*/
+
+#ifndef SIXTE_WEIGHTING_H
+#define SIXTE_WEIGHTING_H
+
+#include "geometry/Ray.h"
+#include "lib/XMLData.h"
+
+/**
+ * @brief How surface losses are applied to a ray, from simulation_details.
+ *
+ * Analog: the ray survives a loss of probability p with probability p, its weight stays 1.
+ * Weighted: the ray always survives, its weight is multiplied by p. Below roulette it plays Russian
+ * roulette, it survives with probability weight / roulette at weight roulette, so the mean is kept.
+ */
+struct Weighting {
+    bool weighted = false;
+    double roulette = 0.1;
+
+    /**
+     * @brief Reads weighting="analog|weighted" and roulette=".." of <simulation_details>.
+     */
+    static Weighting from_xml(const XMLData &xml_data);
+
+    /**
+     * @brief Applies a loss the ray survives with probability, drawing from the photon's stream of the
+     * current bounce. false if the ray is gone.
+     */
+    bool survives(Ray &ray, double probability) const;
+};
+
+
+#endif //SIXTE_WEIGHTING_H
@@ -0,0 +1,368 @@
+/*
+Copyright (C) 2025  Neo Reinmann (neoreinmann@gmail.com)
+*/
+
+// End-to-end throughput benchmark: traces synthetic Wolter modules of N shells and a synthetic lobster eye optic
+// for a grid of photon and thread counts and writes the timings as JSON, see docs/benchmark.md.
+
+#include "Raytracing.h"
+#include "mirror_module/LobsterEyeOptic.h"
+#include "simulation/PhotonEngine.h"
+#include "lib/XMLData.h"
+#include "lib/random.h"
+
+#include <pugixml.hpp>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+    struct BenchmarkOptions {
+        std::vector<std::string> optics = {"wolter", "lobster_eye"};
+        std::vector<int> shells = {3, 30, 300};
+        std::vector<std::size_t> photons = {1000, 10000, 100000, 1000000};
+        std::vector<unsigned> threads = {0};
+        int repetitions = 4;
+        std::uint64_t seed = 42;
+        std::size_t chunk_size = 4096;
+        bool wavefront = false;
+        std::string output;     // empty writes to stdout
+    };
+
+    // Entrance radii of the Athena module in tools_raytracing/wolter.xml, synthetic modules spread N shells over them
+    constexpr double wolter_outer_radius = 174.2, wolter_inner_radius = 37.24;
+    constexpr double wolter_focal_length = 1600, wolter_mirror_height = 150;
+    // Lobster eye optic: a spherical cap of radius 2 * focal length around the origin, as Pore::ray_trace expects
+    constexpr double lobster_focal_length = 600, lobster_half_width = 200;
+    constexpr int lobster_cells = 64;
+
+    std::vector<std::string> split(const std::string &list) {
+        std::vector<std::string> items;
+        std::stringstream stream(list);
+        std::string item;
+        while (std::getline(stream, item, ','))
+            if (!item.empty())
+                items.push_back(item);
+        return items;
+    }
+
+    template<typename T>
+    std::vector<T> numbers(const std::string &list) {
+        std::vector<T> values;
+        for (const std::string &item : split(list))
+            values.push_back((T) std::stod(item));  // accepts 1e6
+        return values;
+    }
+
+    void usage(const char *program) {
+        std::cerr << "Usage: " << program << " [--optics=wolter,lobster_eye] [--shells=3,30,300]"
+                  << " [--photons=1e3,1e4,1e5,1e6] [--threads=0] [--repetitions=4] [--seed=42]"
+                  << " [--chunk_size=4096] [--wavefront=false] [--output=benchmark.json]\n"
+                  << "threads=0 uses all hardware threads, the JSON goes to stdout without --output.\n";
+    }
+
+    BenchmarkOptions parse_arguments(int argc, char *argv[]) {
+        BenchmarkOptions options;
+        for (int i = 1; i < argc; i++) {
+            const std::string argument = argv[i];
+            const auto equals = argument.find('=');
+            if (argument.rfind("--", 0) != 0 || equals == std::string::npos)
+                throw std::runtime_error("benchmark: unknown argument " + argument);
+            const std::string key = argument.substr(2, equals - 2), value = argument.substr(equals + 1);
+            if (key == "optics")
+                options.optics = split(value);
+            else if (key == "shells")
+                options.shells = numbers<int>(value);
+            else if (key == "photons")
+                options.photons = numbers<std::size_t>(value);
+            else if (key == "threads")
+                options.threads = numbers<unsigned>(value);
+            else if (key == "repetitions")
+                options.repetitions = std::stoi(value);
+            else if (key == "seed")
+                options.seed = std::stoull(value);
+            else if (key == "chunk_size")
+                options.chunk_size = std::stoul(value);
+            else if (key == "wavefront")
+                options.wavefront = value == "true";
+            else if (key == "output")
+                options.output = value;
+            else
+                throw std::runtime_error("benchmark: unknown argument " + argument);
+        }
+        for (const std::string &optic : options.optics)
+            if (optic != "wolter" && optic != "lobster_eye")
+                throw std::runtime_error("benchmark: optics must be wolter or lobster_eye, not " + optic);
+        if (options.repetitions < 1 || options.chunk_size == 0)
+            throw std::runtime_error("benchmark: repetitions and chunk_size must be positive");
+        return options;
+    }
+
+    // Settings shared by all synthetic configurations: lossless mirrors, ids only history, no mesh cache
+    const char *simulation_details = R"(<simulation_details history="ids" mesh_cache="off"/>)";
+
+    XMLData load(const std::string &raytracer) {
+        const std::string xml = "<?xml version=\"1.0\"?><instrument><telescope><raytracer>" + raytracer
+                                + "</raytracer></telescope></instrument>";
+        pugi::xml_document document;
+        if (!document.load_string(xml.c_str()))
+            throw std::runtime_error("benchmark: cannot parse the synthetic configuration");
+        return {document, std::filesystem::current_path().string() + "/"};
+    }
+
+    // Wolter I module of n_shells with equally spaced entrance radii
+    std::unique_ptr<MirrorModule> synthetic_wolter(int n_shells) {
+        std::ostringstream positions;
+        positions << std::setprecision(9);
+        for (int i = 0; i < n_shells; i++) {
+            const double t = n_shells == 1 ? 0 : (double) i / (n_shells - 1);
+            positions << (i ? "," : "") << wolter_outer_radius + t * (wolter_inner_radius - wolter_outer_radius);
+        }
+        std::ostringstream raytracer;
+        raytracer << simulation_details
+                  << R"(<type type="wolter" focal_length=")" << wolter_focal_length
+                  << R"(" outer_diameter=")" << 2 * wolter_outer_radius
+                  << R"(" inner_diameter=")" << 2 * wolter_inner_radius
+                  << R"(" mirror_shells=")" << n_shells
+                  << R"(" mirror_height=")" << wolter_mirror_height << R"("/>)"
+                  << R"(<mirror exact="true" positions=")" << positions.str() << R"("/>)"
+                  << R"(<surface model="none"/>)"
+                  << R"(<spider spider="false" path="" position_x="0" position_y="0" position_z="0"/>)"
+                  << R"(<sensor offset="-0.4" sensor_x="28800" sensor_y="28800"/>)";
+        return std::make_unique<Wolter>(load(raytracer.str()));
+    }
+
+    // Binary STL of the spherical cap over [-half_width, half_width]^2, cells^2 squares of two triangles
+    void write_cap(const std::string &path, double radius, double half_width, int cells) {
+        std::ofstream file(path, std::ios::binary);
+        const char header[80] = "synthetic lobster eye optic";
+        file.write(header, sizeof(header));
+        const auto triangles = (std::uint32_t) (2 * cells * cells);
+        file.write(reinterpret_cast<const char *>(&triangles), sizeof(triangles));
+        auto vertex = [&](int i, int j) {
+            const double x = -half_width + 2 * half_width * i / cells, y = -half_width + 2 * half_width * j / cells;
+            return std::array<float, 3>{(float) x, (float) y, (float) std::sqrt(radius * radius - x * x - y * y)};
+        };
+        auto facet = [&](const std::array<float, 3> &a, const std::array<float, 3> &b, const std::array<float, 3> &c) {
+            const float normal[3] = {0, 0, 1};
+            const std::uint16_t attributes = 0;
+            file.write(reinterpret_cast<const char *>(normal), sizeof(normal));
+            for (const auto *corner : {&a, &b, &c})
+                file.write(reinterpret_cast<const char *>(corner->data()), 3 * sizeof(float));
+            file.write(reinterpret_cast<const char *>(&attributes), sizeof(attributes));
+        };
+        for (int i = 0; i < cells; i++) {
+            for (int j = 0; j < cells; j++) {
+                facet(vertex(i, j), vertex(i + 1, j), vertex(i + 1, j + 1));
+                facet(vertex(i, j), vertex(i + 1, j + 1), vertex(i, j + 1));
+            }
+        }
+        if (!file)
+            throw std::runtime_error("benchmark: cannot write " + path);
+    }
+
+    // Lobster eye optic of Theseus size with the focal plane at focal_length from the center of the sphere
+    std::unique_ptr<MirrorModule> synthetic_lobster_eye(const std::string &optic_path) {
+        std::ostringstream raytracer;
+        raytracer << simulation_details
+                  << R"(<type type="lobster_eye" focal_length=")" << lobster_focal_length
+                  << R"(" pore_width="0.04" pore_length="2.4"/>)"
+                  << R"(<optical position_x="0" position_y="0" position_z="0" path=")" << optic_path << R"("/>)"
+                  << R"(<surface model="none"/>)"
+                  << R"(<spider spider="false" path="" position_x="0" position_y="0" position_z="0"/>)"
+                  << R"(<sensor offset=")" << -lobster_focal_length << R"(" sensor_x=")" << 8 * lobster_focal_length
+                  << R"(" sensor_y=")" << 8 * lobster_focal_length << R"(" sensor_z="0" mesh="false"/>)";
+        return std::make_unique<LobsterEyeOptic>(load(raytracer.str()));
+    }
+
+    // On-axis photons over a square of the given half width, like simulate_location
+    std::function<Ray(std::size_t)> on_axis_source(double half_width, double z_start) {
+        return [=](std::size_t) {
+            const auto [u, v] = random_stream().uniform2();
+            Vec3fa dir(0, 0, -1);
+            return Ray(Vec3fa(-half_width + 2 * half_width * u, -half_width + 2 * half_width * v, z_start), dir, 1000);
+        };
+    }
+
+    // Sensor hits, surface interactions (hits of the ray history, sensor included, also those past its capacity)
+    // and rays with more interactions than the history holds, of one chunk
+    struct ChunkTally {
+        std::size_t hits = 0;
+        std::size_t bounces = 0;
+        std::size_t truncated = 0;
+    };
+
+    // Traces photons [0, n_photons) like PhotonEngine::trace, but counts the interactions of lost rays too
+    ChunkTally trace(PhotonEngine &engine, std::size_t n_photons, const std::function<Ray(std::size_t)> &source) {
+        const bool wavefront = engine.wavefront();
+        const auto tallies = engine.map_chunks<ChunkTally>(n_photons, [&](MirrorModule &context, std::uint64_t key,
+                                                                          std::size_t begin, std::size_t end,
+                                                                          std::vector<ChunkTally> &results) {
+            ChunkTally tally;
+            RandomStream &stream = random_stream();
+            if (wavefront) {
+                std::vector<Ray> rays;
+                rays.reserve(end - begin);
+                for (std::size_t i = begin; i < end; i++) {
+                    stream.begin_photon(key, i);
+                    rays.push_back(source(i));
+                }
+                std::vector<char> on_sensor;
+                context.ray_trace_batch(rays, key, begin, on_sensor);
+                for (std::size_t k = 0; k < rays.size(); k++) {
+                    tally.hits += on_sensor[k] != 0;
+                    tally.bounces += rays[k].raytracing_history.total();
+                    tally.truncated += rays[k].raytracing_history.truncated();
+                }
+            } else {
+                for (std::size_t i = begin; i < end; i++) {
+                    stream.begin_photon(key, i);
+                    Ray ray = source(i);
+                    tally.hits += context.ray_trace(ray).has_value();
+                    tally.bounces += ray.raytracing_history.total();
+                    tally.truncated += ray.raytracing_history.truncated();
+                }
+            }
+            results.push_back(tally);
+        });
+        ChunkTally total;
+        for (const ChunkTally &tally : tallies) {
+            total.hits += tally.hits;
+            total.bounces += tally.bounces;
+            total.truncated += tally.truncated;
+        }
+        return total;
+    }
+
+    // Mean and sample standard deviation
+    struct Summary {
+        double mean = 0;
+        double std = 0;
+    };
+
+    Summary summarize(const std::vector<double> &values) {
+        Summary summary;
+        for (double value : values)
+            summary.mean += value;
+        summary.mean /= (double) values.size();
+        if (values.size() > 1) {
+            for (double value : values)
+                summary.std += (value - summary.mean) * (value - summary.mean);
+            summary.std = std::sqrt(summary.std / (double) (values.size() - 1));
+        }
+        return summary;
+    }
+
+    void write_array(std::ostream &out, const std::vector<double> &values) {
+        out << "[";
+        for (std::size_t i = 0; i < values.size(); i++)
+            out << (i ? ", " : "") << values[i];
+        out << "]";
+    }
+
+    // One cell of the grid: optic, shells, threads and photons, all repetitions
+    void run_cell(std::ostream &json, bool &first, PhotonEngine &engine, const std::string &optic, int shells,
+                  std::size_t n_photons, const std::function<Ray(std::size_t)> &source, int repetitions) {
+        std::vector<double> ms, photons_per_s, ns_per_photon, bounces_per_s;
+        ChunkTally tally;
+        for (int r = 0; r < repetitions; r++) {
+            const auto t1 = std::chrono::steady_clock::now();
+            tally = trace(engine, n_photons, source);
+            const std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - t1;
+            ms.push_back(seconds.count() * 1e3);
+            photons_per_s.push_back((double) n_photons / seconds.count());
+            ns_per_photon.push_back(seconds.count() * 1e9 / (double) n_photons);
+            bounces_per_s.push_back((double) tally.bounces / seconds.count());
+        }
+        const Summary time = summarize(ms), rate = summarize(photons_per_s), cost = summarize(ns_per_photon),
+                bounce_rate = summarize(bounces_per_s);
+        std::cerr << optic;
+        if (shells > 0)
+            std::cerr << " " << shells << " shells";
+        std::cerr << ", " << n_photons
+                  << " photons, " << engine.n_threads() << " threads: " << time.mean << " +- " << time.std << " ms, "
+                  << cost.mean << " ns/photon\n";
+
+        json << (first ? "\n" : ",\n") << "    {\"optic\": \"" << optic << "\", \"shells\": " << shells
+             << ", \"photons\": " << n_photons << ", \"threads\": " << engine.n_threads()
+             << ", \"hits\": " << tally.hits << ", \"bounces_per_photon\": " << (double) tally.bounces / (double) n_photons
+             << ", \"truncated_histories\": " << tally.truncated
+             << ",\n     \"ms\": ";
+        write_array(json, ms);
+        json << ", \"ms_mean\": " << time.mean << ", \"ms_std\": " << time.std
+             << ",\n     \"photons_per_s\": " << rate.mean << ", \"photons_per_s_std\": " << rate.std
+             << ", \"ns_per_photon\": " << cost.mean << ", \"ns_per_photon_std\": " << cost.std
+             << ", \"bounces_per_s\": " << bounce_rate.mean << ", \"bounces_per_s_std\": " << bounce_rate.std << "}";
+        first = false;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    BenchmarkOptions options;
+    try {
+        options = parse_arguments(argc, argv);
+    } catch (const std::exception &error) {
+        std::cerr << error.what() << "\n";
+        usage(argv[0]);
+        return 1;
+    }
+
+    std::ostringstream runs;
+    runs << std::setprecision(9);
+    bool first = true;
+    // One telescope per configuration, one engine per thread count; the first trace of an engine is a warm up
+    auto sweep = [&](MirrorModule &telescope, const std::string &optic, int shells,
+                     const std::function<Ray(std::size_t)> &source) {
+        for (unsigned threads : options.threads) {
+            PhotonEngine engine(telescope, threads, options.seed, options.chunk_size, options.wavefront);
+            trace(engine, std::min<std::size_t>(10000, options.photons.front()), source);
+            for (std::size_t n_photons : options.photons)
+                run_cell(runs, first, engine, optic, shells, n_photons, source, options.repetitions);
+        }
+    };
+
+    for (const std::string &optic : options.optics) {
+        if (optic == "wolter") {
+            for (int shells : options.shells) {
+                const auto telescope = synthetic_wolter(shells);
+                sweep(*telescope, optic, shells,
+                      on_axis_source(200, telescope->get_focal_length() * 2 + 200));
+            }
+        } else {
+            const double radius = 2 * lobster_focal_length;
+            const std::string optic_path = (std::filesystem::temp_directory_path()
+                                            / ("sixte_benchmark_optic_" + std::to_string(options.seed) + ".stl")).string();
+            write_cap(optic_path, radius, lobster_half_width, lobster_cells);
+            const auto telescope = synthetic_lobster_eye(optic_path);
+            std::filesystem::remove(optic_path);
+            sweep(*telescope, optic, 0, on_axis_source(lobster_half_width, radius + 100));
+        }
+    }
+
+    std::ofstream file;
+    if (!options.output.empty()) {
+        file.open(options.output);
+        if (!file)
+            throw std::runtime_error("benchmark: cannot write " + options.output);
+    }
+    std::ostream &out = options.output.empty() ? std::cout : file;
+    out << std::setprecision(9)
+        << "{\n  \"benchmark\": \"end_to_end\", \"hardware_threads\": " << std::thread::hardware_concurrency()
+        << ", \"repetitions\": " << options.repetitions << ", \"seed\": " << options.seed
+        << ", \"chunk_size\": " << options.chunk_size << ", \"wavefront\": " << (options.wavefront ? "true" : "false")
+        << ",\n  \"runs\": [" << runs.str() << "\n  ]\n}\n";
+    return 0;
+}
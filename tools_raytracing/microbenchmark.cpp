@@ -0,0 +1,489 @@
+/*
+Copyright (C) 2025  Neo Reinmann (neoreinmann@gmail.com)
+*/
+
+// Kernel microbenchmark: times the intersect, surface and pore routines and the random stream in isolation on
+// prerecorded synthetic ray sets, see docs/benchmark.md.
+
+#include "Raytracing.h"
+#include "shape/Pore.h"
+#include "surface/Microfacet.h"
+#include "surface/Weighting.h"
+#include "lib/random.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <optional>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define SIXTE_HAVE_TSC 1
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define SIXTE_HAVE_TSC 1
+#endif
+
+namespace {
+    // Doubles per vector register, the lane count the double precision quadric kernels can reach
+#if defined(__AVX512F__)
+    constexpr unsigned simd_doubles = 8;
+#elif defined(__AVX__)
+    constexpr unsigned simd_doubles = 4;
+#else
+    constexpr unsigned simd_doubles = 2;
+#endif
+
+    constexpr std::size_t set_size = 4096;     // rays per set, a multiple of every packet width
+    constexpr double arcmin = M_PI / 180 / 60;
+
+    // Time stamp counter ticks on x86, nanoseconds elsewhere
+    std::uint64_t ticks() {
+#ifdef SIXTE_HAVE_TSC
+        return __rdtsc();
+#else
+        return (std::uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    // Ticks per nanosecond, measured over 50 ms
+    double ticks_per_ns() {
+        const auto t0 = std::chrono::steady_clock::now();
+        const std::uint64_t c0 = ticks();
+        while (std::chrono::steady_clock::now() - t0 < std::chrono::milliseconds(50)) {}
+        const std::uint64_t c1 = ticks();
+        const std::chrono::duration<double, std::nano> ns = std::chrono::steady_clock::now() - t0;
+        return (double) (c1 - c0) / ns.count();
+    }
+
+    // Keeps results alive so the timed calls are not optimized away
+    volatile double sink;
+
+    /**
+     * @brief Fewest ticks per call over trials runs of body, which makes calls calls. The minimum is the
+     * run least disturbed by interrupts and other processes.
+     */
+    double ticks_per_call(const std::function<void()> &body, std::size_t calls, int trials) {
+        body();     // warm up caches and branch predictors
+        double best = std::numeric_limits<double>::infinity();
+        for (int t = 0; t < trials; t++) {
+            const std::uint64_t t0 = ticks();
+            body();
+            best = std::min(best, (double) (ticks() - t0) / (double) calls);
+        }
+        return best;
+    }
+
+    // Prerecorded rays of one kind, normals only for the surface kernels
+    struct RaySet {
+        std::string name;
+        std::vector<Vec3fa> org, dir, normal;
+        std::size_t hits = 0;   // filled in by the first run
+    };
+
+    struct Row {
+        std::string kernel, set;
+        unsigned width = 1;         // rays per call
+        double ticks_per_ray = 0;
+        double hit_fraction = -1;   // < 0: not applicable
+        double speedup = 0;         // per ray against width 1, 0: not applicable
+        double efficiency = 0;
+    };
+
+    // Shell of an exact Wolter module, built by Wolter::shell_parameters like the shells of the scene
+    struct Shell {
+        Paraboloid_parameters p{};
+        Hyperboloid_parameters h{};
+
+        Shell(double radius, double focal_length, double mirror_height) {
+            Wolter::shell_parameters(radius, focal_length, mirror_height, p, h);
+        }
+    };
+
+    Vec3fa tilted(double angle, double azimuth) {
+        return {(float) (sin(angle) * cos(azimuth)), (float) (sin(angle) * sin(azimuth)), (float) -cos(angle)};
+    }
+
+    /**
+     * @brief Rays aimed at points of a shell r(z), z_lo <= z <= z_hi: on axis, 10' off axis, grazing the surface
+     * at 1e-4 rad along a meridian, and on axis but 30 % outside the shell. Each ray starts 200 mm before its point.
+     */
+    std::vector<RaySet> shell_sets(const std::function<double(double)> &radius, double z_lo, double z_hi,
+                                   std::uint64_t seed) {
+        std::mt19937_64 engine(seed);
+        std::uniform_real_distribution<double> unit(0, 1);
+        std::vector<RaySet> sets = {{"on_axis", {}, {}, {}}, {"off_axis", {}, {}, {}},
+                                    {"grazing", {}, {}, {}}, {"missing", {}, {}, {}}};
+        for (std::size_t i = 0; i < set_size; i++) {
+            const double z = z_lo + (z_hi - z_lo) * unit(engine), phi = 2 * M_PI * unit(engine);
+            const double r = radius(z);
+            const Vec3fa radial((float) cos(phi), (float) sin(phi), 0);
+            const Vec3fa point = r * radial + Vec3fa(0, 0, (float) z);
+
+            // Meridian tangent towards -z and outward normal of the surface in the (r, z) plane
+            const double h = 1e-3 * (z_hi - z_lo);
+            const double slope = (radius(z + h) - radius(z - h)) / (2 * h);
+            const Vec3fa tangent = normalize(-1.f * ((float) slope * radial + Vec3fa(0, 0, 1)));
+            const Vec3fa outward = normalize(radial - (float) slope * Vec3fa(0, 0, 1));
+            const Vec3fa directions[4] = {
+                    tilted(0, 0),
+                    tilted(10 * arcmin, 2 * M_PI * unit(engine)),
+                    normalize(tangent + 1e-4f * outward),
+                    tilted(0, 0)};
+            const Vec3fa targets[4] = {point, point, point, 1.3f * r * radial + Vec3fa(0, 0, (float) z)};
+            for (int s = 0; s < 4; s++) {
+                sets[s].org.push_back(targets[s] - 200.f * directions[s]);
+                sets[s].dir.push_back(directions[s]);
+            }
+        }
+        return sets;
+    }
+
+    // RTCRayHit packet of width N, the SoA layout RTCRayHitN stands for
+    template<unsigned N> struct Packet;
+    template<> struct Packet<1> { using type = RTCRayHit; };
+    template<> struct Packet<4> { using type = RTCRayHit4; };
+    template<> struct Packet<8> { using type = RTCRayHit8; };
+    template<> struct Packet<16> { using type = RTCRayHit16; };
+
+    /**
+     * @brief Calls an Embree intersect function the way Embree does, with all N lanes valid and tfar reset before
+     * every call, for every ray of the set. Returns ticks per ray and counts the hits of the set.
+     */
+    template<unsigned N>
+    double time_intersect_func(RTCIntersectFunctionN function, void *user_data, RaySet &set, int trials) {
+        using PacketType = typename Packet<N>::type;
+        std::vector<PacketType> packets(set.org.size() / N);
+        for (std::size_t k = 0; k < packets.size(); k++) {
+            packets[k] = PacketType{};
+            auto *rays = (RTCRayN *) &packets[k];
+            for (unsigned l = 0; l < N; l++) {
+                const std::size_t i = k * N + l;
+                RTCRayN_org_x(rays, N, l) = set.org[i].x;
+                RTCRayN_org_y(rays, N, l) = set.org[i].y;
+                RTCRayN_org_z(rays, N, l) = set.org[i].z;
+                RTCRayN_dir_x(rays, N, l) = set.dir[i].x;
+                RTCRayN_dir_y(rays, N, l) = set.dir[i].y;
+                RTCRayN_dir_z(rays, N, l) = set.dir[i].z;
+                RTCRayN_tnear(rays, N, l) = 0.0001f;
+                RTCRayN_mask(rays, N, l) = (unsigned) -1;
+            }
+        }
+        alignas(64) int valid[N];
+        std::fill(valid, valid + N, -1);
+        RTCRayQueryContext context;
+        rtcInitRayQueryContext(&context);
+        RTCIntersectFunctionNArguments args{};
+        args.valid = valid;
+        args.geometryUserPtr = user_data;
+        args.primID = 0;
+        args.context = &context;
+        args.N = N;
+        args.geomID = 0;
+
+        auto run = [&] {
+            for (PacketType &packet : packets) {
+                auto *rays = (RTCRayN *) &packet;
+                for (unsigned l = 0; l < N; l++) {
+                    RTCRayN_tfar(rays, N, l) = std::numeric_limits<float>::infinity();
+                    RTCHitN_geomID(RTCRayHitN_HitN((RTCRayHitN *) &packet, N), N, l) = RTC_INVALID_GEOMETRY_ID;
+                }
+                args.rayhit = (RTCRayHitN *) &packet;
+                function(&args);
+            }
+        };
+        const double ticks = ticks_per_call(run, set.org.size(), trials);
+        set.hits = 0;
+        for (PacketType &packet : packets)
+            for (unsigned l = 0; l < N; l++)
+                set.hits += RTCHitN_geomID(RTCRayHitN_HitN((RTCRayHitN *) &packet, N), N, l) != RTC_INVALID_GEOMETRY_ID;
+        return ticks;
+    }
+
+    // One intersect function at the packet widths Embree uses, with the lane speedup against width 1
+    void bench_intersect_func(std::vector<Row> &rows, const std::string &kernel, RTCIntersectFunctionN function,
+                              void *user_data, std::vector<RaySet> &sets, int trials) {
+        for (RaySet &set : sets) {
+            const double scalar = time_intersect_func<1>(function, user_data, set, trials);
+            const double hit_fraction = (double) set.hits / (double) set.org.size();
+            rows.push_back({kernel, set.name, 1, scalar, hit_fraction, 1, 1});
+            auto packet = [&](unsigned width, double per_ray) {
+                const double speedup = scalar / per_ray;
+                rows.push_back({kernel, set.name, width, per_ray, hit_fraction, speedup,
+                                speedup / std::min(width, simd_doubles)});
+            };
+            packet(4, time_intersect_func<4>(function, user_data, set, trials));
+            packet(8, time_intersect_func<8>(function, user_data, set, trials));
+            packet(16, time_intersect_func<16>(function, user_data, set, trials));
+        }
+    }
+
+    void bench_plane(std::vector<Row> &rows, int trials) {
+        // The sensor plane z = 0, rays start 100 mm above it
+        const Plane plane(0, 0, 1, 0, 28800, 28800);
+        std::mt19937_64 engine(3);
+        std::uniform_real_distribution<double> unit(0, 1);
+        std::vector<RaySet> sets = {{"on_axis", {}, {}, {}}, {"off_axis", {}, {}, {}},
+                                    {"grazing", {}, {}, {}}, {"missing", {}, {}, {}}};
+        for (std::size_t i = 0; i < set_size; i++) {
+            const Vec3fa org((float) (200 * unit(engine) - 100), (float) (200 * unit(engine) - 100), 100);
+            const double azimuth = 2 * M_PI * unit(engine);
+            const Vec3fa directions[4] = {tilted(0, 0), tilted(10 * arcmin, azimuth),
+                                          tilted(M_PI / 2 - 1e-3, azimuth), -1.f * tilted(0, 0)};
+            for (int s = 0; s < 4; s++) {
+                sets[s].org.push_back(org);
+                sets[s].dir.push_back(directions[s]);
+            }
+        }
+        for (RaySet &set : sets) {
+            std::vector<Ray> rays;
+            for (std::size_t i = 0; i < set.org.size(); i++)
+                rays.emplace_back(set.org[i], set.dir[i], 1000);
+            std::size_t hits = 0;
+            const double per_ray = ticks_per_call([&] {
+                double sum = 0;
+                hits = 0;
+                for (Ray &ray : rays) {
+                    const double t = plane.planeIntersect(ray);
+                    hits += t > 0 && t < std::numeric_limits<double>::infinity();
+                    sum += t;
+                }
+                sink = sum;
+            }, rays.size(), trials);
+            rows.push_back({"Plane::planeIntersect", set.name, 1, per_ray, (double) hits / (double) rays.size()});
+        }
+    }
+
+    void bench_pore(std::vector<Row> &rows, int trials) {
+        // The pore of tools_raytracing/theseus.xml, rays enter at its top face z = length in pore coordinates
+        const double width = 0.04, length = 2.4;
+        const Pore pore(width, length, Vec3fa(0, 0, 0), Vec3fa(0, 0, 0));
+        std::mt19937_64 engine(4);
+        std::uniform_real_distribution<double> unit(0, 1);
+        std::vector<RaySet> sets = {{"on_axis", {}, {}, {}}, {"off_axis", {}, {}, {}},
+                                    {"grazing", {}, {}, {}}, {"missing", {}, {}, {}}};
+        for (std::size_t i = 0; i < set_size; i++) {
+            const Vec3fa org((float) (width * unit(engine)), (float) (width * unit(engine)), (float) length);
+            const double azimuth = 2 * M_PI * unit(engine);
+            // Off axis rays meet a wall after about one pore width, grazing ones reach the exit with few reflections
+            const Vec3fa directions[4] = {tilted(0, 0), tilted(60 * arcmin, azimuth), tilted(6 * arcmin, azimuth),
+                                          -1.f * tilted(60 * arcmin, azimuth)};
+            for (int s = 0; s < 4; s++) {
+                sets[s].org.push_back(org);
+                sets[s].dir.push_back(directions[s]);
+            }
+        }
+        for (RaySet &set : sets) {
+            std::vector<Ray> rays;
+            for (std::size_t i = 0; i < set.org.size(); i++)
+                rays.emplace_back(set.org[i], set.dir[i], 1000);
+            std::size_t hits = 0;
+            const double per_ray = ticks_per_call([&] {
+                hits = 0;
+                for (Ray &ray : rays)
+                    hits += pore.findInterection(ray) != -1;
+            }, rays.size(), trials);
+            rows.push_back({"Pore::findInterection", set.name, 1, per_ray, (double) hits / (double) rays.size()});
+        }
+    }
+
+    void bench_microfacet(std::vector<Row> &rows, int trials) {
+        // GGX of tools_raytracing/wolter.xml, at the grazing angle of the outermost Athena shell
+        const Microfacet microfacet(0.0012, 0.0012, true, true);
+        const Weighting analog{};
+        const double shell_angle = asin(174.2 / 1600) / 4;
+        std::mt19937_64 engine(5);
+        std::uniform_real_distribution<double> unit(0, 1);
+        std::vector<RaySet> sets = {{"on_axis", {}, {}, {}}, {"off_axis", {}, {}, {}},
+                                    {"grazing", {}, {}, {}}, {"missing", {}, {}, {}}};
+        for (std::size_t i = 0; i < set_size; i++) {
+            const double phi = 2 * M_PI * unit(engine);
+            const Vec3fa normal((float) -cos(phi), (float) -sin(phi), 0);
+            const Vec3fa down(0, 0, -1);
+            // Angle between ray and surface; missing rays leave the surface instead of arriving
+            const double angles[4] = {shell_angle, shell_angle + 10 * arcmin, 3 * arcmin, -shell_angle};
+            for (int s = 0; s < 4; s++) {
+                sets[s].org.emplace_back(0, 0, 0);
+                sets[s].dir.push_back(normalize((float) cos(angles[s]) * down - (float) sin(angles[s]) * normal));
+                sets[s].normal.push_back(normal);
+            }
+        }
+        for (RaySet &set : sets) {
+            std::vector<Ray> rays;
+            for (std::size_t i = 0; i < set.org.size(); i++)
+                rays.emplace_back(set.org[i], set.dir[i], 1000);
+            RandomStream &stream = random_stream();
+            std::size_t hits = 0;
+            // Every call starts a photon's stream like the engine does and restores the normal it overwrites
+            const double per_ray = ticks_per_call([&] {
+                hits = 0;
+                for (std::size_t i = 0; i < rays.size(); i++) {
+                    stream.begin_photon(42, i);
+                    rays[i].set_normal(set.normal[i]);
+                    hits += microfacet.simulate_surface(rays[i], analog);
+                }
+            }, rays.size(), trials);
+            rows.push_back({"Microfacet::simulate_surface", set.name, 1, per_ray, (double) hits / (double) rays.size()});
+        }
+    }
+
+    void bench_random(std::vector<Row> &rows, int trials) {
+        RandomStream &stream = random_stream();
+        const std::size_t draws = 16 * set_size;
+        auto add = [&](const std::string &kernel, const std::function<void()> &body) {
+            rows.push_back({kernel, "-", 1, ticks_per_call(body, draws, trials)});
+        };
+        stream.set_sampling(Sampling::random);
+        add("RandomStream::uniform", [&] {
+            stream.begin_photon(42, 0);
+            double sum = 0;
+            for (std::size_t i = 0; i < draws; i++)
+                sum += stream.uniform();
+            sink = sum;
+        });
+        add("RandomStream::uniform2 random", [&] {
+            stream.begin_photon(42, 0);
+            double sum = 0;
+            for (std::size_t i = 0; i < draws; i++)
+                sum += stream.uniform2()[1];
+            sink = sum;
+        });
+        stream.set_sampling(Sampling::sobol);
+        add("RandomStream::uniform2 sobol", [&] {
+            double sum = 0;
+            for (std::size_t i = 0; i < draws; i++) {
+                stream.begin_photon(42, i);
+                sum += stream.uniform2()[1];
+            }
+            sink = sum;
+        });
+        stream.set_sampling(Sampling::random);
+        // The start of every bounce: position the stream and fill its buffer with the first draw
+        add("RandomStream::begin_photon + uniform", [&] {
+            double sum = 0;
+            for (std::size_t i = 0; i < draws; i++) {
+                stream.begin_photon(42, i);
+                sum += stream.uniform();
+            }
+            sink = sum;
+        });
+    }
+
+    void write_json(std::ostream &out, const std::vector<Row> &rows, double tick_rate) {
+        out << std::setprecision(6) << "{\n  \"benchmark\": \"kernels\", \"rays_per_set\": " << set_size
+            << ", \"ticks_per_ns\": " << tick_rate << ", \"tsc\": "
+#ifdef SIXTE_HAVE_TSC
+            << "true"
+#else
+            << "false"
+#endif
+            << ", \"simd_doubles\": " << simd_doubles << ",\n  \"rows\": [";
+        for (std::size_t i = 0; i < rows.size(); i++) {
+            const Row &row = rows[i];
+            out << (i ? ",\n" : "\n") << "    {\"kernel\": \"" << row.kernel << "\", \"set\": \"" << row.set
+                << "\", \"width\": " << row.width << ", \"ticks_per_ray\": " << row.ticks_per_ray
+                << ", \"ns_per_ray\": " << row.ticks_per_ray / tick_rate;
+            if (row.hit_fraction >= 0)
+                out << ", \"hit_fraction\": " << row.hit_fraction;
+            if (row.speedup > 0)
+                out << ", \"lane_speedup\": " << row.speedup << ", \"vector_efficiency\": " << row.efficiency;
+            out << "}";
+        }
+        out << "\n  ]\n}\n";
+    }
+
+    void print_table(const std::vector<Row> &rows, double tick_rate) {
+        std::cout << std::left << std::setw(38) << "kernel" << std::setw(10) << "set" << std::right
+                  << std::setw(6) << "width" << std::setw(12) << "ticks/ray" << std::setw(10) << "ns/ray"
+                  << std::setw(8) << "hits" << std::setw(10) << "speedup" << std::setw(12) << "efficiency" << "\n"
+                  << std::fixed;
+        for (const Row &row : rows) {
+            std::cout << std::left << std::setw(38) << row.kernel << std::setw(10) << row.set << std::right
+                      << std::setw(6) << row.width << std::setprecision(1) << std::setw(12) << row.ticks_per_ray
+                      << std::setprecision(2) << std::setw(10) << row.ticks_per_ray / tick_rate;
+            if (row.hit_fraction >= 0)
+                std::cout << std::setw(8) << row.hit_fraction;
+            else
+                std::cout << std::setw(8) << "-";
+            if (row.speedup > 0)
+                std::cout << std::setw(10) << row.speedup << std::setw(12) << row.efficiency;
+            std::cout << "\n";
+        }
+    }
+}
+
+int main(int argc, char *argv[]) {
+    int trials = 20;
+    std::string output;
+    std::optional<std::string> only;
+    for (int i = 1; i < argc; i++) {
+        const std::string argument = argv[i];
+        if (argument.rfind("--trials=", 0) == 0)
+            trials = std::stoi(argument.substr(9));
+        else if (argument.rfind("--output=", 0) == 0)
+            output = argument.substr(9);
+        else if (argument.rfind("--kernel=", 0) == 0)
+            only = argument.substr(9);
+        else {
+            std::cerr << "Usage: " << argv[0] << " [--trials=20] [--kernel=paraboloid|hyperboloid|plane|pore|"
+                      << "microfacet|random] [--output=kernels.json]\n";
+            return 1;
+        }
+    }
+    if (trials < 1) {
+        std::cerr << "trials must be positive\n";
+        return 1;
+    }
+    auto selected = [&](const std::string &kernel) { return !only || *only == kernel; };
+
+    const double tick_rate = ticks_per_ns();
+    std::vector<Row> rows;
+
+    // Outermost shell of the Athena module in tools_raytracing/wolter.xml
+    const Shell shell(174.2, 1600, 150);
+    const ShellSegmentation whole;
+    if (selected("paraboloid")) {
+        PreparedParaboloid paraboloid = Paraboloid::prepare(shell.p, whole);
+        auto sets = shell_sets([&](double z) { return paraboloid.radius(z); }, paraboloid.z_min, paraboloid.z_max, 1);
+        bench_intersect_func(rows, "Paraboloid::paraboloidIntersectFunc", Paraboloid::paraboloidIntersectFunc,
+                             &paraboloid, sets, trials);
+    }
+    if (selected("hyperboloid")) {
+        PreparedHyperboloid hyperboloid = Hyperboloid::prepare(shell.h, whole);
+        auto sets = shell_sets([&](double z) { return hyperboloid.radius(z); }, hyperboloid.z_min,
+                               hyperboloid.z_max, 2);
+        bench_intersect_func(rows, "Hyperboloid::hyperboloidIntersectFunc", Hyperboloid::hyperboloidIntersectFunc,
+                             &hyperboloid, sets, trials);
+    }
+    if (selected("plane"))
+        bench_plane(rows, trials);
+    if (selected("pore"))
+        bench_pore(rows, trials);
+    if (selected("microfacet"))
+        bench_microfacet(rows, trials);
+    if (selected("random"))
+        bench_random(rows, trials);
+
+    print_table(rows, tick_rate);
+    if (!output.empty()) {
+        std::ofstream file(output);
+        if (!file) {
+            std::cerr << "cannot write " << output << "\n";
+            return 1;
+        }
+        write_json(file, rows, tick_rate);
+    }
+    return 0;
+}
@@ -0,0 +1,30 @@
+"""
+Reader for the JSON written by raytracing_benchmark, described in docs/benchmark.md.
+
+    photons, times = read_benchmark("benchmark.json", optic="wolter")
+    times[30]  # runtimes in ms, shape (len(photons), repetitions), for the module of 30 shells
+
+The arrays have the layout of the hand filled tables in runtime.py and lobster_runtime.py.
+"""
+import json
+import numpy as np
+
+
+def read_benchmark(path, optic="wolter", threads=None):
+    """
+    Runtimes of one optic as (photons, {shells: array}), shells is 0 for the lobster eye optic.
+    threads selects one thread count of the run, by default the first one.
+    """
+    with open(path) as f:
+        runs = [run for run in json.load(f)["runs"] if run["optic"] == optic]
+    if not runs:
+        raise ValueError(f"{path}: no runs of {optic}")
+    if threads is None:
+        threads = runs[0]["threads"]
+    runs = [run for run in runs if run["threads"] == threads]
+    photons = np.array(sorted({run["photons"] for run in runs}))
+    times = {}
+    for shells in sorted({run["shells"] for run in runs}):
+        by_photons = {run["photons"]: run["ms"] for run in runs if run["shells"] == shells}
+        times[shells] = np.array([by_photons[n] for n in photons])
+    return photons, times
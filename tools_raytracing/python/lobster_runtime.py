@@ -1,5 +1,7 @@
+import sys
 import numpy as np
 import matplotlib.pyplot as plt
+from benchmark_json import read_benchmark
 
 # Photon counts
 photons = np.array([1000, 10000, 100000, 1000000, 10000000])
@@ -29,6 +31,16 @@ times_300 = np.array([
     []
 ])
 
+# python lobster_runtime.py benchmark.json plots the output of raytracing_benchmark instead
+if len(sys.argv) > 1:
+    photons, lobster = read_benchmark(sys.argv[1], "lobster_eye")
+    wolter_photons, wolter = read_benchmark(sys.argv[1], "wolter")
+    times_3 = lobster[0]
+    if 30 in wolter and np.array_equal(wolter_photons, photons):
+        times_30 = wolter[30]
+    else:
+        times_30 = np.full_like(times_3, np.nan)
+
 # Compute mean and std for each photon count
 def stats(times):
     return np.mean(times, axis=1), np.std(times, axis=1)
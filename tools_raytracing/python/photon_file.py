@@ -0,0 +1,172 @@
+"""
+Reader for the columnar binary photon files (.phot) written with <output format="binary"/>.
+The layout is described in docs/photon_file.md.
+
+    columns = read_photon_file("0_point_off_focus_x0.000000_y0.000000.phot")
+    x, y = columns["x"], columns["y"]
+
+Columns of uncompressed files are numpy.memmap views, nothing is read until a column is used. A streamed
+file has one row group per batch, its columns are GroupedColumn objects that keep one memmap per group.
+Compressed files need the zstandard package.
+"""
+import os
+import sys
+import numpy as np
+
+FILE_MAGIC = b"SXPHOTON"
+GROUP_MAGIC = b"ROWGROUP"
+END_MAGIC = b"ENDFILE\0"
+ALIGNMENT = 64
+HISTORY_LEVELS = ("off", "ids", "full")
+
+
+def _align(offset):
+    return (offset + ALIGNMENT - 1) // ALIGNMENT * ALIGNMENT
+
+
+def read_header(path):
+    """
+    Returns the file header as a dict: version, compression, history level, history capacity,
+    the columns as (name, dtype, width) and the offset of the first row group.
+    """
+    with open(path, "rb") as f:
+        head = f.read(ALIGNMENT)
+        if head[:8] != FILE_MAGIC:
+            raise ValueError(f"{path} is not a photon file")
+        version, n_columns, compression, history, capacity = np.frombuffer(head, "<u4", 5, 8)
+        table = f.read(_align(32 * int(n_columns)))
+    columns = []
+    for i in range(int(n_columns)):
+        entry = table[32 * i:32 * (i + 1)]
+        name = entry[:24].rstrip(b"\0").decode()
+        dtype = np.dtype(entry[24:28].rstrip(b"\0").decode())
+        width = int(np.frombuffer(entry, "<u4", 1, 28)[0])
+        columns.append((name, dtype, width))
+    return {
+        "version": int(version),
+        "compression": "zstd" if compression == 1 else "none",
+        "history": HISTORY_LEVELS[int(history)],
+        "history_capacity": int(capacity),
+        "columns": columns,
+        "data_offset": ALIGNMENT + len(table),
+    }
+
+
+def _blocks(path, header):
+    """
+    Yields (n_rows, [(offset, stored_bytes, raw_bytes, frames) per column]) for every row group.
+    """
+    size = os.path.getsize(path)
+    offset = header["data_offset"]
+    with open(path, "rb") as f:
+        while offset + ALIGNMENT <= size:
+            f.seek(offset)
+            group = f.read(ALIGNMENT)
+            if group[:8] == END_MAGIC:
+                return
+            if group[:8] != GROUP_MAGIC:
+                raise ValueError(f"{path}: broken row group at offset {offset}")
+            n_rows = int(np.frombuffer(group, "<u8", 1, 8)[0])
+            offset += ALIGNMENT
+            blocks = []
+            for _ in header["columns"]:
+                f.seek(offset)
+                stored, raw, frames = (int(v) for v in np.frombuffer(f.read(24), "<u8", 3))
+                blocks.append((offset + ALIGNMENT, stored, raw, frames))
+                offset = _align(offset + ALIGNMENT + stored)
+            yield n_rows, blocks
+    print(f"warning: {path} has no end marker, the run did not finish", file=sys.stderr)
+
+
+def _inflate(path, offset, frames):
+    import zstandard
+    decompressor = zstandard.ZstdDecompressor()
+    parts = []
+    with open(path, "rb") as f:
+        f.seek(offset)
+        for _ in range(frames):
+            compressed, raw = (int(v) for v in np.frombuffer(f.read(16), "<u8", 2))
+            parts.append(decompressor.decompress(f.read(compressed), max_output_size=raw))
+    return b"".join(parts)
+
+
+class GroupedColumn(np.lib.mixins.NDArrayOperatorsMixin):
+    """
+    Column of an uncompressed file with several row groups: one numpy.memmap per group, nothing is read
+    or copied until it is used. Indexing with an int reads one row; other indexing, arithmetic, numpy
+    functions and np.asarray see the whole column, which copies the groups once. Iterate over .groups to
+    go through a large file group by group without that copy.
+    """
+
+    def __init__(self, groups, dtype, width):
+        self.groups = groups
+        self.dtype = dtype
+        rows = sum(len(g) for g in groups)
+        self.shape = (rows, width) if width > 1 else (rows,)
+        self.ndim = len(self.shape)
+
+    def __len__(self):
+        return self.shape[0]
+
+    def __getitem__(self, key):
+        if isinstance(key, (int, np.integer)):
+            row = int(key) + len(self) if key < 0 else int(key)
+            if not 0 <= row < len(self):
+                raise IndexError(f"row {key} out of range for {len(self)} rows")
+            for group in self.groups:
+                if row < len(group):
+                    return group[row]
+                row -= len(group)
+        return np.asarray(self)[key]
+
+    def __array__(self, dtype=None, copy=None):
+        column = np.concatenate(self.groups)
+        return column if dtype is None else column.astype(dtype)
+
+    def __array_ufunc__(self, ufunc, method, *inputs, **kwargs):
+        inputs = [np.asarray(i) if isinstance(i, GroupedColumn) else i for i in inputs]
+        return getattr(ufunc, method)(*inputs, **kwargs)
+
+
+def read_photon_file(path, columns=None):
+    """
+    Returns {column name: array}, one row per photon that reached the sensor.
+    Columns with a width above 1 (history_id, history_origin, ...) have shape (rows, width).
+    Uncompressed columns are memmaps, or GroupedColumn if the file has more than one row group.
+    """
+    header = read_header(path)
+    wanted = [c for c in header["columns"] if columns is None or c[0] in columns]
+    parts = {name: [] for name, _, _ in wanted}
+    for n_rows, blocks in _blocks(path, header):
+        for (name, dtype, width), (offset, stored, raw, frames) in zip(header["columns"], blocks):
+            if name not in parts:
+                continue
+            shape = (n_rows, width) if width > 1 else (n_rows,)
+            if frames == 0:
+                parts[name].append(np.memmap(path, dtype, "r", offset, shape) if n_rows else np.empty(shape, dtype))
+            else:
+                parts[name].append(np.frombuffer(_inflate(path, offset, frames), dtype).reshape(shape))
+    result = {}
+    for name, dtype, width in wanted:
+        chunks = parts[name]
+        if len(chunks) == 1:
+            result[name] = chunks[0]
+        elif chunks and header["compression"] == "none":
+            result[name] = GroupedColumn(chunks, dtype, width)
+        elif chunks:
+            result[name] = np.concatenate(chunks)
+        else:
+            result[name] = np.empty((0, width) if width > 1 else (0,), dtype)
+    return result
+
+
+if __name__ == "__main__":
+    if len(sys.argv) < 2:
+        print(f"usage: {sys.argv[0]} <file.phot>")
+        sys.exit(1)
+    info = read_header(sys.argv[1])
+    data = read_photon_file(sys.argv[1])
+    rows = len(data["index"])
+    print(f"{sys.argv[1]}: {rows} photons, compression {info['compression']}, history {info['history']}")
+    for name, dtype, width in info["columns"]:
+        print(f"  {name:18s} {dtype.str:4s} x {width}")
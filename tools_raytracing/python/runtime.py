@@ -1,5 +1,7 @@
+import sys
 import numpy as np
 import matplotlib.pyplot as plt
+from benchmark_json import read_benchmark
 
 # ---- INPUT: put your data here ----
 # photons must be shared across setups
@@ -57,6 +59,15 @@ data = {
 }
 # -----------------------------------
 
+# python runtime.py benchmark.json [old_benchmark.json] plots the output of raytracing_benchmark instead
+if len(sys.argv) > 1:
+    photons, new = read_benchmark(sys.argv[1], "wolter")
+    data = {"new": new}
+    if len(sys.argv) > 2:
+        old_photons, data["old"] = read_benchmark(sys.argv[2], "wolter")
+        if not np.array_equal(old_photons, photons):
+            raise ValueError("both benchmarks need the same photon counts")
+
 def compute_stats(arr):
     """Return mean and std along axis=1 (per photon count)."""
     return np.mean(arr, axis=1), np.std(arr, axis=1)
@@ -21,126 +21,358 @@ Copyright (C) 2025  Neo Reinmann (neoreinmann@gmail.com)
 #include <optional>    // <-- std::optional
 #include <iomanip>     // <-- CSV formatting
 #include <array>
+#include <span>
 #include "mirror_module/LobsterEyeOptic.h"
-
-
-struct hit_entry{
-    hit_entry(int i, Ray fa) : index(i), hit(std::move(fa)) { }
-    int index;
-    Ray hit;
-};
-
-std::string print_rt_hist(std::vector<shape_id> rt_hist){
+#include "simulation/PhotonEngine.h"
+#include "output/PhotonFile.h"
+#include "output/AsyncHitWriter.h"
+#include "sensor/FocalPlaneImage.h"
+#include "simulation/PsfStatistics.h"
+#include "simulation/EffectiveArea.h"
+#include "simulation/Vignetting.h"
+#include "simulation/ApertureSampler.h"
+#include "surface/Weighting.h"
+
+
+// The surface ids of a history or, if it has them, origin, direction and id of every entry
+std::string print_rt_hist(std::span<const short> ids, std::span<const Vec3fa> origins, std::span<const Vec3fa> directions){
     std::string print_out;
-    for (const shape_id &shapeId : rt_hist) {
+    if (origins.empty()) {
+        for (short id : ids)
+            print_out.append(std::to_string(id) + " ");
+        return print_out;
+    }
+    for (std::size_t i = 0; i < ids.size(); i++) {
         print_out.append(
-                std::to_string(shapeId.origin.x) + " " + std::to_string(shapeId.origin.y) + " " + std::to_string(shapeId.origin.z) + " " +
-                std::to_string(shapeId.direction.x) + " " + std::to_string(shapeId.direction.y) + " " + std::to_string(shapeId.direction.z) + " " +
-                std::to_string(shapeId.id) + " "
+                std::to_string(origins[i].x) + " " + std::to_string(origins[i].y) + " " + std::to_string(origins[i].z) + " " +
+                std::to_string(directions[i].x) + " " + std::to_string(directions[i].y) + " " + std::to_string(directions[i].z) + " " +
+                std::to_string(ids[i]) + " "
         );
     }
     return print_out;
 }
 
-double generateRandomDouble(double m, double n) {
-    double uniform_number = easy_uniform_random();
-    return m + (n-m) * uniform_number;
+std::string print_rt_hist(const RayHistory &rt_hist){
+    return print_rt_hist(rt_hist.ids(), rt_hist.origins(), rt_hist.directions());
 }
 
-void writeUnorderedMapToTextFile(const std::vector<hit_entry>& hits, const std::string& filename) {
-    std::cout << "Start writing into file.\n";
-    std::ofstream ofs(filename);
-    if (!ofs) {
-        std::cerr << "Error opening file for writing!" << std::endl;
-        return;
+// How the simulate_* functions store their hits, from the optional <output> element
+enum class OutputFormat {
+    text,       // one line per photon
+    binary,     // columnar photon file, docs/photon_file.md
+    image       // focal plane image on the detector pixels, no photon list
+};
+
+struct OutputOptions {
+    OutputFormat format = OutputFormat::text;
+    PhotonFileOptions photon_file{};
+    HistoryLevel history = HistoryLevel::full;   // columns of the binary file, from simulation_details
+    bool weights = false;                        // weighting="weighted": hits carry a weight, written with them
+    std::string image_key = "none";              // sub-images: none, shell or reflections
+    std::optional<DetectorWCS> detector;         // only read for format="image"
+};
+static OutputOptions output_options;
+// From the optional <statistics/> element, traces stop once the PSF estimates have converged
+static std::optional<PsfStatisticsOptions> statistics_options;
+
+// Where the simulate_* functions start their photons, from simulation_details
+struct ApertureOptions {
+    bool annuli = false;        // aperture="annuli": only the entrance annuli of the shells, else the whole square
+    std::size_t block = 1000;   // aperture_block, photons per stratified block
+};
+static ApertureOptions aperture_options;
+// From the optional <spectrum/> element, rays carry one weight per energy bin (docs/spectral_mode.md)
+static std::optional<EnergyGrid> spectrum;
+
+ApertureOptions aperture_options_from_xml(const XMLData &xml_data) {
+    auto details = xml_data.child("telescope").child("raytracer").child("simulation_details");
+    ApertureOptions options;
+    const std::string aperture = details.attributeAsStringOr("aperture", "square");
+    if (aperture != "square" && aperture != "annuli")
+        throw std::runtime_error("simulation_details: aperture must be square or annuli, not " + aperture);
+    options.annuli = aperture == "annuli";
+    const int block = details.attributeAsIntOr("aperture_block", (int) options.block);
+    if (block <= 0)
+        throw std::runtime_error("simulation_details: aperture_block must be positive");
+    options.block = (std::size_t) block;
+    return options;
+}
+
+OutputOptions output_options_from_xml(const XMLData &xml_data) {
+    OutputOptions options;
+    options.history = history_level_from_string(xml_data.child("telescope").child("raytracer")
+            .child("simulation_details").attributeAsStringOr("history", "full"));
+    options.weights = Weighting::from_xml(xml_data).weighted;
+    options.photon_file.weights = options.weights;
+    auto output = xml_data.child("telescope").child("raytracer").optionalChild("output");
+    if (!output)
+        return options;
+    const std::string format = output->attributeAsStringOr("format", "text");
+    if (format == "binary")
+        options.format = OutputFormat::binary;
+    else if (format == "image")
+        options.format = OutputFormat::image;
+    else if (format != "text")
+        throw std::runtime_error("output: format must be text, binary or image, not " + format);
+    if (options.format == OutputFormat::image) {
+        options.detector = DetectorWCS::from_xml(xml_data);
+        options.image_key = output->attributeAsStringOr("image_key", "none");
+        if (options.image_key != "none" && options.image_key != "shell" && options.image_key != "reflections")
+            throw std::runtime_error("output: image_key must be none, shell or reflections, not " + options.image_key);
+        if (options.image_key != "none" && options.history == HistoryLevel::off)
+            throw std::runtime_error("output: image_key=\"" + options.image_key + "\" needs a ray history, not history=\"off\"");
     }
-    for (const auto& hit : hits) {
-        ofs << hit.index << " "
-            << hit.hit.position().x << " "
-            << hit.hit.position().y << " "
-            << print_rt_hist(hit.hit.raytracing_history) << "\n";
+    options.photon_file.compression = photon_compression_from_string(output->attributeAsStringOr("compression", "none"));
+    const int chunk_rows = output->attributeAsIntOr("chunk_rows", 1 << 20);
+    if (chunk_rows <= 0)
+        throw std::runtime_error("output: chunk_rows must be positive");
+    options.photon_file.chunk_rows = (std::size_t) chunk_rows;
+    return options;
+}
+
+// Photons of one source and the area their start positions cover
+struct ApertureSource {
+    std::function<Ray(std::size_t)> source;
+    double area;    // mm^2
+};
+
+// Source with the given direction starting at z_start: uniform over the square [ub, lb]^2 or, with
+// aperture="annuli", stratified over the entrance annuli of the shells (ApertureSampler).
+ApertureSource aperture_source(const MirrorModule &telescope, std::size_t n_photons, double lb, double ub,
+                               const Vec3fa &direction, double z_start, double energy) {
+    std::vector<Annulus> annuli;
+    if (aperture_options.annuli)
+        annuli = telescope.entrance_annuli(-direction.x / direction.z, -direction.y / direction.z, z_start);
+    if (annuli.empty()) {
+        if (aperture_options.annuli)
+            std::cerr << "aperture=\"annuli\": the mirror module has no entrance annuli, sampling the square\n";
+        return {[=](std::size_t) {
+            const auto [u, v] = random_stream().uniform2();
+            double x = lb + (ub - lb) * u;
+            double y = lb + (ub - lb) * v;
+            Vec3fa dir = direction;
+            return Ray(Vec3fa(x, y, z_start), dir, energy);
+        }, (ub - lb) * (ub - lb)};
     }
-    ofs.close();
+    auto sampler = std::make_shared<const ApertureSampler>(annuli, n_photons, aperture_options.block);
+    return {[=](std::size_t i) {
+        const auto [u, v] = random_stream().uniform2();
+        const auto [x, y] = sampler->sample(i, u, v);
+        Vec3fa dir = direction;
+        return Ray(Vec3fa(x, y, z_start), dir, energy);
+    }, sampler->area()};
 }
 
-void simulate_location(const std::unique_ptr<MirrorModule> &telescope, const int n_photons, const double dir_x, const double dir_y, double energy=1000, int idx=0) {
-    using std::chrono::high_resolution_clock;
-    auto t1 = high_resolution_clock::now();
-    int lb = 200, ub = -200;
-    std::vector<hit_entry> hits;
-    for (int i = 0; i < n_photons; i++) {
-        double x = generateRandomDouble(lb, ub);
-        double y = generateRandomDouble(lb, ub);
-        Vec3fa direction(dir_x, dir_y, -1);
-        auto ray = Ray(Vec3fa(x, y, telescope->get_focal_length()*2+200), direction, energy);
-
-        std::optional<Ray> hit = telescope->ray_trace(ray);
-        if (!hit) continue;
-        hits.emplace_back(i, *hit);
+// Output file of one simulate_* call: stem.txt or, with <output format="binary"/>, stem.phot, written batch by batch
+class HitFile {
+public:
+    explicit HitFile(const std::string &stem) {
+        std::cout << "Start writing into file.\n";
+        if (output_options.format == OutputFormat::binary) {
+            binary_ = std::make_unique<PhotonFileWriter>(stem + ".phot", output_options.history,
+                                                         output_options.photon_file);
+            return;
+        }
+        text_.open(stem + ".txt");
+        if (!text_)
+            throw std::runtime_error("Error opening " + stem + ".txt for writing");
     }
-    auto t2 = high_resolution_clock::now();
-    std::chrono::duration<double, std::milli> ms_double = t2 - t1;
-    std::cout << "time for " << n_photons << " photons: " << ms_double.count() << "ms\n";
-    t1 = high_resolution_clock::now();
-    const std::string filename = std::to_string(idx) + "_" + std::string("point_off_focus_x") + std::to_string(dir_x) + "_y" + std::to_string(dir_y) + ".txt";
-    writeUnorderedMapToTextFile(hits, filename);
-    t2 = high_resolution_clock::now();
-    ms_double = t2 - t1;
-    std::cout << "time for writing " << n_photons << " photons: " << ms_double.count() << "ms\n";
+
+    void write(const HitBatch &hits) {
+        if (binary_) {
+            binary_->write(hits);
+            return;
+        }
+        for (std::size_t i = 0; i < hits.size(); i++) {
+            text_ << hits.index[i] << " "
+                  << hits.position[i].x << " "
+                  << hits.position[i].y << " "
+                  << print_rt_hist(hits.history_ids(i), hits.history_origins(i), hits.history_directions(i));
+            // Weighted rays end their line with the weight
+            if (output_options.weights)
+                text_ << hits.weight[i];
+            text_ << "\n";
+        }
+    }
+
+    void close() {
+        if (binary_)
+            binary_->close();
+        else
+            text_.close();
+    }
+
+private:
+    std::ofstream text_;
+    std::unique_ptr<PhotonFileWriter> binary_;
+};
+
+// Names of the sub-images of <output format="image" image_key="..."/>, used as FITS EXTNAME
+std::vector<std::string> image_key_names(const MirrorModule &telescope) {
+    std::vector<std::string> names;
+    if (output_options.image_key == "shell") {
+        if (telescope.shell_count() == 0)
+            throw std::runtime_error("output: image_key=\"shell\" needs a mirror module with shells");
+        for (int i = 0; i < telescope.shell_count(); i++)
+            names.push_back("SHELL_" + std::to_string(i));
+    } else if (output_options.image_key == "reflections") {
+        names = {"DIRECT", "SINGLE", "DOUBLE", "MULTIPLE"};
+    }
+    return names;
+}
+
+// Sub-image of a ray on the sensor from the surface ids of its history, -1 for none
+int image_key(const MirrorModule &telescope, std::span<const short> ids) {
+    if (output_options.image_key == "shell") {
+        // First shell the ray hit
+        for (short id : ids) {
+            const int shell = telescope.shell_of(id);
+            if (shell >= 0)
+                return shell;
+        }
+        return -1;
+    }
+    if (output_options.image_key == "reflections") {
+        // The last entry is the sensor itself
+        const std::size_t reflections = ids.empty() ? 0 : ids.size() - 1;
+        return (int) std::min<std::size_t>(reflections, 3);
+    }
+    return -1;
+}
+
+
+// Prints the estimates of one source traced with <statistics/>
+void print_psf_statistics(const PsfStatistics &statistics, double focal_length) {
+    // mm on the sensor to arcsec on the sky
+    const double arcsec = 180.0 / M_PI * 3600.0 / focal_length;
+    const Estimate x = statistics.centroid_x(), y = statistics.centroid_y();
+    const Estimate hew = statistics.hew();
+    const Estimate area = statistics.effective_area();
+    std::cout << (statistics.stopped() ? "converged after " : "not converged after ") << statistics.photons()
+              << " photons, " << statistics.hits() << " hits\n"
+              << "  centroid: x " << x.value << " +- " << x.half_width() << " mm, y " << y.value << " +- "
+              << y.half_width() << " mm\n"
+              << "  HEW: " << hew.value << " mm [" << hew.lower << ", " << hew.upper << "] = " << hew.value * arcsec
+              << " arcsec\n"
+              << "  effective area: " << area.value << " +- " << area.half_width() << " mm^2\n";
 }
 
-void simulate_location_model_change(const std::unique_ptr<MirrorModule> &telescope, const int n_photons, const double dir_x, const double dir_y, std::string model) {
+// Traces n_photons from every source into stem.txt, stem.phot or stem.fits, depending on <output>.
+// With <statistics/> n_photons is the maximum, each source stops once its estimates have converged.
+void trace_to_output(PhotonEngine &engine, const int n_photons, const std::vector<ApertureSource> &sources,
+                     const std::string &stem) {
     using std::chrono::high_resolution_clock;
     auto t1 = high_resolution_clock::now();
-    int lb = 400, ub = -400;
-    std::vector<hit_entry> hits;
-    for (int i = 0; i < n_photons; i++) {
-        double x = generateRandomDouble(lb, ub);
-        double y = generateRandomDouble(lb, ub);
-        Vec3fa direction(dir_x, dir_y, -1.0);
-        auto ray = Ray(Vec3fa(x, y, 5000.0), direction, 277.0);
-        std::optional<Ray> hit = telescope->ray_trace(ray);
-        if (!hit) continue;
-        hits.emplace_back(i, *hit);
+    std::size_t total_photons = 0;
+
+    // Streams the hits of one source to output, batch by batch in photon order
+    auto trace_source = [&](const ApertureSource &source,
+                            const std::function<void(HitBatch &&)> &output) {
+        if (!statistics_options) {
+            engine.trace(n_photons, source.source, output);
+            total_photons += n_photons;
+            return;
+        }
+        PsfStatistics statistics(source.area, *statistics_options);
+        engine.trace_until(n_photons, source.source, [&](HitBatch &&batch, std::size_t photons_done) {
+            const bool more = statistics.consume(batch, photons_done);
+            output(std::move(batch));
+            return more;
+        });
+        total_photons += statistics.photons();
+        print_psf_statistics(statistics, engine.telescope().get_focal_length());
+    };
+
+    if (output_options.format == OutputFormat::image) {
+        const MirrorModule &telescope = engine.telescope();
+        // A spectral cube per worker would cost n_threads times its memory, it is only binned here
+        const FocalPlaneImage empty(*output_options.detector, image_key_names(telescope),
+                                    spectrum ? spectrum->mids() : std::vector<double>{});
+        std::vector<FocalPlaneImage> images(spectrum ? 1 : engine.n_threads(), empty);
+        auto bin = [&](FocalPlaneImage &image, const Ray &hit) {
+            image.add(hit.position().x, hit.position().y, hit.weight, image_key(telescope, hit.raytracing_history.ids()));
+        };
+        for (const auto &source : sources) {
+            if (statistics_options || spectrum) {
+                // Where a source stops decides which hits count, so these are binned in photon order here
+                trace_source(source, [&](HitBatch &&batch) {
+                    for (std::size_t i = 0; i < batch.size(); i++) {
+                        const int key = image_key(telescope, batch.history_ids(i));
+                        if (spectrum)
+                            images[0].add(batch.position[i].x, batch.position[i].y, batch.spectral(i),
+                                          batch.weight[i], key);
+                        else
+                            images[0].add(batch.position[i].x, batch.position[i].y, batch.weight[i], key);
+                    }
+                });
+            } else {
+                // One image per worker, merged in worker order once all photons are traced
+                engine.trace_into<FocalPlaneImage>(n_photons, source.source, images, bin);
+                total_photons += n_photons;
+            }
+        }
+        auto t2 = high_resolution_clock::now();
+        std::chrono::duration<double, std::milli> ms_double = t2 - t1;
+        std::cout << "time for " << total_photons << " photons: " << ms_double.count() << "ms\n";
+
+        t1 = high_resolution_clock::now();
+        for (std::size_t w = 1; w < images.size(); w++)
+            images[0].merge(images[w]);
+        images[0].write_fits(stem + ".fits");
+        ms_double = high_resolution_clock::now() - t1;
+        std::cout << "time for writing the image of " << images[0].total() << " hits (" << images[0].outside()
+                  << " off the detector): " << ms_double.count() << "ms\n";
+        return;
+    }
+
+    HitFile file(stem);
+    AsyncHitWriter writer([&](const HitBatch &batch) { file.write(batch); }, engine.batch_bytes());
+    std::size_t n_hits = 0;
+    for (const auto &source : sources) {
+        trace_source(source, [&](HitBatch &&batch) {
+            n_hits += batch.size();
+            writer.push(std::move(batch));
+        });
     }
     auto t2 = high_resolution_clock::now();
     std::chrono::duration<double, std::milli> ms_double = t2 - t1;
-    std::cout << "time for " << n_photons << " photons: " << ms_double.count() << "ms\n";
+    std::cout << "time for " << total_photons << " photons: " << ms_double.count() << "ms\n";
+
+    // Whatever the writer has not caught up with yet, and how long tracing waited for it
     t1 = high_resolution_clock::now();
-    const std::string filename = std::string("point_off_focus_x") + std::to_string(dir_x) + "_y" + std::to_string(dir_y) + model + ".txt";
-    writeUnorderedMapToTextFile(hits, filename);
-    t2 = high_resolution_clock::now();
-    ms_double = t2 - t1;
-    std::cout << "time for writing " << n_photons << " photons: " << ms_double.count() << "ms\n";
+    writer.finish();
+    file.close();
+    ms_double = high_resolution_clock::now() - t1;
+    std::cout << "time for writing " << n_hits << " hits after tracing: " << ms_double.count() << "ms, tracing waited "
+              << writer.stall_ms() << "ms for the writer\n";
 }
 
-void simulate_psf_row(const std::unique_ptr<MirrorModule> &telescope, const int n_photons, const double energy) {
-    using std::chrono::high_resolution_clock;
-    auto t1 = high_resolution_clock::now();
-    std::vector<hit_entry> hits;
+void simulate_location(PhotonEngine &engine, const int n_photons, const double dir_x, const double dir_y, double energy=1000, int idx=0) {
+    int lb = 200, ub = -200;
+    const double z_start = engine.telescope().get_focal_length()*2+200;
+    const std::string filename = std::to_string(idx) + "_" + std::string("point_off_focus_x") + std::to_string(dir_x) + "_y" + std::to_string(dir_y);
+    trace_to_output(engine, n_photons, {aperture_source(engine.telescope(), n_photons, lb, ub, Vec3fa(dir_x, dir_y, -1),
+                                                        z_start, energy)}, filename);
+}
+
+void simulate_location_model_change(PhotonEngine &engine, const int n_photons, const double dir_x, const double dir_y, std::string model) {
+    int lb = 400, ub = -400;
+    const std::string filename = std::string("point_off_focus_x") + std::to_string(dir_x) + "_y" + std::to_string(dir_y) + model;
+    trace_to_output(engine, n_photons, {aperture_source(engine.telescope(), n_photons, lb, ub, Vec3fa(dir_x, dir_y, -1.0),
+                                                        5000.0, 277.0)}, filename);
+}
+
+void simulate_psf_row(PhotonEngine &engine, const int n_photons, const double energy) {
+    const double z_start = engine.telescope().get_focal_length()*2+200;
+    const std::string filename = std::string("psf_row") + std::to_string(energy);
+    std::vector<ApertureSource> sources;
+    const int lb = 400, ub = -400;
     for (int k = 0; k < 5; k++) {
 
-        int lb = 400, ub = -400;
-        for (int i = 0; i < n_photons; i++) {
-            double x = generateRandomDouble(lb, ub);
-            double y = generateRandomDouble(lb, ub);
-            Vec3fa direction(0.002*k, 0, -1);
-            auto ray = Ray(Vec3fa(x, y, telescope->get_focal_length()*2+200), direction, energy);
-            //auto ray = Ray(po, di, 8.0);
-            std::optional<Ray> hit = telescope->ray_trace(ray);
-            if (!hit) continue;
-            hits.emplace_back(i, *hit);
-        }
+        sources.push_back(aperture_source(engine.telescope(), n_photons, lb, ub, Vec3fa(0.002*k, 0, -1),
+                                          z_start, energy));
     }
-    auto t2 = high_resolution_clock::now();
-    std::chrono::duration<double, std::milli> ms_double = t2 - t1;
-    std::cout << "time for " << n_photons << " photons: " << ms_double.count() << "ms\n";
-    t1 = high_resolution_clock::now();
-    const std::string filename = std::string("psf_row") + std::to_string(energy) + ".txt";
-    writeUnorderedMapToTextFile(hits, filename);
-    t2 = high_resolution_clock::now();
-    ms_double = t2 - t1;
-    std::cout << "time for writing " << n_photons << " photons: " << ms_double.count() << "ms\n";
+    trace_to_output(engine, n_photons, sources, filename);
 }
 
 std::unique_ptr<MirrorModule> create_telescope(const std::string& path)
@@ -155,40 +387,129 @@ std::unique_ptr<MirrorModule> create_telescope(const std::string& path)
     throw std::runtime_error("Unknown mirror_module type: " + telescope_type);
 }
 
-void simulate_psfs_single_thread(const std::unique_ptr<MirrorModule> &telescope, int n_photons) {
+void simulate_psfs(PhotonEngine &engine, int n_photons) {
     for (int l = 0; l < 1; l++) {
         for (int k = 0; k < 1; k++) {
-            simulate_location(telescope, n_photons, 0.002*k, 0.0012*l);
+            simulate_location(engine, n_photons, 0.002*k, 0.0012*l);
         }
     }
 }
 
-void simulate_on_axis_psf_ggx_ggx(std::unique_ptr<MirrorModule> &telescope, int n_photons) {
+// Traces n_photons from aperture on all workers and sums their throughput over grid, see EffectiveAreaAccumulator
+EffectiveAreaAccumulator trace_throughput(PhotonEngine &engine, int n_photons, const ApertureSource &aperture,
+                                          const EnergyGrid &grid, const Reflectivity &reflectivity) {
+    std::vector<EffectiveAreaAccumulator> accumulators(engine.n_threads(), EffectiveAreaAccumulator(grid, reflectivity));
+    engine.trace_into<EffectiveAreaAccumulator>(n_photons, aperture.source, accumulators, [](EffectiveAreaAccumulator &accumulator, const Ray &hit) {
+        if (spectrum)
+            accumulator.add(hit.spectral_weights, hit.weight);
+        else
+            accumulator.add(hit.grazing_angles, hit.weight);
+    });
+    for (std::size_t w = 1; w < accumulators.size(); w++)
+        accumulators[0].merge(accumulators[w]);
+    return accumulators[0];
+}
+
+// On-axis effective area over the energy grid of <effective_area/>, written as OGIP ARF.
+// One lossless trace, the grazing angles of every hit are weighted with the coating reflectivity at each
+// energy, or with the constant reflectivity of <effective_area/> if there is no <reflectivity/>.
+// In the spectral mode the hits carry these weights already, the ARF is on the grid of <spectrum/>.
+void simulate_effective_area(PhotonEngine &engine, int n_photons, EffectiveAreaOptions options,
+                             const Reflectivity *coating) {
+    if (spectrum)
+        options.grid = *spectrum;
+    int lb = 200, ub = -200;
+    const double z_start = engine.telescope().get_focal_length()*2+200;
+    const ApertureSource aperture = aperture_source(engine.telescope(), n_photons, lb, ub, Vec3fa(0, 0, -1),
+                                                    z_start, 1000);
+    const ConstantReflectivity constant(options.reflectivity);
+    const Reflectivity &reflectivity = coating != nullptr ? *coating : constant;
+
+    using std::chrono::high_resolution_clock;
+    auto t1 = high_resolution_clock::now();
+    const EffectiveAreaAccumulator accumulator = trace_throughput(engine, n_photons, aperture, options.grid, reflectivity);
+    std::chrono::duration<double, std::milli> ms_double = high_resolution_clock::now() - t1;
+    std::cout << "time for " << n_photons << " photons (" << accumulator.hits() << " hits): "
+              << ms_double.count() << "ms\n";
+
+    // mm^2 -> cm^2
+    std::vector<double> area = accumulator.effective_area(aperture.area / 100, n_photons);
+    std::vector<double> error = accumulator.effective_area_error(aperture.area / 100, n_photons);
+    write_arf(options.filename, options.grid, area, error, options.telescope, options.instrument);
+    std::cout << "effective area written to " << options.filename << "\n";
+}
+
+// Vignetting over the off-axis grid of <vignetting/>, written as SIXTE vignetting file. Every direction is
+// one lossless trace on all workers, weighted like simulate_effective_area, and divided by the on-axis area.
+void simulate_vignetting(PhotonEngine &engine, int n_photons, VignettingOptions options, const Reflectivity *coating) {
+    if (spectrum)
+        options.grid = *spectrum;
+    const double z_start = engine.telescope().get_focal_length()*2+200;
+    const ConstantReflectivity constant(options.reflectivity);
+    const Reflectivity &reflectivity = coating != nullptr ? *coating : constant;
+    VignettingMap map(options);
+
+    // Effective area [cm^2] of one direction, theta [arcmin] and phi [deg]
+    auto area = [&](double theta, double phi) {
+        const double theta_rad = theta / 60 * M_PI / 180, phi_rad = phi * M_PI / 180;
+        const Vec3fa direction((float) (std::sin(theta_rad) * std::cos(phi_rad)),
+                               (float) (std::sin(theta_rad) * std::sin(phi_rad)), (float) -std::cos(theta_rad));
+        // The square has to cover the shells after the walk off of the tilted rays
+        const double half = 200 + z_start * std::tan(theta_rad);
+        const ApertureSource aperture = aperture_source(engine.telescope(), n_photons, half, -half, direction,
+                                                        z_start, 1000);
+        return trace_throughput(engine, n_photons, aperture, options.grid, reflectivity)
+                .effective_area(aperture.area / 100, n_photons);
+    };
+
+    using std::chrono::high_resolution_clock;
+    auto t1 = high_resolution_clock::now();
+    const std::vector<double> on_axis = area(0, 0);
+    map.set_on_axis(on_axis);
+    std::size_t directions = 1;
+    for (std::size_t p = 0; p < options.phi.size(); p++)
+        for (std::size_t t = 0; t < options.theta.size(); t++) {
+            // On axis the azimuth does not matter, the normalisation is exactly 1 there
+            if (options.theta[t] == 0) {
+                map.set(t, p, on_axis);
+                continue;
+            }
+            map.set(t, p, area(options.theta[t], options.phi[p]));
+            directions++;
+        }
+    std::chrono::duration<double, std::milli> ms_double = high_resolution_clock::now() - t1;
+    std::cout << "time for " << directions << " directions of " << n_photons << " photons: " << ms_double.count()
+              << "ms\n";
+    map.write_fits(options.filename);
+    std::cout << "vignetting written to " << options.filename << "\n";
+}
+
+void simulate_on_axis_psf_ggx_ggx(PhotonEngine &engine, int n_photons) {
     for (double ii = 0; ii < 0.001; ii+=0.00001) {
         for (double jj = 0; jj < 0.001; jj+=0.00001) {
-            telescope->set_surface_parameter("ggx", "ggx", ii, jj);
-            simulate_location_model_change(telescope, n_photons, 0, 0, "ggx_" + std::to_string(ii) + "ggx_" + std::to_string(jj));
+            engine.telescope().set_surface_parameter("ggx", "ggx", ii, jj);
+            simulate_location_model_change(engine, n_photons, 0, 0, "ggx_" + std::to_string(ii) + "ggx_" + std::to_string(jj));
         }
     }
 
     for (double ii = 0; ii < 0.001; ii+=0.00001) {
         for (double jj = 0; jj < 0.001; jj+=0.00001) {
-            telescope->set_surface_parameter("beckmann", "ggx", ii, jj);
-            simulate_location_model_change(telescope, n_photons, 0, 0, "beckmann_" + std::to_string(ii) + "ggx_" + std::to_string(jj));
+            engine.telescope().set_surface_parameter("beckmann", "ggx", ii, jj);
+            simulate_location_model_change(engine, n_photons, 0, 0, "beckmann_" + std::to_string(ii) + "ggx_" + std::to_string(jj));
         }
     }
 
     for (double ii = 0; ii < 0.001; ii+=0.00001) {
         for (double jj = 0; jj < 0.001; jj+=0.00001) {
-            telescope->set_surface_parameter("ggx", "beckmann", ii, jj);
-            simulate_location_model_change(telescope, n_photons, 0, 0, "ggx_" + std::to_string(ii) + "beckmann_" + std::to_string(jj));
+            engine.telescope().set_surface_parameter("ggx", "beckmann", ii, jj);
+            simulate_location_model_change(engine, n_photons, 0, 0, "ggx_" + std::to_string(ii) + "beckmann_" + std::to_string(jj));
         }
     }
 
     for (double ii = 0; ii < 0.001; ii+=0.00001) {
         for (double jj = 0; jj < 0.001; jj+=0.00001) {
-            telescope->set_surface_parameter("beckmann", "beckmann", ii, jj);
-            simulate_location_model_change(telescope, n_photons, 0, 0, "beckmann_" + std::to_string(ii) + "beckmann_" + std::to_string(jj));
+            engine.telescope().set_surface_parameter("beckmann", "beckmann", ii, jj);
+            simulate_location_model_change(engine, n_photons, 0, 0, "beckmann_" + std::to_string(ii) + "beckmann_" + std::to_string(jj));
         }
     }
 }
@@ -241,7 +562,15 @@ static bool parse_csv_photon_line(const std::string& line, CSVPhoton& out)
     return true;
 }
 
-void retrace_from_csv_same_photons(const std::unique_ptr<MirrorModule>& telescope,
+// What is written of a retraced photon, taken from the ray while its history storage is alive
+struct retrace_entry {
+    std::optional<Vec3fa> hit;      // position on the sensor
+    std::size_t history_len = 0;
+    std::string history;
+    bool truncated = false;
+};
+
+void retrace_from_csv_same_photons(PhotonEngine &engine,
                                    const std::string& inCsvPath,
                                    const std::string& outCsvPath)
 {
@@ -266,30 +595,49 @@ void retrace_from_csv_same_photons(const std::unique_ptr<MirrorModule>& telescop
             << "history_len,"
             << "history_flat\n";
 
-    uint64_t total = 0, hits = 0;
+    // Read everything first, the photons are then traced in parallel and written back in input order
+    std::vector<CSVPhoton> photons;
     std::string line;
     while (std::getline(in, line)) {
         CSVPhoton p;
         if (!parse_csv_photon_line(line, p)) continue;
-        total++;
+        photons.push_back(p);
+    }
 
+    std::vector<retrace_entry> traced = engine.map<retrace_entry>(photons.size(),
+            [&](MirrorModule &context, std::size_t i) -> std::optional<retrace_entry> {
+        const CSVPhoton &p = photons[i];
         // Create lvalues (no temporaries) for Ray ctor
         Vec3fa o((float)p.ex, (float)p.ey, (float)p.ez);
         Vec3fa d((float)p.dx, (float)p.dy, (float)p.dz);
         Ray ray(o, d, 277.0f);
+        RayStorage storage = context.ray_storage(1);
+        storage.bind(ray, 0);
+        retrace_entry entry;
+        if (context.ray_trace(ray)) {
+            entry.hit = ray.position();
+            entry.history_len = ray.raytracing_history.size();
+            entry.history = print_rt_hist(ray.raytracing_history);
+        }
+        entry.truncated = ray.raytracing_history.truncated();
+        return entry;
+    });
 
-        std::optional<Ray> hit = telescope->ray_trace(ray);
+    uint64_t total = photons.size(), hits = 0, truncated = 0;
+    for (std::size_t i = 0; i < photons.size(); i++) {
+        const CSVPhoton &p = photons[i];
+        const retrace_entry &entry = traced[i];
+        truncated += entry.truncated;
 
-        if (hit) {
+        if (entry.hit) {
             hits++;
-            const Ray& hr = *hit;
             out << p.id << ","
                 << p.ex << "," << p.ey << "," << p.ez << ","
                 << p.dx << "," << p.dy << "," << p.dz << ","
                 << 1 << ","
-                << hr.position().x << "," << hr.position().y << "," << hr.position().z << ","
-                << hr.raytracing_history.size() << ",\""
-                << print_rt_hist(hr.raytracing_history) << "\"\n";
+                << entry.hit->x << "," << entry.hit->y << "," << entry.hit->z << ","
+                << entry.history_len << ",\""
+                << entry.history << "\"\n";
         } else {
             out << p.id << ","
                 << p.ex << "," << p.ey << "," << p.ez << ","
@@ -302,34 +650,37 @@ void retrace_from_csv_same_photons(const std::unique_ptr<MirrorModule>& telescop
     std::cout << "[CSV Retrace] traced " << total
               << " photons; sensor hits = " << hits
               << " -> wrote " << outCsvPath << "\n";
+    if (truncated > 0)
+        std::cerr << "[CSV Retrace] " << truncated << " photons hit more than " << RayHistory::capacity
+                  << " surfaces, only the first ones are in their history\n";
 }
 
 
-void simulate_row_on_different_energies(const std::unique_ptr<MirrorModule> &telescope, int n_photons) {
+void simulate_row_on_different_energies(PhotonEngine &engine, int n_photons) {
     for (int i = 300; i <= 10000; i+=100) {
-        simulate_psf_row(telescope, n_photons, (double) i);
+        simulate_psf_row(engine, n_photons, (double) i);
     }
 }
 
-void simulate_psf_moving_around(const std::unique_ptr<MirrorModule> &telescope, int n_photons) {
+void simulate_psf_moving_around(PhotonEngine &engine, int n_photons) {
     int idx=0;
     for (int i = 0; i <= 100; i++) {
-        simulate_location(telescope, n_photons, 0.0001*i, 0,1000.0,idx);
+        simulate_location(engine, n_photons, 0.0001*i, 0,1000.0,idx);
         idx++;
     }
     for (int i = 0; i <= 100; i++) {
-        simulate_location(telescope, n_photons, 0.0001*100,0.0001*i,1000.0, idx);
+        simulate_location(engine, n_photons, 0.0001*100,0.0001*i,1000.0, idx);
         idx++;
     }
 
     for (int i = 100; i >= 0; i--) {
-        simulate_location(telescope, n_photons, 0.0001*i, 0.0001*i,1000.0, idx);
+        simulate_location(engine, n_photons, 0.0001*i, 0.0001*i,1000.0, idx);
         idx++;
     }
 }
 
-void simulate_2D(const std::unique_ptr<MirrorModule> &telescope, int n_photons) {
-    simulate_location(telescope, n_photons, 0, 0, 1000.0);
+void simulate_2D(PhotonEngine &engine, int n_photons) {
+    simulate_location(engine, n_photons, 0, 0, 1000.0);
 }
 /* --------------------------- end NEW: CSV retrace --------------------------- */
 #include <filesystem>
@@ -359,22 +710,60 @@ int main(int argc, char *argv[]) {
     std::chrono::duration<double, std::milli> ms_double = t2 - t1;
     std::cout << "Time loading and creating mirror_module: " << ms_double.count() << "ms\n";
 
+    XMLData xml_data{path};
+    output_options = output_options_from_xml(xml_data);
+    statistics_options = PsfStatisticsOptions::from_xml(xml_data);
+    aperture_options = aperture_options_from_xml(xml_data);
+    // A stop inside a stratified block would leave its last slices of the annuli unsampled
+    if (statistics_options && aperture_options.annuli && statistics_options->check_every % aperture_options.block != 0)
+        throw std::runtime_error("statistics: check_every (" + std::to_string(statistics_options->check_every)
+                                 + ") must be a multiple of aperture_block (" + std::to_string(aperture_options.block)
+                                 + ") with aperture=\"annuli\"");
+    const auto effective_area = EffectiveAreaOptions::from_xml(xml_data);
+    const auto vignetting = VignettingOptions::from_xml(xml_data);
+    spectrum = EnergyGrid::spectrum_from_xml(xml_data);
+    // The engine clones the telescope, so the spectrum and coating have to be set before it
+    const std::shared_ptr<const Reflectivity> coating = telescope->reflectivity();
+    if (spectrum) {
+        if (coating == nullptr)
+            throw std::runtime_error("spectrum: the spectral mode needs a <reflectivity/> coating");
+        telescope->set_spectrum(std::make_shared<const std::vector<double>>(spectrum->mids()));
+        output_options.photon_file.spectral_bins = spectrum->size();
+    } else if (effective_area || vignetting) {
+        // The effective area applies the coating to the hits itself, so its trace has to be lossless and
+        // keep the grazing angles
+        telescope->set_reflectivity(nullptr);
+        telescope->set_record_grazing_angles(true);
+    }
+    // Only the throughput counts for the vignetting map, rays the spider stops end with one any-hit query
+    if (vignetting)
+        telescope->set_blocker_prepass(true);
+    PhotonEngine engine(*telescope, xml_data);
+    std::cout << "Tracing on " << engine.n_threads() << " threads, seed " << engine.seed() << "\n";
+
     if (argc >= 3) {
         // NEW: retrace exactly the photons listed in bake_rays.csv
         const std::string inCsv  = argv[2];
         const std::string outCsv = "embree_retrace.csv";
-        retrace_from_csv_same_photons(telescope, inCsv, outCsv);
+        retrace_from_csv_same_photons(engine, inCsv, outCsv);
     } else {
-        XMLData xml_data{path};
         auto raytracing = xml_data.child("telescope").child("raytracer");
         int n_photons =  raytracing.child("simulation_details").attributeAsInt("n_photons");
         // (commented) old code paths; leave here for quick toggle
-        simulate_psfs_single_thread(telescope, n_photons);
-        //simulate_row_on_different_energies(telescope, n_photons);
-        //simulate_location(telescope, n_photons, 0, 0, 1000.0);
-        //simulate_psf_moving_around(telescope, n_photons);
-        //simulate_on_axis_psf_ggx_ggx(telescope, /*n_photons*/ 1000000);
-        //simulate_2D(telescope, n_photons);
+        if (vignetting)
+            simulate_vignetting(engine, n_photons, *vignetting, coating.get());
+        else if (effective_area)
+            simulate_effective_area(engine, n_photons, *effective_area, coating.get());
+        else
+            simulate_psfs(engine, n_photons);
+        //simulate_row_on_different_energies(engine, n_photons);
+        //simulate_location(engine, n_photons, 0, 0, 1000.0);
+        //simulate_psf_moving_around(engine, n_photons);
+        //simulate_on_axis_psf_ggx_ggx(engine, /*n_photons*/ 1000000);
+        //simulate_2D(engine, n_photons);
+        if (engine.truncated_histories() > 0)
+            std::cerr << engine.truncated_histories() << " rays hit more than " << RayHistory::capacity
+                      << " surfaces, only the first ones are in their history\n";
         std::cout << "No CSV provided; nothing to retrace. Pass bake_rays.csv as argv[2].\n";
     }
 }